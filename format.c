@@ -2,6 +2,16 @@
 #include <string.h>   
 #include <errno.h>   
 #include <assert.h>  
+#include <limits.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FORMAT_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define FORMAT_USE_SSE2 0
+#endif
  
 #include "format.h"
 
@@ -20,8 +30,51 @@
   
 #define NUMBER_BUFFER_LENGTH 511
 #define NUMBER_DEFAULT_PRECISION 6
+//every significant digit of a double and a rounding carry, see DECINT_BASE_SIZE
+#define NUMBER_CVT_LENGTH 800
+#define NUMBER_SEGMENT_COUNT 8
+#define NUMBER_FILL_BLOCK 64
+//bytes of a %*ph buffer encoded at a time, 3 characters each with separators
+#define HEX_CHUNK_BYTES 128
+#define HEX_DUMP_LINE_BYTES 16
+
+//escaping variants of %s, see _vformat_escape
+#define ESCAPE_JSON 1
+#define ESCAPE_CSV 2        //inside a quoted field, only '"' is doubled
+#define ESCAPE_CSV_FIELD 3  //characters that make a field need quotes
+#define ESCAPE_URL 4
+
+//%Us counts code points, %UUs display columns, see _vformat_utf8_prefix
+#define UTF8_CODE_POINTS 1
+#define UTF8_COLUMNS 2
+#define UTF8_UTF16_UNITS 3  //%s of osl_vformat_units(16), a code point above U+FFFF takes 2
 typedef int ibool;
 
+//argument types of integer conversions, resolved from the length modifier while parsing
+#define ARG_CHAR 1
+#define ARG_SHORT 2
+#define ARG_INT 3
+#define ARG_INT64 4
+#define ARG_INT128 5
+//the argument type of an integer type with the maximum value max, a constant expression
+#define ARG_TYPE_OF_MAX(max) \
+  ((max) > INT32_MAX ? ARG_INT64 : (max) > INT16_MAX ? ARG_INT : (max) > INT8_MAX ? ARG_SHORT : ARG_CHAR)
+
+//a piece of a converted number, runs of fill characters are never materialized
+typedef struct OslFormatSegment OslFormatSegment;
+struct OslFormatSegment {
+  const char* sz;   //NULL for a run of fill
+  char fill;
+  intptr_t len;
+};
+
+typedef struct OslFormatSegments OslFormatSegments;
+struct OslFormatSegments {
+  int count;
+  intptr_t len;
+  OslFormatSegment items[NUMBER_SEGMENT_COUNT];
+};
+
 typedef struct OslFormatter OslFormatter;
 struct OslFormatter {
   int width;
@@ -32,11 +85,28 @@ struct OslFormatter {
   ibool prefix_blank;
   ibool alternate_form;
   ibool specifieris_upper;
+  int utf8_mode;            //0 for bytes, UTF8_CODE_POINTS or UTF8_COLUMNS
+  int string_mode;          //the utf8_mode of a %s without U, see osl_vformat_units
    
   OslFormatWriteFunc writefunc;
   void* userData;
   intptr_t count;
 
+  //resumable output, see osl_vformat_resume
+  OslFormatResume* resume;
+  const char* format;
+  intptr_t replay_offset;   //pieces before this offset were emitted by an earlier call
+  const char* piece;        //literal run or conversion being emitted
+  int piece_arg_index;
+  intptr_t piece_emitted;
+  intptr_t skip;            //bytes of the current piece the sink already accepted
+  int arg_index;
+  ibool would_block;
+
+  //bounded output, see osl_vformat_limit
+  intptr_t limit;           //-1 for unlimited
+  ibool truncated;
+
   char tempbuf[NUMBER_BUFFER_LENGTH + 1];
   //char cvtbuf[NUMBER_BUFFER_LENGTH + 1];
 };
@@ -65,8 +135,109 @@ intptr_t osl_vformat(OslFormatWriteFunc writefunc, void* userData, const char* s
   formatter.userData = userData;
   if (writefunc == NULL)
     formatter.writefunc = _vformat_null_write;
+  formatter.resume = NULL;
+  formatter.replay_offset = 0;
+  formatter.limit = -1;
+  formatter.string_mode = 0;
   return _vformat_impl(&formatter, szformat, argptr);
 }   
+
+/// <summary>
+/// Like osl_vformat, but widths and precisions of %s count the code units of the output
+/// once it is converted to UTF-16 (unit_bits 16) or UTF-32 (unit_bits 32), for the wide entry points.
+/// A multi-byte character is never cut. Other unit_bits count bytes like osl_vformat.
+/// </summary>
+intptr_t osl_vformat_units(OslFormatWriteFunc writefunc, void* userData, int unit_bits, const char* szformat, va_list argptr) {
+  OslFormatter formatter;
+  formatter.count = 0;
+  formatter.writefunc = writefunc;
+  formatter.userData = userData;
+  if (writefunc == NULL)
+    formatter.writefunc = _vformat_null_write;
+  formatter.resume = NULL;
+  formatter.replay_offset = 0;
+  formatter.limit = -1;
+  formatter.string_mode = unit_bits == 16 ? UTF8_UTF16_UNITS : unit_bits == 32 ? UTF8_CODE_POINTS : 0;
+  return _vformat_impl(&formatter, szformat, argptr);
+}
+
+void osl_format_resume_init(OslFormatResume* resume) {
+  resume->format_offset = 0;
+  resume->field_emitted = 0;
+  resume->arg_index = 0;
+  resume->count = 0;
+}
+
+/// <summary>
+/// Like osl_vformat, but a writefunc that accepts fewer bytes than offered
+/// suspends the formatter instead of failing.
+/// The first call uses a resume state from osl_format_resume_init, later calls
+/// pass the same state, format and arguments (a fresh va_list) to continue.
+/// Conversions completed by an earlier call are skipped without being converted again,
+/// the partially emitted one is regenerated and its accepted bytes are dropped.
+/// </summary>
+/// <param name="resume">state shared by the calls of one formatting operation</param>
+/// <returns>the total number of characters written once finished,
+/// OSL_FORMAT_WOULD_BLOCK when the sink is full, or a negative value on error</returns>
+intptr_t osl_vformat_resume(OslFormatResume* resume, OslFormatWriteFunc writefunc, void* userData, const char* szformat, va_list argptr) {
+  OslFormatter formatter;
+  intptr_t rv;
+  if (writefunc == NULL)
+    return osl_vformat(writefunc, userData, szformat, argptr);
+  formatter.count = resume->count;
+  formatter.writefunc = writefunc;
+  formatter.userData = userData;
+  formatter.resume = resume;
+  formatter.replay_offset = resume->format_offset;
+  formatter.limit = -1;
+  formatter.string_mode = 0;
+  rv = _vformat_impl(&formatter, szformat, argptr);
+  if (rv < 0 && formatter.would_block) {
+    resume->format_offset = formatter.piece - szformat;
+    resume->field_emitted = formatter.piece_emitted;
+    resume->arg_index = formatter.piece_arg_index;
+    resume->count = formatter.count;
+    return OSL_FORMAT_WOULD_BLOCK;
+  }
+  osl_format_resume_init(resume);
+  return rv;
+}
+
+/// <summary>
+/// Like osl_vformat, but writes at most max_bytes characters.
+/// Once a byte is dropped nothing else is converted: later conversions are skipped,
+/// strings are only scanned as far as they can be shown and float digits past the limit are not produced.
+/// Output that ends exactly at the limit is not truncated.
+/// </summary>
+/// <param name="max_bytes">maximum number of characters written before the marker</param>
+/// <param name="marker">appended after the output when it was truncated, may be NULL</param>
+/// <returns>the number of characters written including the marker, or a negative value on error</returns>
+intptr_t osl_vformat_limit(OslFormatWriteFunc writefunc, void* userData, intptr_t max_bytes,
+  const char* marker, const char* szformat, va_list argptr) {
+  OslFormatter formatter;
+  intptr_t rv;
+  formatter.count = 0;
+  formatter.writefunc = writefunc;
+  formatter.userData = userData;
+  if (writefunc == NULL)
+    formatter.writefunc = _vformat_null_write;
+  formatter.resume = NULL;
+  formatter.replay_offset = 0;
+  formatter.limit = max_bytes < 0 ? 0 : max_bytes;
+  formatter.truncated = FALSE;
+  formatter.string_mode = 0;
+  rv = _vformat_impl(&formatter, szformat, argptr);
+  if (rv < 0 && formatter.truncated) {
+    rv = formatter.count;
+    if (marker != NULL) {
+      intptr_t marker_len = strlen(marker);
+      if (formatter.writefunc(userData, marker, marker_len) != marker_len)
+        return -1;
+      rv += marker_len;
+    }
+  }
+  return rv;
+}
 static const char _digits_upper[] = "0123456789ABCDEF";
 static const char _digits_lower[] = "0123456789abcdef";
 #define INT_STR_BUF_LENGTH 64 
@@ -116,23 +287,111 @@ DEFINE_ITOA(_vformat_u32toa10, uint32_t, 10)
 DEFINE_ITOA(_vformat_u64toa10, uint64_t, 10)
 DEFINE_ITOA16(_vformat_u64toa16, uint64_t)
 
+/// <summary>
+/// Starts a literal run or a conversion.
+/// </summary>
+/// <returns>TRUE if an earlier call of osl_vformat_resume already emitted the whole piece</returns>
+static ibool _vformat_begin_piece(OslFormatter* formatter, const char* pos) {
+  intptr_t offset = pos - formatter->format;
+  formatter->piece = pos;
+  formatter->piece_arg_index = formatter->arg_index;
+  formatter->piece_emitted = 0;
+  formatter->skip = 0;
+  if (offset < formatter->replay_offset)
+    return TRUE;
+  if (offset == formatter->replay_offset && formatter->resume)
+    formatter->skip = formatter->resume->field_emitted;
+  return FALSE;
+}
+
 static ibool _vformat_append(OslFormatter* formatter, const char* start, intptr_t len) {
+  intptr_t written;
   if (len <= 0)
     return TRUE;
-  if (formatter->writefunc(formatter->userData, start, len) < 0)
+  if (formatter->skip > 0) {
+    //accepted by the sink before the formatter was suspended
+    intptr_t skip = formatter->skip < len ? formatter->skip : len;
+    formatter->skip -= skip;
+    formatter->piece_emitted += skip;
+    start += skip;
+    len -= skip;
+    if (len == 0)
+      return TRUE;
+  }
+  if (formatter->limit >= 0 && len > formatter->limit - formatter->count) {
+    len = formatter->limit - formatter->count;
+    formatter->truncated = TRUE;
+    if (len > 0 && formatter->writefunc(formatter->userData, start, len) >= 0)
+      formatter->count += len;
+    return FALSE;
+  }
+  written = formatter->writefunc(formatter->userData, start, len);
+  if (written < 0)
     return FALSE;
+  if (formatter->resume && written < len) {
+    formatter->count += written;
+    formatter->piece_emitted += written;
+    formatter->would_block = TRUE;
+    return FALSE;
+  }
   formatter->count += len;
+  formatter->piece_emitted += len;
   return TRUE;
 }
 
 static ibool _vformat_append_nchar(OslFormatter* formatter, char ch, intptr_t count) {
+  char block[NUMBER_FILL_BLOCK];
   if (count <= 0)
     return TRUE;
-  for (intptr_t i = 0; i < count; i++) {
-    if (formatter->writefunc(formatter->userData, &ch, 1) < 0)
+  memset(block, ch, count < NUMBER_FILL_BLOCK ? count : NUMBER_FILL_BLOCK);
+  while (count > 0) {
+    intptr_t n = count < NUMBER_FILL_BLOCK ? count : NUMBER_FILL_BLOCK;
+    if (!_vformat_append(formatter, block, n))
+      return FALSE;
+    count -= n;
+  }
+  return TRUE;
+}
+
+static void _vformat_segments_init(OslFormatSegments* segs) {
+  segs->count = 0;
+  segs->len = 0;
+}
+
+static void _vformat_segments_add(OslFormatSegments* segs, const char* sz, intptr_t len) {
+  if (len <= 0)
+    return;
+  assert(segs->count < NUMBER_SEGMENT_COUNT);
+  OslFormatSegment* seg = segs->items + segs->count;
+  seg->sz = sz;
+  seg->fill = 0;
+  seg->len = len;
+  segs->count++;
+  segs->len += len;
+}
+
+static void _vformat_segments_fill(OslFormatSegments* segs, char fill, intptr_t len) {
+  if (len <= 0)
+    return;
+  assert(segs->count < NUMBER_SEGMENT_COUNT);
+  OslFormatSegment* seg = segs->items + segs->count;
+  seg->sz = NULL;
+  seg->fill = fill;
+  seg->len = len;
+  segs->count++;
+  segs->len += len;
+}
+
+static ibool _vformat_append_segments(OslFormatter* formatter, const OslFormatSegments* segs) {
+  for (int i = 0; i < segs->count; i++) {
+    const OslFormatSegment* seg = segs->items + i;
+    if (seg->sz) {
+      if (!_vformat_append(formatter, seg->sz, seg->len))
+        return FALSE;
+    }
+    else if (!_vformat_append_nchar(formatter, seg->fill, seg->len))
       return FALSE;
   }
-  formatter->count += count;
   return TRUE;
 }
  
@@ -184,8 +443,9 @@ static ibool _vformat_append_with_prefix(OslFormatter* formatter, const char* pr
   return TRUE;
 }
 
-static ibool _vformat_append_with_prefix_double(OslFormatter* formatter, const char* prefix, int prefixLen, const char* digits, intptr_t len) {
+static ibool _vformat_append_with_prefix_double(OslFormatter* formatter, const char* prefix, int prefixLen, const OslFormatSegments* segs) {
   
+  intptr_t len = segs->len;
   intptr_t padding_zero_count = 0;
   intptr_t padding_black_count = formatter->width - len - prefixLen;
   if (padding_black_count < 0)
@@ -208,7 +468,7 @@ static ibool _vformat_append_with_prefix_double(OslFormatter* formatter, const c
     return FALSE;
   }
 
-  if (!_vformat_append(formatter, digits, len))
+  if (!_vformat_append_segments(formatter, segs))
     return FALSE;
 
   if (formatter->left_align) {
@@ -253,6 +513,12 @@ static ibool _vformat_append_integer(OslFormatter* formatter, unsigned int base,
         }
       }
     }
+    else if (base == 2) {
+      if (digits != NULL && digits[0] != '0') {
+        prefixLen = 2;
+        prefix = formatter->specifieris_upper ? "0B" : "0b";
+      }
+    }
     else {
       if (digits == NULL || digits[0] != '0') {
         prefix = "0";
@@ -264,6 +530,29 @@ static ibool _vformat_append_integer(OslFormatter* formatter, unsigned int base,
   return _vformat_append_with_prefix(formatter, prefix, prefixLen, digits, len);
 }
  
+extern int u64tos(uint64_t value, char* buf);
+
+//the number of significant bits of value != 0
+static int _vformat_bit_length(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 64 - __builtin_clzll(value);
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return (int)index + 1;
+#else
+  int bits = 0;
+  while (value != 0) {
+    bits++;
+    value >>= 1;
+  }
+  return bits;
+#endif
+}
+
+static const char _binary_nibbles[] =
+  "0000000100100011010001010110011110001001101010111100110111101111";
+
 static ibool _vformat_uint64(OslFormatter* formatter, uint64_t value, unsigned int base, ibool neg) {
   const char* digits;
   char* buf = formatter->tempbuf;
@@ -279,13 +568,8 @@ static ibool _vformat_uint64(OslFormatter* formatter, uint64_t value, unsigned i
   pos = buf + NUMBER_BUFFER_LENGTH;
 
   if (base == 10) {
-    for (;;) {
-      *pos = '0'+value % 10;
-      value /= 10;
-      if (value == 0)
-        break;
-      pos--;
-    }
+    len = u64tos(value, buf);
+    return _vformat_append_integer(formatter, base, neg, buf, len);
   }
   else if (base == 16) {
     for (;;) {
@@ -305,6 +589,16 @@ static ibool _vformat_uint64(OslFormatter* formatter, uint64_t value, unsigned i
       pos--;
     }
   }
+  else if (base == 2) {
+    //the length is known from a bit scan, four digits per nibble
+    int bits = value == 0 ? 1 : _vformat_bit_length(value);
+    char* end = buf + NUMBER_BUFFER_LENGTH + 1;
+    for (pos = end - 4; pos + 4 > end - bits; pos -= 4) {
+      memcpy(pos, _binary_nibbles + (value & 15) * 4, 4);
+      value >>= 4;
+    }
+    pos = end - bits;
+  }
   else {
     return FALSE;
   }
@@ -325,33 +619,56 @@ static ibool _vformat_int64(OslFormatter* formatter, int64_t value, unsigned int
   return _vformat_uint64(formatter, val, base, neg);
 }
 
-static ibool _vformat_append_string(OslFormatter* formatter, const char* sz, intptr_t len) {
-  if (len < formatter->width) {
-    if (!formatter->left_align) {
-      intptr_t delta = formatter->width - len;
-      while (delta) {
-        delta--;
-        if (!_vformat_append(formatter, " ", 1))
-          return FALSE;
-      }
-    }
+#if defined(__SIZEOF_INT128__)
+static ibool _vformat_uint128(OslFormatter* formatter, osl_uint128_t value, unsigned int base, ibool neg) {
+  const char* digits;
+  char* buf = formatter->tempbuf;
+  char* pos;
+  if ((value >> 64) == 0)
+    return _vformat_uint64(formatter, (uint64_t)value, base, neg);
+  if (base == 10)
+    return _vformat_append_integer(formatter, base, neg, buf, osl_u128tos(value, buf));
+  if (formatter->specifieris_upper)
+    digits = _digits_upper;
+  else
+    digits = _digits_lower;
+  //base 2, 8 and 16 need shifts only
+  pos = buf + NUMBER_BUFFER_LENGTH + 1;
+  while (value != 0) {
+    pos--;
+    *pos = digits[(unsigned int)value & (base - 1)];
+    value >>= (base == 16 ? 4 : base == 8 ? 3 : 1);
+  }
+  return _vformat_append_integer(formatter, base, neg, pos, buf + NUMBER_BUFFER_LENGTH + 1 - pos);
+}
+
+static ibool _vformat_int128(OslFormatter* formatter, osl_int128_t value, unsigned int base) {
+  if (value < 0)
+    return _vformat_uint128(formatter, (osl_uint128_t)0 - (osl_uint128_t)value, base, TRUE);
+  return _vformat_uint128(formatter, (osl_uint128_t)value, base, FALSE);
+}
+#endif // __SIZEOF_INT128__
+
+//len bytes of sz padded to the width, the text takes columns of the width
+static ibool _vformat_append_text(OslFormatter* formatter, const char* sz, intptr_t len, intptr_t columns) {
+  if (columns < formatter->width && !formatter->left_align) {
+    if (!_vformat_append_nchar(formatter, ' ', formatter->width - columns))
+      return FALSE;
   }
   if (!_vformat_append(formatter, sz, len))
     return FALSE;
-  if (len < formatter->width) {
-    if (formatter->left_align) {
-      intptr_t delta = formatter->width - len;
-      while (delta) {
-        delta--;
-        if (!_vformat_append(formatter, " ", 1))
-          return FALSE;
-      }
-    }
+  if (columns < formatter->width && formatter->left_align) {
+    if (!_vformat_append_nchar(formatter, ' ', formatter->width - columns))
+      return FALSE;
   }
   return TRUE;
 }
 
-static ibool _vformat_append_double(OslFormatter* formatter, ibool neg, const char* digits, intptr_t len) {
+static ibool _vformat_append_string(OslFormatter* formatter, const char* sz, intptr_t len) {
+  return _vformat_append_text(formatter, sz, len, len);
+}
+
+static ibool _vformat_append_double(OslFormatter* formatter, ibool neg, const OslFormatSegments* segs) {
   const char* prefix = NULL;
   int prefixLen = 0;
 
@@ -368,344 +685,1042 @@ static ibool _vformat_append_double(OslFormatter* formatter, ibool neg, const ch
     prefixLen = 1;
   }
 
-  return _vformat_append_with_prefix_double(formatter, prefix, prefixLen, digits, len);
+  return _vformat_append_with_prefix_double(formatter, prefix, prefixLen, segs);
 }
 
-static ibool _vformat_string(OslFormatter* formatter, const char* sz) {
-  intptr_t len;
-  if (sz == NULL) {
-    sz = "(null)";
+//the position of the lowest set bit of mask != 0
+static int _vformat_ctz(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  int index = 0;
+  while ((mask & 1) == 0) {
+    mask >>= 1;
+    index++;
   }
-  len = strlen(sz);
-  if (formatter->precision >= 0 && len > formatter->precision) {
-    len = formatter->precision;
-  }
-  return _vformat_append_string(formatter, sz, len);
+  return index;
+#endif
+}
+
+/// <summary>
+/// strlen bounded by maxlen, bytes from sz + maxlen on and past the terminating null are never read,
+/// so sz may be an array without a terminator
+/// </summary>
+static intptr_t _vformat_strnlen(const char* sz, intptr_t maxlen) {
+  const char* end;
+  if (maxlen <= 0)
+    return 0;
+  end = (const char*)memchr(sz, 0, maxlen);
+  return end ? end - sz : maxlen;
 }
 
-static char* _vformat_remove_trailing_zero_guard(const char* guard, const char* pos, ibool keepDot) {
-  while (pos > guard && (*pos == '0')) {
+void osl_format_counter_init(OslFormatCounter* counter, uint64_t value) {
+  char* pos = counter->digits + OSL_COUNTER_DIGITS;
+  counter->value = value;
+  memset(counter->digits, '0', OSL_COUNTER_DIGITS);
+  do {
     pos--;
+    *pos = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  counter->length = (int)(counter->digits + OSL_COUNTER_DIGITS - pos);
+}
+
+/// <summary>
+/// Adds one to the counter, updating the ASCII digits in place
+/// </summary>
+void osl_format_counter_inc(OslFormatCounter* counter) {
+  char* pos = counter->digits + OSL_COUNTER_DIGITS - 1;
+  counter->value++;
+  if (counter->value == 0) {
+    osl_format_counter_init(counter, 0);
+    return;
   }
-  if (!keepDot && *pos == '.') {
-    return (char*)pos;
+  while (*pos == '9') {
+    *pos = '0';
+    pos--;
   }
-  return (char*)(pos + 1);
+  (*pos)++;
+  if (pos < counter->digits + OSL_COUNTER_DIGITS - counter->length)
+    counter->length++;
 }
- 
-/*
-For a conversion, the double argument is converted to hexadecimal notation
-(using the letters abcdef) in the style [-]0xh.hhhhp; for A conversion the prefix 0X,
-the letters ABCDEF, and the exponent separator P is used.
-There is one hexadecimal digit before the decimal point,
-and the number of digits after it is equal to the precision.
-The default precision suffices for an exact representation of the value
-if an exact representation in base 2 exists and otherwise is sufficiently
-large to distinguish values of type double. The digit before
-the decimal point is unspecified for nonnormalized numbers,
-and nonzero but otherwise unspecified for normalized numbers.
-*/
 
-typedef double float64_t;
-union ui64_f64 { uint64_t ui; float64_t f; };
-#define signF64UI( a ) ((int_fast16_t) ((uint64_t) (a)>>63))
-#define expF64UI( a ) ((int32_t) ((a)>>52) & 0x7FF)
-#define fracF64UI( a ) ((a) & UINT64_C( 0x000FFFFFFFFFFFFF ))
- 
-static intptr_t _vformat_hcvt_ieee754d64(OslFormatter* formatter, char* buf,
-  intptr_t  buf_count,
-  double  value,
-  int precision, int* prefix_len) {
-    
-  *prefix_len = 2; 
-  char* pos = buf;
-   
-  if (value >= 0) {
-    if (formatter->with_sign) {
-      *pos = '+';
-      pos++;
-      (*prefix_len)++;
-    }
-    else if (formatter->prefix_blank) {
-      *pos = ' ';
-      pos++;
-      (*prefix_len)++;
-    }
+static ibool _vformat_counter(OslFormatter* formatter, const OslFormatCounter* counter) {
+  const char* digits = counter->digits + OSL_COUNTER_DIGITS - counter->length;
+  formatter->with_sign = FALSE;
+  formatter->prefix_blank = FALSE;
+  if (formatter->precision >= 0)
+    formatter->padding_zero = FALSE;
+  //If both the converted value and the precision are 0 the conversion results in no characters.
+  if (counter->value == 0 && formatter->precision == 0)
+    return _vformat_append_integer(formatter, 10, FALSE, NULL, 0);
+  return _vformat_append_integer(formatter, 10, FALSE, digits, counter->length);
+}
+
+/// <summary>
+/// Writes the 2 * len hex digits of src to dst, 16 bytes at a time with SSE2
+/// </summary>
+static void _vformat_hex_encode(char* dst, const unsigned char* src, intptr_t len, ibool is_upper) {
+  const char* digits = is_upper ? _digits_upper : _digits_lower;
+  intptr_t i = 0;
+#if FORMAT_USE_SSE2 == 1
+  const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero_char = _mm_set1_epi8('0');
+  const __m128i letter_offset = _mm_set1_epi8(is_upper ? 'A' - '0' - 10 : 'a' - '0' - 10);
+  for (; i + 16 <= len; i += 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+    __m128i low = _mm_and_si128(bytes, nibble_mask);
+    //high nibble first: [h0, l0, h1, l1, ...]
+    __m128i first = _mm_unpacklo_epi8(high, low);
+    __m128i second = _mm_unpackhi_epi8(high, low);
+    first = _mm_add_epi8(_mm_add_epi8(first, zero_char), _mm_and_si128(_mm_cmpgt_epi8(first, nine), letter_offset));
+    second = _mm_add_epi8(_mm_add_epi8(second, zero_char), _mm_and_si128(_mm_cmpgt_epi8(second, nine), letter_offset));
+    _mm_storeu_si128((__m128i*)(dst + i * 2), first);
+    _mm_storeu_si128((__m128i*)(dst + i * 2 + 16), second);
   }
-  else {
-    value = -value;
-    *pos = '-';
-    pos++;
-    (*prefix_len)++;
+#endif // FORMAT_USE_SSE2
+  for (; i < len; i++) {
+    dst[i * 2] = digits[src[i] >> 4];
+    dst[i * 2 + 1] = digits[src[i] & 15];
   }
-  *pos = '0';
-  pos++;
-  *pos = *pos = formatter->specifieris_upper ? 'X' : 'x';
-  pos++;
-
-  union ui64_f64 ua;
-  ua.f = value;
-  uint64_t ui = ua.ui;
-  //uint64_t sign = signF64UI(ui);
-  int32_t exponent = expF64UI(ui) - 1023;
-  uint64_t frac = fracF64UI(ui);
+}
 
-  //*pexp = exp;
-  //*pdotpos = 1;
-  uint64_t mantissa;
-  if (exponent == -1023) {
-    //mantissa = frac + (UINT64_C(1) << 52);
-    if (frac == 0) {
-      exponent = 0;
-      mantissa = 0;
+/// <summary>
+/// %*ph, len bytes of data as hex separated by separator, 0 for none
+/// </summary>
+static ibool _vformat_hex_buffer(OslFormatter* formatter, const unsigned char* data, intptr_t len, char separator) {
+  char hex[HEX_CHUNK_BYTES * 2];
+  char* buf = formatter->tempbuf;
+  for (intptr_t offset = 0; offset < len; offset += HEX_CHUNK_BYTES) {
+    intptr_t count = len - offset < HEX_CHUNK_BYTES ? len - offset : HEX_CHUNK_BYTES;
+    if (separator == 0) {
+      _vformat_hex_encode(buf, data + offset, count, formatter->specifieris_upper);
+      if (!_vformat_append(formatter, buf, count * 2))
+        return FALSE;
+      continue;
     }
-    else {
-      mantissa = frac + (UINT64_C(1) << 52);
+    _vformat_hex_encode(hex, data + offset, count, formatter->specifieris_upper);
+    char* pos = buf;
+    for (intptr_t i = 0; i < count; i++) {
+      if (offset + i > 0)
+        *pos++ = separator;
+      memcpy(pos, hex + i * 2, 2);
+      pos += 2;
     }
+    if (!_vformat_append(formatter, buf, pos - buf))
+      return FALSE;
   }
-  else {
-    mantissa = frac + (UINT64_C(1) << 52);
-  }
-  if (precision < 0)
-    precision = 13;
-  if (precision <= 12) {
-#ifdef hcvt_round_away_from_zero
-    //0x000FFFFFFFFFFFFF
-    int shift = precision * 4;
-    uint64_t round_add = (UINT64_C(0x0008000000000000) >> shift);
-    assert(round_add > 0);
-    mantissa += round_add;
-#else //hcvt_round_near_even
-    //0x000FFFFFFFFFFFFF 
-    int shift = precision * 4;
-#ifdef round_val_first
-    uint64_t round_add = (UINT64_C(0x0008000000000000) >> shift);
-    uint64_t round_val = (mantissa & (UINT64_C(0x000F000000000000) >> shift)) >> (48 - shift);
-    if (round_val == 8) {
-      uint64_t sticky_bit = (mantissa & (UINT64_C(0x0000FFFFFFFFFFFF) >> shift));
-      if (sticky_bit == 0) {
-        uint64_t guardval = (mantissa & (UINT64_C(0x00F0000000000000) >> shift)) >> (52 - shift);
-        if (((guardval) % 2) == 1)
-          mantissa += round_add;
+  return TRUE;
+}
+
+/// <summary>
+/// %*pX, a hexdump -C style dump of len bytes of data:
+/// 00000000  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 21 0a 00 01  |Hello, world!...|
+/// </summary>
+static ibool _vformat_hex_dump(OslFormatter* formatter, const unsigned char* data, intptr_t len) {
+  char hex[HEX_DUMP_LINE_BYTES * 2];
+  char* buf = formatter->tempbuf;
+  for (intptr_t offset = 0; offset < len; offset += HEX_DUMP_LINE_BYTES) {
+    intptr_t count = len - offset < HEX_DUMP_LINE_BYTES ? len - offset : HEX_DUMP_LINE_BYTES;
+    char* pos = buf;
+    for (int shift = 28; shift >= 0; shift -= 4)
+      *pos++ = _digits_lower[((uint64_t)offset >> shift) & 15];
+    *pos++ = ' ';
+    _vformat_hex_encode(hex, data + offset, count, FALSE);
+    for (int i = 0; i < HEX_DUMP_LINE_BYTES; i++) {
+      *pos++ = ' ';
+      if (i == HEX_DUMP_LINE_BYTES / 2)
+        *pos++ = ' ';
+      if (i < count) {
+        memcpy(pos, hex + i * 2, 2);
       }
       else {
-        mantissa += round_add;
-      }
-    }
-    else if (round_val > 8) {
-      mantissa += round_add;
-    }
-    else {//round_val < 8
-    }
-#elif defined(sticky_bit_first)
-    uint64_t round_add = (UINT64_C(0x0008000000000000) >> shift);
-    uint64_t sticky_bit = (mantissa & (UINT64_C(0x0000FFFFFFFFFFFF) >> shift));
-    if (sticky_bit == 0) {
-      uint64_t round_val = (mantissa & (UINT64_C(0x000F000000000000) >> shift)) >> (48 - shift);
-      if (round_val == 8) {
-        uint64_t guardval = (mantissa & (UINT64_C(0x00F0000000000000) >> shift)) >> (52 - shift);
-        if (((guardval) % 2) == 1)
-          mantissa += round_add;
-      }
-      else if (round_val > 8) {
-        mantissa += round_add;
-      }
-      else {//round_val < 8
+        pos[0] = ' ';
+        pos[1] = ' ';
       }
+      pos += 2;
     }
-    else {
-      mantissa += round_add;
+    *pos++ = ' ';
+    *pos++ = ' ';
+    *pos++ = '|';
+    for (intptr_t i = 0; i < count; i++) {
+      unsigned char ch = data[offset + i];
+      *pos++ = (ch >= 0x20 && ch < 0x7f) ? (char)ch : '.';
     }
-#else 
-    uint64_t mask = (UINT64_C(0xFFFFFFFFFFFFFFFF) << (52 - shift));
-    uint64_t mid_point = (mantissa & mask)
-      | ((UINT64_C(0x00008000000000000) >> shift));
-    if (mantissa == mid_point) {
-      mantissa += (UINT64_C(0x0007000000000000) >> shift)
-        + (mantissa & (UINT64_C(0x0010000000000000) >> shift));
-    }
-    else {
-      mantissa += (UINT64_C(0x0008000000000000) >> shift);
-    }
-    mantissa &= mask;
-#endif
-#endif 
+    *pos++ = '|';
+    *pos++ = '\n';
+    if (!_vformat_append(formatter, buf, pos - buf))
+      return FALSE;
   }
-  char tmp[32];
-  _vformat_u64toa16(mantissa, tmp,formatter->specifieris_upper);
-  const char* tpos = tmp;
+  return TRUE;
+}
 
-  //int part
-  if (exponent == -1023) {
-    *pos = '0';
-    pos++;
-    tpos++;
-    exponent += 1;
-  }
-  else {
-    *pos = *tpos;
-    pos++;
-    tpos++;
+//TRUE if ch is the terminating null or must be escaped in the mode
+static ibool _vformat_escape_needed(int mode, unsigned char ch) {
+  switch (mode) {
+  case ESCAPE_JSON:
+    return ch < 0x20 || ch == '"' || ch == '\\';
+  case ESCAPE_CSV:
+    return ch == 0 || ch == '"';
+  case ESCAPE_CSV_FIELD:
+    return ch == 0 || ch == '"' || ch == ',' || ch == '\r' || ch == '\n';
+  default:
+    //RFC 3986 unreserved characters stay as they are
+    return !(('a' <= ch && ch <= 'z') || ('A' <= ch && ch <= 'Z') || ('0' <= ch && ch <= '9')
+      || ch == '-' || ch == '.' || ch == '_' || ch == '~');
   }
-  //precision--;
+}
 
-  if (precision > 0) {
-    *pos = '.';
-    pos++; 
-    for (; (*tpos) && precision > 0; pos++, tpos++, precision--) {
-       *pos = *tpos;
-    }
-    for (; precision > 0; pos++, precision--) {
-       *pos = '0';
-    } 
+#if FORMAT_USE_SSE2 == 1
+//lo <= ch <= hi for unsigned bytes
+static __m128i _vformat_sse2_in_range(__m128i bytes, char lo, char hi) {
+  __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8((char)(hi - lo))), offset);
+}
+
+static unsigned int _vformat_escape_mask(int mode, __m128i bytes) {
+  __m128i mask;
+  switch (mode) {
+  case ESCAPE_JSON:
+    mask = _mm_or_si128(_vformat_sse2_in_range(bytes, 0, 0x1f),
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\'))));
+    break;
+  case ESCAPE_CSV:
+    mask = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_setzero_si128()), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"')));
+    break;
+  case ESCAPE_CSV_FIELD:
+    mask = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_setzero_si128()), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'))),
+      _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(',')),
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')))));
+    break;
+  default:
+    mask = _mm_or_si128(_mm_or_si128(_vformat_sse2_in_range(bytes, 'a', 'z'), _vformat_sse2_in_range(bytes, 'A', 'Z')),
+      _mm_or_si128(_vformat_sse2_in_range(bytes, '0', '9'),
+        _mm_or_si128(_vformat_sse2_in_range(bytes, '-', '.'),
+          _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('_')), _mm_cmpeq_epi8(bytes, _mm_set1_epi8('~'))))));
+    return ~(unsigned int)_mm_movemask_epi8(mask) & 0xffff;
   }
-  else if (formatter->alternate_form) {
-    *pos = '.';
-    pos++;
+  return (unsigned int)_mm_movemask_epi8(mask);
+}
+#endif // FORMAT_USE_SSE2
+
+/// <summary>
+/// The length of the run at sz that needs no escaping, at most maxlen.
+/// The maxlen bytes at sz are characters of the string, nothing past them is read.
+/// </summary>
+static intptr_t _vformat_escape_run(int mode, const char* sz, intptr_t maxlen) {
+  intptr_t run = 0;
+#if FORMAT_USE_SSE2 == 1
+  while (run + 16 <= maxlen) {
+    unsigned int bits = _vformat_escape_mask(mode, _mm_loadu_si128((const __m128i*)(sz + run)));
+    if (bits != 0)
+      return run + _vformat_ctz(bits);
+    run += 16;
   }
+#endif // FORMAT_USE_SSE2
+  while (run < maxlen && !_vformat_escape_needed(mode, (unsigned char)sz[run]))
+    run++;
+  return run;
+}
 
-  *pos = formatter->specifieris_upper ? 'P' : 'p';
-  pos++;
-  if (exponent >= 0) {
-    *pos = '+';
-    pos++;
+//the escape sequence of ch, which _vformat_escape_needed reported
+static int _vformat_escape_char(int mode, unsigned char ch, char* buf) {
+  switch (mode) {
+  case ESCAPE_JSON:
+    buf[0] = '\\';
+    switch (ch) {
+    case '"': buf[1] = '"'; return 2;
+    case '\\': buf[1] = '\\'; return 2;
+    case '\n': buf[1] = 'n'; return 2;
+    case '\r': buf[1] = 'r'; return 2;
+    case '\t': buf[1] = 't'; return 2;
+    case '\b': buf[1] = 'b'; return 2;
+    case '\f': buf[1] = 'f'; return 2;
+    default:
+      memcpy(buf + 1, "u00", 3);
+      buf[4] = _digits_lower[ch >> 4];
+      buf[5] = _digits_lower[ch & 15];
+      return 6;
+    }
+  case ESCAPE_CSV:
+    buf[0] = '"';
+    buf[1] = '"';
+    return 2;
+  default:
+    buf[0] = '%';
+    buf[1] = _digits_upper[ch >> 4];
+    buf[2] = _digits_upper[ch & 15];
+    return 3;
   }
-  else {
-    exponent = -exponent;
-    *pos = '-';
-    pos++;
+}
+
+/// <summary>
+/// Escapes sz up to budget characters of output, an escape sequence is never cut.
+/// Clean runs are found by _vformat_escape_run and written in one piece.
+/// </summary>
+/// <param name="formatter">NULL to measure only</param>
+/// <returns>the escaped length, or -1 when the sink fails</returns>
+static intptr_t _vformat_escape_text(OslFormatter* formatter, int mode, const char* sz, intptr_t budget) {
+  intptr_t total = 0;
+  //every character takes at least one byte of the budget
+  intptr_t left = _vformat_strnlen(sz, budget);
+  char sequence[8];
+  for (;;) {
+    intptr_t run = _vformat_escape_run(mode, sz, left < budget - total ? left : budget - total);
+    if (run > 0) {
+      if (formatter && !_vformat_append(formatter, sz, run))
+        return -1;
+      total += run;
+      sz += run;
+      left -= run;
+    }
+    if (total >= budget || left == 0)
+      return total;
+    int len = _vformat_escape_char(mode, (unsigned char)*sz, sequence);
+    if (total + len > budget)
+      return total;
+    if (formatter && !_vformat_append(formatter, sequence, len))
+      return -1;
+    total += len;
+    sz++;
+    left--;
   }
-  pos = _vformat_u32toa10(exponent, pos);
-  *pos = 0;
-  return pos-buf;
 }
 
-static intptr_t _vformat_double_f(OslFormatter* formatter, char* buf, const char* cvt,
-  int precision, ibool significant_precision, int dotpos, ibool trailingZeroes) {
-  char* pos = buf;
-  char* trailing_limit = buf;
-  if (dotpos <= 0) {
-    *pos = '0'; pos++;
+//a CSV field is quoted when the part the budget can show holds a quote, comma or line break,
+//the quotes count in the budget
+static intptr_t _vformat_escape_csv(OslFormatter* formatter, const char* sz, intptr_t budget) {
+  intptr_t len = _vformat_strnlen(sz, budget);
+  if (_vformat_escape_run(ESCAPE_CSV_FIELD, sz, len) == len)
+    return _vformat_escape_text(formatter, ESCAPE_CSV, sz, budget);
+  if (budget < 2)
+    return 0;
+  if (formatter && !_vformat_append(formatter, "\"", 1))
+    return -1;
+  len = _vformat_escape_text(formatter, ESCAPE_CSV, sz, budget - 2);
+  if (len < 0 || (formatter && !_vformat_append(formatter, "\"", 1)))
+    return -1;
+  return len + 2;
+}
+
+/// <summary>
+/// %pEj (JSON string content), %pEc (CSV field) and %pEu (URL component) of a C string.
+/// The precision limits and the width pads the escaped text.
+/// </summary>
+static ibool _vformat_escape(OslFormatter* formatter, int mode, const char* sz) {
+  intptr_t budget = formatter->precision >= 0 ? formatter->precision : INTPTR_MAX;
+  intptr_t len = 0;
+  if (sz == NULL)
+    sz = "(null)";
+  if (formatter->width > 0 && !formatter->left_align) {
+    len = mode == ESCAPE_CSV ? _vformat_escape_csv(NULL, sz, budget) : _vformat_escape_text(NULL, mode, sz, budget);
+    if (len < formatter->width && !_vformat_append_nchar(formatter, ' ', formatter->width - len))
+      return FALSE;
   }
-  else {
-    for (int i = 0; i < dotpos; i++) {
-      *pos = cvt[i]; pos++;
+  len = mode == ESCAPE_CSV ? _vformat_escape_csv(formatter, sz, budget) : _vformat_escape_text(formatter, mode, sz, budget);
+  if (len < 0)
+    return FALSE;
+  if (formatter->left_align && len < formatter->width)
+    return _vformat_append_nchar(formatter, ' ', formatter->width - len);
+  return TRUE;
+}
+
+//two digits of every value below 100
+static const char _vformat_digit_pairs[201] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+//UUID bytes in the order they are printed, RFC 4122 big endian and the little endian GUID of Windows
+static const unsigned char _vformat_uuid_big[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+static const unsigned char _vformat_uuid_little[16] = { 3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+//the dotted decimal form of the 4 bytes of an IPv4 address
+static char* _vformat_ipv4_text(char* pos, const unsigned char* addr) {
+  for (int i = 0; i < 4; i++) {
+    unsigned int byte = addr[i];
+    if (i > 0)
+      *pos++ = '.';
+    if (byte >= 100) {
+      *pos++ = (char)('0' + byte / 100);
+      byte %= 100;
     }
-    cvt += dotpos;
-    trailing_limit += dotpos;
-    if (significant_precision) {
-      precision -= dotpos;
+    else if (byte < 10) {
+      *pos++ = (char)('0' + byte);
+      continue;
     }
+    memcpy(pos, _vformat_digit_pairs + byte * 2, 2);
+    pos += 2;
   }
+  return pos;
+}
 
-  if (formatter->alternate_form || (precision > 0)) {
-    *pos = '.'; pos++;
+/// <summary>
+/// The RFC 5952 form of the 16 bytes of an IPv6 address: lower case hex without leading zeros,
+/// the first longest run of two or more zero groups becomes "::", IPv4-mapped addresses end in dotted decimal.
+/// </summary>
+static char* _vformat_ipv6_text(char* pos, const unsigned char* addr) {
+  unsigned int groups[8];
+  int best = -1;
+  int best_len = 1;
+  int run = 0;
+  int i;
+  for (i = 0; i < 8; i++) {
+    groups[i] = ((unsigned int)addr[i * 2] << 8) | addr[i * 2 + 1];
+    run = groups[i] == 0 ? run + 1 : 0;
+    if (run > best_len) {
+      best_len = run;
+      best = i - run + 1;
+    }
   }
-
-  if (precision > 0) {
-    if (significant_precision) {
-      for (int i = 0; i < -dotpos; i++) {
-        *pos = '0'; pos++;
-      }
+  if (best == 0 && best_len == 5 && groups[5] == 0xFFFF) {
+    memcpy(pos, "::ffff:", 7);
+    return _vformat_ipv4_text(pos + 7, addr + 12);
+  }
+  i = 0;
+  while (i < 8) {
+    if (i == best) {
+      *pos++ = ':';
+      *pos++ = ':';
+      i += best_len;
+      continue;
     }
-    else {
-      for (int i = 0; (i < -dotpos) && precision > 0; i++, precision--) {
-        *pos = '0'; pos++;
-      }
+    if (i > 0 && i != best + best_len)
+      *pos++ = ':';
+    int shift = 12;
+    while (shift > 0 && (groups[i] >> shift) == 0) {
+      shift -= 4;
     }
+    for (; shift >= 0; shift -= 4) {
+      *pos++ = _digits_lower[(groups[i] >> shift) & 15];
+    }
+    i++;
   }
+  return pos;
+}
 
-  for (; (precision > 0) && (*cvt); precision--, cvt++) {
-    *pos = *cvt; pos++;
+//the 6 bytes of a MAC address as lower case hex separated by ':'
+static char* _vformat_mac_text(char* pos, const unsigned char* addr) {
+  for (int i = 0; i < 6; i++) {
+    if (i > 0)
+      *pos++ = ':';
+    *pos++ = _digits_lower[addr[i] >> 4];
+    *pos++ = _digits_lower[addr[i] & 15];
   }
-  if (trailingZeroes) {
-    while (precision > 0) {
-      *pos = '0'; pos++; precision--;
-    }
+  return pos;
+}
+
+//the 16 bytes of a UUID as 8-4-4-4-12 hex digits, order is _vformat_uuid_big or _vformat_uuid_little
+static char* _vformat_uuid_text(char* pos, const unsigned char* uuid, const unsigned char* order, ibool is_upper) {
+  const char* digits = is_upper ? _digits_upper : _digits_lower;
+  for (int i = 0; i < 16; i++) {
+    unsigned char byte = uuid[order[i]];
+    if (i == 4 || i == 6 || i == 8 || i == 10)
+      *pos++ = '-';
+    *pos++ = digits[byte >> 4];
+    *pos++ = digits[byte & 15];
   }
-  else {
-    pos = _vformat_remove_trailing_zero_guard(trailing_limit, pos - 1, formatter->alternate_form);
+  return pos;
+}
+
+/// <summary>
+/// %pI4, %pI6, %pM and %pU, the text form of a binary address or UUID written as one piece
+/// </summary>
+static ibool _vformat_network(OslFormatter* formatter, const char* psz, const unsigned char* data) {
+  char* pos = formatter->tempbuf;
+  switch (psz[1]) {
+  case 'I':
+    pos = psz[2] == '4' ? _vformat_ipv4_text(pos, data) : _vformat_ipv6_text(pos, data);
+    break;
+  case 'M':
+    pos = _vformat_mac_text(pos, data);
+    break;
+  default:
+    pos = _vformat_uuid_text(pos, data, psz[2] == 'l' || psz[2] == 'L' ? _vformat_uuid_little : _vformat_uuid_big,
+      psz[2] == 'B' || psz[2] == 'L');
+    break;
   }
+  return _vformat_append_string(formatter, formatter->tempbuf, pos - formatter->tempbuf);
+}
 
-  return pos - buf;
+/// <summary>
+/// Length of the extension letters following a 'p' specifier
+/// </summary>
+static int _vformat_pointer_extension(const char* psz) {
+  switch (psz[1]) {
+  case 'N':
+  case 'X':
+  case 'V':
+  case 'M':
+    return 1;
+  case 'I':
+    if (psz[2] == '4' || psz[2] == '6')
+      return 2;
+    return 0;
+  case 'U':
+    if (psz[2] == 'b' || psz[2] == 'B' || psz[2] == 'l' || psz[2] == 'L')
+      return 2;
+    return 1;
+  case 'E':
+    if (psz[2] == 'j' || psz[2] == 'c' || psz[2] == 'u')
+      return 2;
+    return 1;
+  case 'h':
+  case 'H':
+    if (psz[2] == 'C' || psz[2] == 'D' || psz[2] == 'N')
+      return 2;
+    return 1;
+  default:
+    return 0;
+  }
 }
 
-static intptr_t _vformat_double_e(OslFormatter* formatter, char* buf, const char* cvt,
-  int precision, ibool significant_precision, int exponent, int dotpos, ibool trailingZeroes) {
-  intptr_t len = _vformat_double_f(formatter, buf, cvt, precision, significant_precision, dotpos, trailingZeroes);
-  char* pos = buf + len;
+static ibool _vformat_string(OslFormatter* formatter, const char* sz);
+static ibool _vformat_string_view(OslFormatter* formatter, const OslStringView* view);
 
-  *pos = formatter->specifieris_upper ? 'E' : 'e';
-  pos++;
+/// <summary>
+/// %p followed by extension letters, the argument is a pointer to the value
+/// %pN  OslFormatCounter
+/// %pI4 %pI6  4 or 16 bytes of an IPv4 or IPv6 address
+/// %pM  6 bytes of a MAC address
+/// %pU  16 bytes of a UUID, %pUB upper case, %pUl and %pUL in the little endian GUID order
+/// A NULL pointer prints (null) like %s, whatever the extension.
+/// </summary>
+static ibool _vformat_pointer(OslFormatter* formatter, const char** ppsz, const void* ptr) {
+  const char* psz = *ppsz;
+  *ppsz += _vformat_pointer_extension(psz);
+  if (ptr == NULL)
+    return _vformat_string(formatter, NULL);
+  switch (psz[1]) {
+  case 'N':
+    return _vformat_counter(formatter, (const OslFormatCounter*)ptr);
+  case 'H':
+    formatter->specifieris_upper = TRUE;
+  case 'h':
+    do {
+      //the field width is the length of the buffer, one byte without it as in the kernel
+      intptr_t len = formatter->width >= 0 ? formatter->width : 1;
+      char separator = psz[2] == 'C' ? ':' : psz[2] == 'D' ? '-' : psz[2] == 'N' ? 0 : ' ';
+      return _vformat_hex_buffer(formatter, (const unsigned char*)ptr, len, separator);
+    } while (0);
+  case 'X':
+    return _vformat_hex_dump(formatter, (const unsigned char*)ptr, formatter->width >= 0 ? formatter->width : 1);
+  case 'V':
+    return _vformat_string_view(formatter, (const OslStringView*)ptr);
+  case 'E':
+    return _vformat_escape(formatter, psz[2] == 'c' ? ESCAPE_CSV : psz[2] == 'u' ? ESCAPE_URL : ESCAPE_JSON,
+      (const char*)ptr);
+  case 'I':
+  case 'M':
+  case 'U':
+    return _vformat_network(formatter, psz, (const unsigned char*)ptr);
+  default:
+    return FALSE;
+  }
+}
 
-  *pos = exponent >= 0 ? '+' : '-';
-  pos++;
-  if (exponent < 0)
-    exponent = -exponent;
-  int exponent_len = 2;
-  if (exponent >= 100) {
-    exponent_len = 3;
+static int _vformat_popcount(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcount(mask);
+#else
+  int count = 0;
+  while (mask != 0) {
+    mask &= mask - 1;
+    count++;
   }
+  return count;
+#endif
+}
 
-  char* digits = pos + exponent_len - 1;
+//columns of a code point in a terminal, East Asian wide characters take 2
+static int _vformat_utf8_columns(uint32_t cp) {
+  if ((0x0300 <= cp && cp <= 0x036F) || (0x200B <= cp && cp <= 0x200F) || (0xFE00 <= cp && cp <= 0xFE0F))
+    return 0;
+  if ((0x1100 <= cp && cp <= 0x115F) || (0x2E80 <= cp && cp <= 0x303E) || (0x3041 <= cp && cp <= 0x33FF)
+    || (0x3400 <= cp && cp <= 0x4DBF) || (0x4E00 <= cp && cp <= 0x9FFF) || (0xA000 <= cp && cp <= 0xA4CF)
+    || (0xAC00 <= cp && cp <= 0xD7A3) || (0xF900 <= cp && cp <= 0xFAFF) || (0xFE30 <= cp && cp <= 0xFE4F)
+    || (0xFF00 <= cp && cp <= 0xFF60) || (0xFFE0 <= cp && cp <= 0xFFE6) || (0x1F300 <= cp && cp <= 0x1F64F)
+    || (0x1F900 <= cp && cp <= 0x1F9FF) || (0x20000 <= cp && cp <= 0x3FFFD))
+    return 2;
+  return 1;
+}
+
+#if FORMAT_USE_SSE2 == 1
+/// <summary>
+/// The code points of 16 bytes that are whole UTF-8 sequences: every lead byte is followed by all
+/// of its continuation bytes inside the block and no continuation byte is left over.
+/// Those count one per byte that is not a continuation byte, as the byte by byte scan counts them.
+/// In UTF8_UTF16_UNITS a 4 byte sequence may be a surrogate pair, those blocks are left to the scan.
+/// </summary>
+/// <returns>the code points, or -1 for a block the byte by byte scan must take</returns>
+static int _vformat_utf8_block(__m128i bytes, int mode) {
+  unsigned int lead2 = (unsigned int)_mm_movemask_epi8(_vformat_sse2_in_range(bytes, (char)0xC0, (char)0xFF));
+  unsigned int lead3 = (unsigned int)_mm_movemask_epi8(_vformat_sse2_in_range(bytes, (char)0xE0, (char)0xFF));
+  unsigned int lead4 = (unsigned int)_mm_movemask_epi8(_vformat_sse2_in_range(bytes, (char)0xF0, (char)0xFF));
+  unsigned int continuation = (unsigned int)_mm_movemask_epi8(_vformat_sse2_in_range(bytes, (char)0x80, (char)0xBF));
+  //the bytes that must be continuation bytes, a sequence running into the next block sets bits above 15
+  unsigned int expected = (lead2 << 1) | (lead3 << 2) | (lead4 << 3);
+  if (expected != continuation || (mode == UTF8_UTF16_UNITS && lead4 != 0))
+    return -1;
+  return 16 - _vformat_popcount(continuation);
+}
+#endif // FORMAT_USE_SSE2
 
+/// <summary>
+/// The bytes of the longest prefix of sz that takes at most limit code points (UTF8_CODE_POINTS),
+/// display columns (UTF8_COLUMNS) or UTF-16 code units (UTF8_UTF16_UNITS), ending at the terminating null at the latest.
+/// A multi-byte sequence is never cut. 16 byte blocks of ASCII, and for code points blocks of
+/// whole sequences, are counted at once; blocks are only loaded from the bytes before the terminator.
+/// </summary>
+/// <param name="punits">the code points or columns of the prefix</param>
+static intptr_t _vformat_utf8_prefix(const char* sz, intptr_t limit, int mode, intptr_t* punits) {
+  const unsigned char* pos = (const unsigned char*)sz;
+  intptr_t units = 0;
+#if FORMAT_USE_SSE2 == 1
+  //a code point takes at most 4 bytes, past them only the byte by byte scan reads on
+  const unsigned char* end = pos + _vformat_strnlen(sz, limit < INTPTR_MAX / 4 ? limit * 4 : INTPTR_MAX);
+#endif // FORMAT_USE_SSE2
   for (;;) {
-    *digits = exponent % 10 + '0';
-    exponent /= 10; digits--;
-    if (exponent == 0)
+#if FORMAT_USE_SSE2 == 1
+    while (units + 16 <= limit && end - pos >= 16) {
+      __m128i bytes = _mm_loadu_si128((const __m128i*)pos);
+      int count = 16;
+      if (_mm_movemask_epi8(bytes) != 0) {
+        if (mode == UTF8_COLUMNS)
+          break;
+        count = _vformat_utf8_block(bytes, mode);
+        if (count < 0)
+          break;
+      }
+      units += count;
+      pos += 16;
+    }
+#endif // FORMAT_USE_SSE2
+    unsigned char lead = *pos;
+    if (lead == 0)
+      break;
+    int len = lead < 0x80 ? 1 : lead < 0xC0 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    uint32_t cp = lead < 0x80 ? lead : lead < 0xC0 ? 0xFFFD : lead & (0x7F >> len);
+    for (int i = 1; i < len; i++) {
+      if ((pos[i] & 0xC0) != 0x80) {
+        //a truncated sequence counts as one character
+        len = i;
+        cp = 0xFFFD;
+        break;
+      }
+      cp = (cp << 6) | (pos[i] & 0x3F);
+    }
+    int width = mode == UTF8_COLUMNS ? _vformat_utf8_columns(cp)
+      : mode == UTF8_UTF16_UNITS && 0x10000 <= cp && cp <= 0x10FFFF ? 2 : 1;
+    if (units + width > limit)
       break;
+    units += width;
+    pos += len;
   }
-  while (digits >= pos) {
-    *digits = '0'; digits--;
+  *punits = units;
+  return (const char*)pos - sz;
+}
+
+//%Us and %UUs
+static ibool _vformat_utf8_string(OslFormatter* formatter, const char* sz) {
+  intptr_t limit = formatter->precision >= 0 ? formatter->precision : INTPTR_MAX;
+  intptr_t units;
+  intptr_t len;
+  if (formatter->limit >= 0) {
+    //past the limit only the padding in front still depends on the string,
+    //one more unit tells whether anything is dropped
+    intptr_t shown = formatter->limit - formatter->count + 1;
+    if (shown < formatter->width)
+      shown = formatter->width;
+    if (shown < limit)
+      limit = shown;
   }
-  *(pos + exponent_len) = 0;
-  return pos + exponent_len - buf;
+  len = _vformat_utf8_prefix(sz, limit, formatter->utf8_mode, &units);
+  return _vformat_append_text(formatter, sz, len, units);
 }
 
-struct OslVFormatNan {
-  int len;
-  char value[9];
-};
+static ibool _vformat_string(OslFormatter* formatter, const char* sz) {
+  intptr_t len;
+  if (sz == NULL) {
+    sz = "(null)";
+  }
+  if (formatter->utf8_mode == 0 && (formatter->width > 0 || formatter->precision >= 0))
+    //the wide entry points count code units, only a width or precision depends on the count
+    formatter->utf8_mode = formatter->string_mode;
+  if (formatter->utf8_mode)
+    return _vformat_utf8_string(formatter, sz);
+  if (formatter->limit >= 0) {
+    //characters past the limit are never shown,
+    //a longer string only matters for the padding in front of it, one more byte tells whether anything is dropped
+    intptr_t maxlen = formatter->limit - formatter->count + 1;
+    if (maxlen < formatter->width)
+      maxlen = formatter->width;
+    if (formatter->precision >= 0 && maxlen > formatter->precision)
+      maxlen = formatter->precision;
+    len = _vformat_strnlen(sz, maxlen);
+  }
+  else if (formatter->precision >= 0)
+    //never read past the precision, the array need not be null-terminated
+    len = _vformat_strnlen(sz, formatter->precision);
+  else
+    len = strlen(sz);
+  return _vformat_append_string(formatter, sz, len);
+}
 
-static ibool _vformat_nan(OslFormatter* formatter, int negative,int classification,char specifier) {
-  static const struct OslVFormatNan nan_value[] = {
-     {3,"inf"},
-     {3,"INF"}, 
-     {3,"nan"},//Quiet NAN
-     {3,"NAN"}, 
-     {8,"nan(ind)"},//Indeterminate NAN
-     {8,"NAN(IND)"},
-     {9,"nan(snan)"},//Signaling NAN
-     {9,"NAN(SNAN)"}, 
-  };
-    //formatter->padding_zero = FALSE;
-    //formatter->with_sign = FALSE;
-    //formatter->prefix_blank = FALSE;
-    int nan_value_index = classification*2;
-    if (formatter->specifieris_upper)
-      nan_value_index++;
-    const struct OslVFormatNan* nan = nan_value + nan_value_index;
-    const char* digits = nan->value;
-    int digist_len = nan->len;
-    char* prefix = formatter->tempbuf;
-    if (negative) {
-      *prefix = '-';
-      prefix++;
+//%pV, an OslStringView of length characters that need not be null-terminated
+static ibool _vformat_string_view(OslFormatter* formatter, const OslStringView* view) {
+  intptr_t len;
+  if (view == NULL)
+    return _vformat_string(formatter, NULL);
+  len = view->length;
+  if (formatter->precision >= 0 && len > formatter->precision)
+    len = formatter->precision;
+  return _vformat_append_string(formatter, view->data, len);
+}
+
+ 
+/*
+For a conversion, the double argument is converted to hexadecimal notation
+(using the letters abcdef) in the style [-]0xh.hhhhp; for A conversion the prefix 0X,
+the letters ABCDEF, and the exponent separator P is used.
+There is one hexadecimal digit before the decimal point,
+and the number of digits after it is equal to the precision.
+The default precision suffices for an exact representation of the value
+if an exact representation in base 2 exists and otherwise is sufficiently
+large to distinguish values of type double. The digit before
+the decimal point is unspecified for nonnormalized numbers,
+and nonzero but otherwise unspecified for normalized numbers.
+*/
+
+typedef double float64_t;
+union ui64_f64 { uint64_t ui; float64_t f; };
+#define signF64UI( a ) ((int_fast16_t) ((uint64_t) (a)>>63))
+#define expF64UI( a ) ((int32_t) ((a)>>52) & 0x7FF)
+#define fracF64UI( a ) ((a) & UINT64_C( 0x000FFFFFFFFFFFFF ))
+ 
+static intptr_t _vformat_hcvt_ieee754d64(OslFormatter* formatter, char* buf,
+  intptr_t  buf_count,
+  double  value,
+  int precision, int* prefix_len, intptr_t* zero_pos, intptr_t* zero_count) {
+    
+  *prefix_len = 2; 
+  *zero_count = 0;
+  char* pos = buf;
+   
+  if (value >= 0) {
+    if (formatter->with_sign) {
+      *pos = '+';
+      pos++;
+      (*prefix_len)++;
     }
     else if (formatter->prefix_blank) {
-      *prefix = ' ';
-      prefix++;
-    }
-    else if (formatter->with_sign) {
-      *prefix = '+';
-      prefix++;
+      *pos = ' ';
+      pos++;
+      (*prefix_len)++;
     }
-    int prefix_len = (int)(prefix - formatter->tempbuf);
- 
-    if (formatter->alternate_form && formatter->precision == 0 && specifier != 'g') { 
-      if (negative) {
-        if (specifier == 'a' ) {
-          *prefix = '0';
+  }
+  else {
+    value = -value;
+    *pos = '-';
+    pos++;
+    (*prefix_len)++;
+  }
+  *pos = '0';
+  pos++;
+  *pos = *pos = formatter->specifieris_upper ? 'X' : 'x';
+  pos++;
+
+  union ui64_f64 ua;
+  ua.f = value;
+  uint64_t ui = ua.ui;
+  //uint64_t sign = signF64UI(ui);
+  int32_t exponent = expF64UI(ui) - 1023;
+  uint64_t frac = fracF64UI(ui);
+
+  //*pexp = exp;
+  //*pdotpos = 1;
+  uint64_t mantissa;
+  if (exponent == -1023) {
+    //mantissa = frac + (UINT64_C(1) << 52);
+    if (frac == 0) {
+      exponent = 0;
+      mantissa = 0;
+    }
+    else {
+      mantissa = frac + (UINT64_C(1) << 52);
+    }
+  }
+  else {
+    mantissa = frac + (UINT64_C(1) << 52);
+  }
+  if (precision < 0)
+    precision = 13;
+  if (precision <= 12) {
+#ifdef hcvt_round_away_from_zero
+    //0x000FFFFFFFFFFFFF
+    int shift = precision * 4;
+    uint64_t round_add = (UINT64_C(0x0008000000000000) >> shift);
+    assert(round_add > 0);
+    mantissa += round_add;
+#else //hcvt_round_near_even
+    //0x000FFFFFFFFFFFFF 
+    int shift = precision * 4;
+#ifdef round_val_first
+    uint64_t round_add = (UINT64_C(0x0008000000000000) >> shift);
+    uint64_t round_val = (mantissa & (UINT64_C(0x000F000000000000) >> shift)) >> (48 - shift);
+    if (round_val == 8) {
+      uint64_t sticky_bit = (mantissa & (UINT64_C(0x0000FFFFFFFFFFFF) >> shift));
+      if (sticky_bit == 0) {
+        uint64_t guardval = (mantissa & (UINT64_C(0x00F0000000000000) >> shift)) >> (52 - shift);
+        if (((guardval) % 2) == 1)
+          mantissa += round_add;
+      }
+      else {
+        mantissa += round_add;
+      }
+    }
+    else if (round_val > 8) {
+      mantissa += round_add;
+    }
+    else {//round_val < 8
+    }
+#elif defined(sticky_bit_first)
+    uint64_t round_add = (UINT64_C(0x0008000000000000) >> shift);
+    uint64_t sticky_bit = (mantissa & (UINT64_C(0x0000FFFFFFFFFFFF) >> shift));
+    if (sticky_bit == 0) {
+      uint64_t round_val = (mantissa & (UINT64_C(0x000F000000000000) >> shift)) >> (48 - shift);
+      if (round_val == 8) {
+        uint64_t guardval = (mantissa & (UINT64_C(0x00F0000000000000) >> shift)) >> (52 - shift);
+        if (((guardval) % 2) == 1)
+          mantissa += round_add;
+      }
+      else if (round_val > 8) {
+        mantissa += round_add;
+      }
+      else {//round_val < 8
+      }
+    }
+    else {
+      mantissa += round_add;
+    }
+#else 
+    uint64_t mask = (UINT64_C(0xFFFFFFFFFFFFFFFF) << (52 - shift));
+    uint64_t mid_point = (mantissa & mask)
+      | ((UINT64_C(0x00008000000000000) >> shift));
+    if (mantissa == mid_point) {
+      mantissa += (UINT64_C(0x0007000000000000) >> shift)
+        + (mantissa & (UINT64_C(0x0010000000000000) >> shift));
+    }
+    else {
+      mantissa += (UINT64_C(0x0008000000000000) >> shift);
+    }
+    mantissa &= mask;
+#endif
+#endif 
+  }
+  char tmp[32];
+  _vformat_u64toa16(mantissa, tmp,formatter->specifieris_upper);
+  const char* tpos = tmp;
+
+  //int part
+  if (exponent == -1023) {
+    *pos = '0';
+    pos++;
+    tpos++;
+    exponent += 1;
+  }
+  else {
+    *pos = *tpos;
+    pos++;
+    tpos++;
+  }
+  //precision--;
+
+  if (precision > 0) {
+    *pos = '.';
+    pos++; 
+    for (; (*tpos) && precision > 0; pos++, tpos++, precision--) {
+       *pos = *tpos;
+    }
+    //trailing zeros are left to the caller as a fill run
+    *zero_count = precision;
+  }
+  else if (formatter->alternate_form) {
+    *pos = '.';
+    pos++;
+  }
+  *zero_pos = pos - buf;
+
+  *pos = formatter->specifieris_upper ? 'P' : 'p';
+  pos++;
+  if (exponent >= 0) {
+    *pos = '+';
+    pos++;
+  }
+  else {
+    exponent = -exponent;
+    *pos = '-';
+    pos++;
+  }
+  pos = _vformat_u32toa10(exponent, pos);
+  *pos = 0;
+  return pos-buf;
+}
+
+/// <summary>
+/// Lays out the digits of ieee754d64tos as segments,
+/// zero runs of any length are fill segments so the precision is not limited by a buffer
+/// </summary>
+static void _vformat_double_f(OslFormatter* formatter, OslFormatSegments* segs, const char* cvt,
+  int precision, ibool significant_precision, int dotpos, ibool trailingZeroes) {
+  intptr_t cvt_len = strlen(cvt);
+  intptr_t leading_zero = 0;
+  intptr_t digits_len = 0;
+  intptr_t trailing_zero = 0;
+  ibool dot;
+  if (dotpos <= 0) {
+    _vformat_segments_add(segs, "0", 1);
+  }
+  else {
+    if (dotpos <= cvt_len) {
+      _vformat_segments_add(segs, cvt, dotpos);
+    }
+    else {
+      _vformat_segments_add(segs, cvt, cvt_len);
+      _vformat_segments_fill(segs, '0', dotpos - cvt_len);
+    }
+    cvt += dotpos < cvt_len ? dotpos : cvt_len;
+    cvt_len -= dotpos < cvt_len ? dotpos : cvt_len;
+    if (significant_precision) {
+      precision -= dotpos;
+    }
+  }
+
+  dot = formatter->alternate_form || (precision > 0);
+
+  if (precision > 0 && dotpos < 0) {
+    leading_zero = -dotpos;
+    if (!significant_precision) {
+      if (leading_zero > precision)
+        leading_zero = precision;
+      precision -= (int)leading_zero;
+    }
+  }
+
+  if (precision > 0) {
+    digits_len = precision < cvt_len ? precision : cvt_len;
+    precision -= (int)digits_len;
+  }
+  if (trailingZeroes) {
+    if (precision > 0)
+      trailing_zero = precision;
+  }
+  else {
+    while (digits_len > 0 && cvt[digits_len - 1] == '0') {
+      digits_len--;
+    }
+    if (digits_len == 0) {
+      leading_zero = 0;
+      if (!formatter->alternate_form)
+        dot = FALSE;
+    }
+  }
+
+  if (dot)
+    _vformat_segments_add(segs, ".", 1);
+  _vformat_segments_fill(segs, '0', leading_zero);
+  _vformat_segments_add(segs, cvt, digits_len);
+  _vformat_segments_fill(segs, '0', trailing_zero);
+}
+
+static void _vformat_double_e(OslFormatter* formatter, OslFormatSegments* segs, char* buf, const char* cvt,
+  int precision, ibool significant_precision, int exponent, int dotpos, ibool trailingZeroes) {
+  _vformat_double_f(formatter, segs, cvt, precision, significant_precision, dotpos, trailingZeroes);
+  char* pos = buf;
+
+  *pos = formatter->specifieris_upper ? 'E' : 'e';
+  pos++;
+
+  *pos = exponent >= 0 ? '+' : '-';
+  pos++;
+  if (exponent < 0)
+    exponent = -exponent;
+  int exponent_len = 2;
+  if (exponent >= 100) {
+    exponent_len = 3;
+  }
+  //decimal128 reaches 6144
+  if (exponent >= 1000) {
+    exponent_len = 4;
+  }
+
+  char* digits = pos + exponent_len - 1;
+
+  for (;;) {
+    *digits = exponent % 10 + '0';
+    exponent /= 10; digits--;
+    if (exponent == 0)
+      break;
+  }
+  while (digits >= pos) {
+    *digits = '0'; digits--;
+  }
+  *(pos + exponent_len) = 0;
+  _vformat_segments_add(segs, buf, pos + exponent_len - buf);
+}
+
+struct OslVFormatNan {
+  int len;
+  char value[9];
+};
+
+static ibool _vformat_nan(OslFormatter* formatter, int negative,int classification,char specifier) {
+  static const struct OslVFormatNan nan_value[] = {
+     {3,"inf"},
+     {3,"INF"}, 
+     {3,"nan"},//Quiet NAN
+     {3,"NAN"}, 
+     {8,"nan(ind)"},//Indeterminate NAN
+     {8,"NAN(IND)"},
+     {9,"nan(snan)"},//Signaling NAN
+     {9,"NAN(SNAN)"}, 
+  };
+    //formatter->padding_zero = FALSE;
+    //formatter->with_sign = FALSE;
+    //formatter->prefix_blank = FALSE;
+    int nan_value_index = classification*2;
+    if (formatter->specifieris_upper)
+      nan_value_index++;
+    const struct OslVFormatNan* nan = nan_value + nan_value_index;
+    const char* digits = nan->value;
+    int digist_len = nan->len;
+    char* prefix = formatter->tempbuf;
+    if (negative) {
+      *prefix = '-';
+      prefix++;
+    }
+    else if (formatter->prefix_blank) {
+      *prefix = ' ';
+      prefix++;
+    }
+    else if (formatter->with_sign) {
+      *prefix = '+';
+      prefix++;
+    }
+    int prefix_len = (int)(prefix - formatter->tempbuf);
+ 
+    if (formatter->alternate_form && formatter->precision == 0 && specifier != 'g') { 
+      if (negative) {
+        if (specifier == 'a' ) {
+          *prefix = '0';
           prefix++;
           *prefix = formatter->specifieris_upper ? 'X' : 'x';
           prefix++;
@@ -738,151 +1753,1087 @@ static ibool _vformat_nan(OslFormatter* formatter, int negative,int classificati
     if (prefix_len == 0)
       prefix = NULL;
     else {
-      prefix = formatter->tempbuf;
+      prefix = formatter->tempbuf;
+    }
+    formatter->padding_zero = FALSE;
+    formatter->prefix_blank = FALSE;
+    OslFormatSegments segs;
+    _vformat_segments_init(&segs);
+    _vformat_segments_add(&segs, digits, digist_len);
+    return _vformat_append_with_prefix_double(formatter, prefix, prefix_len, &segs); 
+   
+}
+
+extern int ieee754d64tos(double value, char* buf, int buflen,   char specifier, int precision, int* pexp, int* pdotpos, char* pgret);
+extern int ieee754d64fixed(const double* values, intptr_t count, int precision, uint64_t* scaled, unsigned char* ok);
+
+/// <summary>
+/// %.precisionf of a value whose digits are scaled = |value| * 10^precision from ieee754d64fixed,
+/// followed by zeros more fraction digits that are all 0
+/// </summary>
+static ibool _vformat_fixed(OslFormatter* formatter, ibool neg, uint64_t scaled, int precision, int zeros) {
+  char digits[24];
+  int len = u64tos(scaled, digits);
+  OslFormatSegments segs;
+  _vformat_segments_init(&segs);
+  if (len <= precision) {
+    _vformat_segments_add(&segs, "0.", 2);
+    _vformat_segments_fill(&segs, '0', precision - len);
+    _vformat_segments_add(&segs, digits, len);
+  }
+  else {
+    _vformat_segments_add(&segs, digits, len - precision);
+    if (precision + zeros > 0 || formatter->alternate_form)
+      _vformat_segments_add(&segs, ".", 1);
+    _vformat_segments_add(&segs, digits + len - precision, precision);
+  }
+  _vformat_segments_fill(&segs, '0', zeros);
+  return _vformat_append_double(formatter, neg, &segs);
+}
+
+static const uint64_t _vformat_pow10[20] = {
+  UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000), UINT64_C(100000),
+  UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+  UINT64_C(10000000000), UINT64_C(100000000000), UINT64_C(1000000000000), UINT64_C(10000000000000),
+  UINT64_C(100000000000000), UINT64_C(1000000000000000), UINT64_C(10000000000000000),
+  UINT64_C(100000000000000000), UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+};
+
+/// <summary>
+/// scaled / 10^scale to precision fraction digits, fewer digits round half to even like %f, more append zeros
+/// </summary>
+static ibool _vformat_scaled_digits(OslFormatter* formatter, ibool neg, uint64_t scaled, int scale, int precision) {
+  if (precision >= scale)
+    return _vformat_fixed(formatter, neg, scaled, scale, precision - scale);
+  if (scale - precision >= 20) {
+    //|value| < 10^20 / 2, rounds to 0
+    scaled = 0;
+  }
+  else {
+    uint64_t unit = _vformat_pow10[scale - precision];
+    uint64_t rest = scaled % unit;
+    scaled /= unit;
+    if (rest > unit / 2 || (rest == unit / 2 && (scaled & 1)))
+      scaled++;
+  }
+  return _vformat_fixed(formatter, neg, scaled, precision, 0);
+}
+
+/// <summary>
+/// %Q, an int64 with an implied decimal scale printed exactly as value / 10^scale, without a double.
+/// The precision defaults to the scale.
+/// </summary>
+static ibool _vformat_scaled(OslFormatter* formatter, int64_t value, int scale) {
+  uint64_t scaled = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  if (scale < 0) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  return _vformat_scaled_digits(formatter, value < 0, scaled, scale,
+    formatter->precision >= 0 ? formatter->precision : scale);
+}
+
+/// <summary>
+/// Lays out the rounded digits of ieee754d64tos or ieee754dectos for 'e', 'f' or 'g'
+/// </summary>
+static void _vformat_cvt_layout(OslFormatter* formatter, OslFormatSegments* segs, char* expbuf, const char* cvtbuf,
+  char specifier, int precision, int exponent10, int dotpos, char gspecifier) {
+  switch (specifier) {
+  case 'e':
+    _vformat_double_e(formatter, segs, expbuf, cvtbuf, precision, FALSE, exponent10, dotpos, TRUE);
+    break;
+  case 'f':
+    _vformat_double_f(formatter, segs, cvtbuf, precision, FALSE, dotpos, TRUE);
+    break;
+  default:
+    //'#' For g and G
+    //  conversions, trailing zeros are not removed from the
+    //  result as they would otherwise be.
+    // 
+    //Style e is used if the exponent from its conversion is less than -4 
+    // or greater than or equal to the precision.
+    if (gspecifier == 'e') {//if ((exp < -4 || (exp >= precision))) {
+      _vformat_double_e(formatter, segs, expbuf, cvtbuf, precision, TRUE, exponent10, dotpos, formatter->alternate_form);
+    }
+    else {
+      _vformat_double_f(formatter, segs, cvtbuf, precision, TRUE, dotpos, formatter->alternate_form);
+    }
+    break;
+  }
+}
+
+/// <summary>
+/// The buffer length given to ieee754d64tos for 'e' and 'f': digits of a bounded output that would land
+/// past the limit are never copied out, the layout fills their places with zeros that are dropped anyway
+/// </summary>
+static int _vformat_cvt_length(OslFormatter* formatter) {
+  if (formatter->limit >= 0 && formatter->limit - formatter->count < NUMBER_CVT_LENGTH)
+    return (int)(formatter->limit - formatter->count) + 1;
+  return NUMBER_CVT_LENGTH;
+}
+
+static ibool _vformat_ieee754d64(OslFormatter* formatter, double value, char specifier) {
+   
+  union ui64_f64 ua;
+  ua.f = value;
+  uint64_t ui = ua.ui; 
+  int32_t  exponent2 = expF64UI(ui);
+  uint64_t frac = fracF64UI(ui);
+
+  //  infinity 	inf             s = u; e = 2047; f = 0 
+  //  Indefinite NaN 	nan(ind)  s = 1; e = 2047; f = .1000 -- 00
+  //  Quiet NaN  nan            s = u; e = 2047; f = .1uuu -- uu 
+  //  Signaling NaN 	nan(snan) s = u; e = 2047; f = .0uuu -- uu 0 (at least one of the u in f is nonzero)
+   
+  if (exponent2 == 2047) {
+    int classification;
+    int negative = signF64UI(ui);
+    if (frac == 0) {//inf
+      classification = 0;
+    }
+    else {//nan
+#if 1
+      //from msvc crt
+      const uint64_t special_nan_mantissa_mask = (UINT64_C(1) << 51);
+      if (negative && frac == special_nan_mantissa_mask) {
+        //Indeterminate NAN
+        classification = 2;
+      }
+      else if (frac & special_nan_mantissa_mask) {
+        //Quiet NAN
+        classification = 1;
+      }
+      else {
+        //Signaling NAN
+        classification = 3;
+      }
+#else 
+      classification = 1;
+#endif
+
+    }  
+    return _vformat_nan(formatter, negative, classification, specifier);
+  }  
+
+  int precision;
+  intptr_t len = 0;
+  int exponent10;
+  int dotpos;
+  char gspecifier;
+  char cvtbuf[NUMBER_CVT_LENGTH + 1];
+  char expbuf[8];
+  OslFormatSegments segs;
+  _vformat_segments_init(&segs);
+
+  switch (specifier) {
+  case 'a':
+    do{ 
+      int prefix_len;
+      intptr_t zero_pos;
+      intptr_t zero_count;
+      precision = formatter->precision >= 0 ? formatter->precision : 13;
+      len = _vformat_hcvt_ieee754d64(formatter, formatter->tempbuf,
+        NUMBER_BUFFER_LENGTH, value, precision, &prefix_len, &zero_pos, &zero_count);
+      if (len <0)
+        return FALSE; 
+      _vformat_segments_add(&segs, formatter->tempbuf + prefix_len, zero_pos - prefix_len);
+      _vformat_segments_fill(&segs, '0', zero_count);
+      _vformat_segments_add(&segs, formatter->tempbuf + zero_pos, len - zero_pos);
+      return _vformat_append_with_prefix_double(formatter, formatter->tempbuf, prefix_len, &segs);
+    }while (0);
+  case 'e':
+    precision = formatter->precision >= 0 ? formatter->precision : 6;
+    ieee754d64tos(value, cvtbuf, _vformat_cvt_length(formatter), 'e',
+      precision, &exponent10, &dotpos, NULL);
+    _vformat_cvt_layout(formatter, &segs, expbuf, cvtbuf, 'e', precision, exponent10, dotpos, 0);
+    break;
+  case 'f':
+    precision = (formatter->precision >= 0 ? formatter->precision : 6);
+    do {
+      uint64_t scaled;
+      unsigned char ok;
+      if (ieee754d64fixed(&value, 1, precision, &scaled, &ok) == 1)
+        return _vformat_fixed(formatter, value < 0, scaled, precision, 0);
+    } while (0);
+    ieee754d64tos(value, cvtbuf, _vformat_cvt_length(formatter), 'f',
+      precision, &exponent10, &dotpos, NULL);
+    _vformat_cvt_layout(formatter, &segs, expbuf, cvtbuf, 'f', precision, exponent10, dotpos, 0);
+    break;
+  case 'g':
+    //The e format is used only when the exponent of the value is less than ?C4
+    //or greater than or equal to the precision argument.Trailing zeros are truncated,
+    //and the decimal point appears only if one or more digits follow it.
+
+    //The precision specifies the number of significant digits. 
+    //If the precision is missing, 6 digits are given;
+    precision = (formatter->precision >= 0 ? formatter->precision : 6);
+    if (precision == 0)
+      precision = 1;
+    ieee754d64tos(value, cvtbuf, NUMBER_CVT_LENGTH,'g',
+      precision, &exponent10, &dotpos, &gspecifier);
+    _vformat_cvt_layout(formatter, &segs, expbuf, cvtbuf, 'g', precision, exponent10, dotpos, gspecifier);
+    break;
+  default:
+    return FALSE;
+  } 
+  return _vformat_append_double(formatter, value < 0, &segs);
+}
+
+extern int ieee754dectos(const char* digits, int length, int exponent, char* buf, int buflen, char specifier,
+  int precision, int* pexp, int* pdotpos, char* pgret);
+
+#define DECIMAL64_BIAS 398
+#define DECIMAL64_MAX_COEFFICIENT UINT64_C(9999999999999999)
+#define DECIMAL128_BIAS 6176
+//10^34 - 1
+#define DECIMAL128_MAX_HIGH UINT64_C(0x1ED09BEAD87C0)
+#define DECIMAL128_MAX_LOW UINT64_C(0x378D8E63FFFFFFFF)
+
+/// <summary>
+/// The decimal digits of the 128 bit value high:low
+/// </summary>
+/// <param name="buf">at least 39 characters</param>
+static int _vformat_u128_digits(uint64_t high, uint64_t low, char* buf) {
+#if defined(__SIZEOF_INT128__)
+  return osl_u128tos(((osl_uint128_t)high << 64) | low, buf);
+#else
+  //divide the 32 bit limbs by 10^9, the chunks come out least significant first
+  uint32_t limbs[4];
+  uint32_t chunks[5];
+  int count = 0;
+  int len;
+  limbs[0] = (uint32_t)(high >> 32);
+  limbs[1] = (uint32_t)high;
+  limbs[2] = (uint32_t)(low >> 32);
+  limbs[3] = (uint32_t)low;
+  while (limbs[0] | limbs[1] | limbs[2] | limbs[3]) {
+    uint64_t rest = 0;
+    for (int i = 0; i < 4; i++) {
+      uint64_t cur = (rest << 32) | limbs[i];
+      limbs[i] = (uint32_t)(cur / 1000000000);
+      rest = cur % 1000000000;
+    }
+    chunks[count++] = (uint32_t)rest;
+  }
+  if (count == 0)
+    return u64tos(0, buf);
+  len = u64tos(chunks[count - 1], buf);
+  for (int i = count - 2; i >= 0; i--) {
+    uint32_t chunk = chunks[i];
+    for (int j = 8; j >= 0; j--) {
+      buf[len + j] = '0' + chunk % 10;
+      chunk /= 10;
+    }
+    len += 9;
+  }
+  return len;
+#endif // __SIZEOF_INT128__
+}
+
+/// <summary>
+/// Lays out the exact value digits * 10^exponent for 'e', 'f' or 'g'
+/// </summary>
+static ibool _vformat_decimal(OslFormatter* formatter, ibool negative, const char* digits, int length, int exponent,
+  char specifier) {
+  int precision = formatter->precision >= 0 ? formatter->precision : 6;
+  int exponent10;
+  int dotpos;
+  char gspecifier = 0;
+  char cvtbuf[NUMBER_CVT_LENGTH + 1];
+  char expbuf[8];
+  OslFormatSegments segs;
+  _vformat_segments_init(&segs);
+  if (specifier == 'g' && precision == 0)
+    precision = 1;
+  if (ieee754dectos(digits, length, exponent, cvtbuf, NUMBER_CVT_LENGTH, specifier,
+    precision, &exponent10, &dotpos, &gspecifier) != 0)
+    return FALSE;
+  _vformat_cvt_layout(formatter, &segs, expbuf, cvtbuf, specifier, precision, exponent10, dotpos, gspecifier);
+  return _vformat_append_double(formatter, negative, &segs);
+}
+
+/// <summary>
+/// %Df of a BID decimal64: sign, a 10 bit biased exponent and a coefficient below 10^16.
+/// Coefficients of the 11 combination field start with 100 and are at bit 50, 1111 is infinity or NaN.
+/// Non-canonical coefficients are 0 as the standard requires.
+/// </summary>
+static ibool _vformat_decimal64(OslFormatter* formatter, uint64_t bits, char specifier) {
+  ibool negative = (bits >> 63) != 0;
+  uint64_t coefficient;
+  int exponent;
+  char digits[24];
+  if (((bits >> 61) & 3) == 3) {
+    if (((bits >> 59) & 3) == 3) {
+      if (((bits >> 58) & 1) == 0)
+        return _vformat_nan(formatter, negative, 0, specifier);
+      return _vformat_nan(formatter, negative, ((bits >> 57) & 1) ? 3 : 1, specifier);
+    }
+    exponent = (int)((bits >> 51) & 0x3FF);
+    coefficient = (UINT64_C(4) << 51) | (bits & ((UINT64_C(1) << 51) - 1));
+  }
+  else {
+    exponent = (int)((bits >> 53) & 0x3FF);
+    coefficient = bits & ((UINT64_C(1) << 53) - 1);
+  }
+  if (coefficient > DECIMAL64_MAX_COEFFICIENT)
+    coefficient = 0;
+  exponent -= DECIMAL64_BIAS;
+  if (specifier == 'f' && exponent <= 0) {
+    //a fraction of a 64 bit integer, the same as %Q
+    return _vformat_scaled_digits(formatter, negative, coefficient, -exponent,
+      formatter->precision >= 0 ? formatter->precision : 6);
+  }
+  return _vformat_decimal(formatter, negative, digits, u64tos(coefficient, digits), exponent, specifier);
+}
+
+/// <summary>
+/// %DDf of a BID decimal128: sign, a 14 bit biased exponent and a coefficient below 10^34.
+/// The 11 combination field is only used for infinity and NaN, any other coefficient in it is non-canonical.
+/// </summary>
+static ibool _vformat_decimal128(OslFormatter* formatter, uint64_t high, uint64_t low, char specifier) {
+  ibool negative = (high >> 63) != 0;
+  uint64_t coefficient_high;
+  int exponent;
+  char digits[40];
+  if (((high >> 61) & 3) == 3) {
+    if (((high >> 59) & 3) == 3) {
+      if (((high >> 58) & 1) == 0)
+        return _vformat_nan(formatter, negative, 0, specifier);
+      return _vformat_nan(formatter, negative, ((high >> 57) & 1) ? 3 : 1, specifier);
+    }
+    exponent = (int)((high >> 47) & 0x3FFF);
+    coefficient_high = 0;
+    low = 0;
+  }
+  else {
+    exponent = (int)((high >> 49) & 0x3FFF);
+    coefficient_high = high & ((UINT64_C(1) << 49) - 1);
+    if (coefficient_high > DECIMAL128_MAX_HIGH
+      || (coefficient_high == DECIMAL128_MAX_HIGH && low > DECIMAL128_MAX_LOW)) {
+      coefficient_high = 0;
+      low = 0;
+    }
+  }
+  exponent -= DECIMAL128_BIAS;
+  if (specifier == 'f' && exponent <= 0 && coefficient_high == 0) {
+    return _vformat_scaled_digits(formatter, negative, low, -exponent,
+      formatter->precision >= 0 ? formatter->precision : 6);
+  }
+  return _vformat_decimal(formatter, negative, digits, _vformat_u128_digits(coefficient_high, low, digits),
+    exponent, specifier);
+}
+
+#define SMALL_FLOAT_HALF 1 //IEEE 754 binary16
+#define SMALL_FLOAT_BF16 2 //bfloat16, the upper half of a binary32
+
+static const double _vformat_pow10_f64[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/// <summary>
+/// The value of binary16 or bfloat16 bits as a double, which holds all of them exactly
+/// </summary>
+static double _vformat_small_float_value(uint32_t bits, int type) {
+  union ui64_f64 ua;
+  uint64_t sign = (uint64_t)(bits >> 15) << 63;
+  uint32_t exponent;
+  uint64_t frac;
+  if (type == SMALL_FLOAT_HALF) {
+    exponent = (bits >> 10) & 0x1F;
+    frac = bits & 0x3FF;
+    if (exponent == 0) {
+      //subnormal, frac * 2^-24
+      ua.f = (double)frac * (1.0 / 16777216.0);
+      ua.ui |= sign;
+      return ua.f;
+    }
+    exponent = exponent == 0x1F ? 0x7FF : exponent - 15 + 1023;
+    ua.ui = sign | ((uint64_t)exponent << 52) | (frac << 42);
+    return ua.f;
+  }
+  exponent = (bits >> 7) & 0xFF;
+  frac = bits & 0x7F;
+  if (exponent == 0) {
+    //subnormal, frac * 2^-133
+    ua.f = (double)frac * (1.0 / 16777216.0) * (1.0 / 16777216.0) * (1.0 / 16777216.0)
+      * (1.0 / 16777216.0) * (1.0 / 16777216.0) * (1.0 / 8192.0);
+    ua.ui |= sign;
+    return ua.f;
+  }
+  exponent = exponent == 0xFF ? 0x7FF : exponent - 127 + 1023;
+  ua.ui = sign | ((uint64_t)exponent << 52) | (frac << 45);
+  return ua.f;
+}
+
+/// <summary>
+/// Rounds a positive normal double to the nearest binary16 or bfloat16, ties to even.
+/// </summary>
+/// <returns>the bits without the sign, infinity if it is too large</returns>
+static uint32_t _vformat_small_float_round(double value, int type) {
+  int mantissa_bits = type == SMALL_FLOAT_HALF ? 10 : 7;
+  int bias = type == SMALL_FLOAT_HALF ? 15 : 127;
+  uint32_t infinity = (uint32_t)(2 * bias + 1) << mantissa_bits;
+  union ui64_f64 ua;
+  ua.f = value;
+  int biased = (int)((ua.ui >> 52) & 0x7FF) - 1023 + bias;
+  uint64_t significand = (ua.ui & ((UINT64_C(1) << 52) - 1)) | (UINT64_C(1) << 52);
+  int shift = 52 - mantissa_bits;
+  if (biased <= 0) {
+    shift += 1 - biased;
+    biased = 0;
+  }
+  if (shift > 54)
+    return 0;
+  uint64_t kept = significand >> shift;
+  uint64_t rest = significand & ((UINT64_C(1) << shift) - 1);
+  uint64_t half = UINT64_C(1) << (shift - 1);
+  if (rest > half || (rest == half && (kept & 1)))
+    kept++;
+  //a subnormal that rounds up to 2^mantissa_bits has become the smallest normal by itself
+  if (biased == 0)
+    return (uint32_t)kept;
+  uint32_t bits = ((uint32_t)biased << mantissa_bits) + (uint32_t)(kept - (UINT64_C(1) << mantissa_bits));
+  return bits < infinity ? bits : infinity;
+}
+
+/// <summary>
+/// candidate * 10^exponent, correctly rounded for |exponent| <= 22
+/// </summary>
+static double _vformat_small_float_decimal(uint64_t candidate, int exponent) {
+  double value = (double)candidate;
+  while (exponent > 22) {
+    value *= 1e22;
+    exponent -= 22;
+  }
+  while (exponent < -22) {
+    value /= 1e22;
+    exponent += 22;
+  }
+  return exponent >= 0 ? value * _vformat_pow10_f64[exponent] : value / _vformat_pow10_f64[-exponent];
+}
+
+/// <summary>
+/// The shortest decimal candidate * 10^exponent that rounds back to bits, the nearest one if there are two.
+/// A binary16 needs at most 5 digits and a bfloat16 4, so for each length only the two neighbours
+/// of value in that many digits are tried, with double arithmetic and _vformat_small_float_round.
+/// </summary>
+static void _vformat_small_float_shortest(double value, uint32_t bits, int type, uint64_t* pdigits, int* pexponent) {
+  union ui64_f64 ua;
+  ua.f = value;
+  //the decimal exponent from the binary one, log10(2) ~ 0.30103
+  int k = ((int)((ua.ui >> 52) & 0x7FF) - 1023) * 30103 / 100000;
+  while (_vformat_small_float_decimal(1, k) > value)
+    k--;
+  while (_vformat_small_float_decimal(1, k + 1) <= value)
+    k++;
+  for (int p = 1; ; p++) {
+    int exponent = k - p + 1;
+    double scaled = exponent >= 0 ? value / _vformat_small_float_decimal(1, exponent)
+      : value * _vformat_small_float_decimal(1, -exponent);
+    uint64_t low = (uint64_t)scaled;
+    uint64_t high = low + 1;
+    ibool low_ok = low > 0 && _vformat_small_float_round(_vformat_small_float_decimal(low, exponent), type) == bits;
+    ibool high_ok = _vformat_small_float_round(_vformat_small_float_decimal(high, exponent), type) == bits;
+    if (low_ok && high_ok) {
+      double low_distance = scaled - (double)low;
+      double high_distance = (double)high - scaled;
+      if (high_distance < low_distance || (high_distance == low_distance && (high & 1) == 0))
+        low_ok = FALSE;
+    }
+    if (low_ok || high_ok || p >= 17) {
+      *pdigits = low_ok ? low : high;
+      *pexponent = exponent;
+      return;
+    }
+  }
+}
+
+#define SMALL_FLOAT_LIMBS 12 //base 10^9 limbs of an exact value, a bfloat16 needs at most 11
+
+static const uint32_t _vformat_pow5_u32[14] = {
+  1, 5, 25, 125, 625, 3125, 15625, 78125, 390625, 1953125, 9765625, 48828125, 244140625, 1220703125
+};
+
+/// <summary>
+/// All significant digits of a binary16 or bfloat16 magnitude, at most 96. The odd mantissa of 8 or 11
+/// bits is multiplied by 2^e, or by 5^-e for a negative e which moves the point -e digits left,
+/// in a few base 10^9 limbs.
+/// </summary>
+/// <returns>the number of digits, *pexponent10 is the decimal exponent of the first</returns>
+static int _vformat_small_float_exact(double magnitude, char* digits, int* pexponent10) {
+  union ui64_f64 ua;
+  uint32_t limbs[SMALL_FLOAT_LIMBS];
+  int count = 1;
+  int len;
+  ua.f = magnitude;
+  uint64_t mantissa = fracF64UI(ua.ui) | (UINT64_C(1) << 52);
+  int exponent2 = expF64UI(ua.ui) - 1075;
+  while ((mantissa & 1) == 0) {
+    mantissa >>= 1;
+    exponent2++;
+  }
+  limbs[0] = (uint32_t)mantissa;
+  for (int left = exponent2 < 0 ? -exponent2 : exponent2; left > 0;) {
+    //a limb below 10^9 times 2^29 or 5^13 and a carry fits 64 bits
+    int step = exponent2 < 0 ? (left < 13 ? left : 13) : (left < 29 ? left : 29);
+    uint64_t factor = exponent2 < 0 ? _vformat_pow5_u32[step] : UINT64_C(1) << step;
+    uint64_t carry = 0;
+    for (int i = 0; i < count; i++) {
+      uint64_t product = limbs[i] * factor + carry;
+      limbs[i] = (uint32_t)(product % 1000000000);
+      carry = product / 1000000000;
+    }
+    while (carry != 0) {
+      limbs[count++] = (uint32_t)(carry % 1000000000);
+      carry /= 1000000000;
+    }
+    left -= step;
+  }
+  len = u64tos(limbs[count - 1], digits);
+  for (int i = count - 2; i >= 0; i--) {
+    uint32_t limb = limbs[i];
+    for (int j = 8; j >= 0; j--) {
+      digits[len + j] = (char)('0' + limb % 10);
+      limb /= 10;
+    }
+    len += 9;
+  }
+  *pexponent10 = len - 1 + (exponent2 < 0 ? exponent2 : 0);
+  return len;
+}
+
+/// <summary>
+/// Rounds len exact digits to count significant digits, half to even, and drops trailing zeros.
+/// A carry out of the first digit leaves "1" and increments *pexponent10.
+/// </summary>
+static int _vformat_small_float_round_digits(char* digits, int len, int count, int* pexponent10) {
+  if (len > count) {
+    ibool up = digits[count] > '5';
+    if (digits[count] == '5') {
+      up = ((digits[count - 1] - '0') & 1) != 0;
+      for (int i = count + 1; i < len && !up; i++) {
+        up = digits[i] != '0';
+      }
+    }
+    len = count;
+    for (int i = count - 1; up; i--) {
+      if (i < 0) {
+        digits[0] = '1';
+        len = 1;
+        (*pexponent10)++;
+        break;
+      }
+      up = digits[i] == '9';
+      digits[i] = up ? '0' : digits[i] + 1;
+    }
+  }
+  while (len > 1 && digits[len - 1] == '0') {
+    len--;
+  }
+  digits[len] = 0;
+  return len;
+}
+
+//%e and %g of a binary16 or bfloat16 from its exact digits, without the double conversion
+static ibool _vformat_small_float_fixed(OslFormatter* formatter, double magnitude, ibool negative, char specifier) {
+  char digits[SMALL_FLOAT_LIMBS * 9 + 1];
+  char expbuf[8];
+  int exponent10;
+  int precision = formatter->precision >= 0 ? formatter->precision : 6;
+  int len = _vformat_small_float_exact(magnitude, digits, &exponent10);
+  OslFormatSegments segs;
+  _vformat_segments_init(&segs);
+  if (specifier == 'e') {
+    _vformat_small_float_round_digits(digits, len, precision < len ? precision + 1 : len, &exponent10);
+    _vformat_cvt_layout(formatter, &segs, expbuf, digits, 'e', precision, exponent10, 1, 0);
+  }
+  else {
+    if (precision == 0)
+      precision = 1;
+    _vformat_small_float_round_digits(digits, len, precision < len ? precision : len, &exponent10);
+    if (exponent10 < -4 || exponent10 >= precision)
+      _vformat_cvt_layout(formatter, &segs, expbuf, digits, 'g', precision, exponent10, 1, 'e');
+    else
+      _vformat_cvt_layout(formatter, &segs, expbuf, digits, 'g', precision, exponent10, exponent10 + 1, 'f');
+  }
+  return _vformat_append_double(formatter, negative, &segs);
+}
+
+//the shortest digits of every positive binary16 and bfloat16 as candidate << 8 | (exponent + 128),
+//each entry is filled on first use, 0 until then. Racing threads store the same value.
+static volatile uint32_t _vformat_small_float_cache[2][0x8000];
+
+/// <summary>
+/// f e g a of binary16 or bfloat16 bits. e and g round the exact digits of the value like %e and %g of
+/// the equivalent double, 6 digits without a precision. %#g without a precision gives instead the shortest
+/// digits that read back as the same value, with the %g layout and no trailing zeros.
+/// f and a are the conversions of the exact double.
+/// </summary>
+static ibool _vformat_small_float(OslFormatter* formatter, uint32_t bits, int type, char specifier) {
+  double value = _vformat_small_float_value(bits, type);
+  uint32_t magnitude = bits & 0x7FFF;
+  uint32_t infinity = type == SMALL_FLOAT_HALF ? 0x7C00 : 0x7F80;
+  uint64_t candidate;
+  int exponent;
+  int len;
+  int exponent10;
+  char digits[24];
+  char expbuf[8];
+  OslFormatSegments segs;
+  if (magnitude == 0 || magnitude >= infinity || specifier == 'f' || specifier == 'a')
+    return _vformat_ieee754d64(formatter, value, specifier);
+  if (specifier != 'g' || !formatter->alternate_form || formatter->precision >= 0)
+    return _vformat_small_float_fixed(formatter, value < 0 ? -value : value, (bits >> 15) != 0, specifier);
+  //'#' asks for the shortest digits, not for the trailing zeros of %#g
+  formatter->alternate_form = FALSE;
+  uint32_t cached = _vformat_small_float_cache[type - 1][magnitude];
+  if (cached != 0) {
+    candidate = cached >> 8;
+    exponent = (int)(cached & 0xFF) - 128;
+  }
+  else {
+    _vformat_small_float_shortest(value < 0 ? -value : value, magnitude, type, &candidate, &exponent);
+    while (candidate % 10 == 0) {
+      candidate /= 10;
+      exponent++;
+    }
+    _vformat_small_float_cache[type - 1][magnitude] = (uint32_t)(candidate << 8) | (uint32_t)(exponent + 128);
+  }
+  len = u64tos(candidate, digits);
+  digits[len] = 0;
+  //fewer digits than the precision of 6, the %g layout needs no rounding
+  exponent10 = exponent + len - 1;
+  _vformat_segments_init(&segs);
+  if (exponent10 < -4 || exponent10 >= 6)
+    _vformat_cvt_layout(formatter, &segs, expbuf, digits, 'g', 6, exponent10, 1, 'e');
+  else
+    _vformat_cvt_layout(formatter, &segs, expbuf, digits, 'g', 6, exponent10, exponent10 + 1, 'f');
+  return _vformat_append_double(formatter, (bits >> 15) != 0, &segs);
+}
+
+#define PREFIX_MAX_PRECISION 40
+#define PREFIX_SI_UNIT 8 //the index of the empty SI prefix
+
+//SI prefixes from 10^-24 to 10^24, index - PREFIX_SI_UNIT is the power of 1000
+static const char* const _vformat_si_prefixes[17] = {
+  "y", "z", "a", "f", "p", "n", "u", "m", "", "k", "M", "G", "T", "P", "E", "Z", "Y"
+};
+
+//IEC prefixes, index is the power of 1024
+static const char* const _vformat_iec_prefixes[9] = {
+  "", "Ki", "Mi", "Gi", "Ti", "Pi", "Ei", "Zi", "Yi"
+};
+
+static const double _vformat_pow1000_f64[9] = {
+  1e0, 1e3, 1e6, 1e9, 1e12, 1e15, 1e18, 1e21, 1e24
+};
+
+/// <summary>
+/// whole + rest / unit followed by prefixes[index]. The precision is the number of significant digits,
+/// 3 by default, but digits of whole are never dropped. The last digit rounds half to even, a carry
+/// that reaches radix moves to the next prefix. Trailing zeros are removed unless '#' is given.
+/// </summary>
+/// <param name="unit">the value of 1 in rest, at most 2^60 so that rest * 10 fits</param>
+static ibool _vformat_prefixed(OslFormatter* formatter, ibool neg, uint64_t whole, uint64_t rest, uint64_t unit,
+  uint64_t radix, int index, int max_index, const char* const* prefixes) {
+  char digits[24];
+  char fraction[PREFIX_MAX_PRECISION];
+  int precision = formatter->precision < 0 ? 3 : formatter->precision == 0 ? 1 : formatter->precision;
+  int len = u64tos(whole, digits);
+  int count;
+  int i;
+  OslFormatSegments segs;
+  if (precision > PREFIX_MAX_PRECISION)
+    precision = PREFIX_MAX_PRECISION;
+  count = precision > len ? precision - len : 0;
+  for (i = 0; i < count; i++) {
+    rest *= 10;
+    fraction[i] = (char)('0' + rest / unit);
+    rest %= unit;
+  }
+  if (rest * 2 > unit || (rest * 2 == unit && ((count > 0 ? fraction[count - 1] : (int)whole) & 1))) {
+    i = count - 1;
+    while (i >= 0 && fraction[i] == '9') {
+      fraction[i--] = '0';
+    }
+    if (i >= 0) {
+      fraction[i]++;
+    }
+    else {
+      //the carry reached whole, which may have grown a digit or reached the next prefix
+      whole++;
+      if (whole == radix && index < max_index) {
+        whole = 1;
+        index++;
+      }
+      len = u64tos(whole, digits);
+      count = precision > len ? precision - len : 0;
+      memset(fraction, '0', count);
     }
-    formatter->padding_zero = FALSE;
-    formatter->prefix_blank = FALSE;
-    return _vformat_append_with_prefix_double(formatter, prefix, prefix_len, digits, digist_len); 
-   
+  }
+  if (!formatter->alternate_form) {
+    while (count > 0 && fraction[count - 1] == '0') {
+      count--;
+    }
+  }
+  _vformat_segments_init(&segs);
+  _vformat_segments_add(&segs, digits, len);
+  if (count > 0 || formatter->alternate_form)
+    _vformat_segments_add(&segs, ".", 1);
+  _vformat_segments_add(&segs, fraction, count);
+  _vformat_segments_add(&segs, prefixes[index], (intptr_t)strlen(prefixes[index]));
+  return _vformat_append_double(formatter, neg, &segs);
 }
 
-extern int ieee754d64tos(double value, char* buf, int buflen,   char specifier, int precision, int* pexp, int* pdotpos, char* pgret);
+/// <summary>
+/// %k and %K of an integer, the prefix is picked by comparing with the powers of 1000 or 1024
+/// </summary>
+static ibool _vformat_prefixed_int64(OslFormatter* formatter, int64_t value, ibool iec) {
+  uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+  int index = 0;
+  if (iec) {
+    while (index < 6 && (magnitude >> (10 * index + 10)) != 0) {
+      index++;
+    }
+    return _vformat_prefixed(formatter, value < 0, magnitude >> (10 * index),
+      magnitude & ((UINT64_C(1) << (10 * index)) - 1), UINT64_C(1) << (10 * index), 1024, index, 8, _vformat_iec_prefixes);
+  }
+  while (index < 6 && magnitude >= _vformat_pow10[3 * index + 3]) {
+    index++;
+  }
+  return _vformat_prefixed(formatter, value < 0, magnitude / _vformat_pow10[3 * index],
+    magnitude % _vformat_pow10[3 * index], _vformat_pow10[3 * index], 1000, index + PREFIX_SI_UNIT, 16, _vformat_si_prefixes);
+}
 
-static ibool _vformat_ieee754d64(OslFormatter* formatter, double value, char specifier) {
-   
+/// <summary>
+/// %Rk and %RK of a double. The IEC prefix comes from the binary exponent, the SI prefix from an
+/// estimate of the decimal exponent corrected by one compare. Values beyond the prefixes, and IEC
+/// values below 1, are printed like %g with the same precision.
+/// </summary>
+static ibool _vformat_prefixed_double(OslFormatter* formatter, double value, ibool iec) {
   union ui64_f64 ua;
-  ua.f = value;
-  uint64_t ui = ua.ui; 
-  int32_t  exponent2 = expF64UI(ui);
-  uint64_t frac = fracF64UI(ui);
-
-  //  infinity 	inf             s = u; e = 2047; f = 0 
-  //  Indefinite NaN 	nan(ind)  s = 1; e = 2047; f = .1000 -- 00
-  //  Quiet NaN  nan            s = u; e = 2047; f = .1uuu -- uu 
-  //  Signaling NaN 	nan(snan) s = u; e = 2047; f = .0uuu -- uu 0 (at least one of the u in f is nonzero)
-   
-  if (exponent2 == 2047) {
-    int classification;
-    int negative = signF64UI(ui);
-    if (frac == 0) {//inf
-      classification = 0;
+  double magnitude = value < 0 ? -value : value;
+  double scaled;
+  int exponent2;
+  int index;
+  ua.f = magnitude;
+  exponent2 = (int)expF64UI(ua.ui) - 1023;
+  if (magnitude == 0)
+    return _vformat_prefixed(formatter, value < 0, 0, 0, 1, 1000, 0, 0, _vformat_iec_prefixes);
+  if (exponent2 == 2047 - 1023)
+    goto fallback;
+  if (iec) {
+    if (exponent2 < 0)
+      goto fallback;
+    index = exponent2 / 10 < 8 ? exponent2 / 10 : 8;
+    //divides by 1024^index exactly
+    ua.ui -= (uint64_t)(10 * index) << 52;
+    scaled = ua.f;
+  }
+  else {
+    //floor(exponent2 * log10(2)) is the decimal exponent or one less
+    int exponent10 = exponent2 * 30103 / 100000 - (exponent2 < 0);
+    index = exponent10 >= 0 ? exponent10 / 3 : -((2 - exponent10) / 3);
+    if (index < -PREFIX_SI_UNIT)
+      index = -PREFIX_SI_UNIT;
+    else if (index > PREFIX_SI_UNIT)
+      index = PREFIX_SI_UNIT;
+    for (;;) {
+      scaled = index >= 0 ? magnitude / _vformat_pow1000_f64[index] : magnitude * _vformat_pow1000_f64[-index];
+      if (scaled >= 1000 && index < PREFIX_SI_UNIT)
+        index++;
+      else if (scaled < 1 && index > -PREFIX_SI_UNIT)
+        index--;
+      else
+        break;
     }
-    else {//nan
-#if 1
-      //from msvc crt
-      const uint64_t special_nan_mantissa_mask = (1ui64 << 51);
-      if (negative && frac == special_nan_mantissa_mask) {
-        //Indeterminate NAN
-        classification = 2;
-      }
-      else if (frac & special_nan_mantissa_mask) {
-        //Quiet NAN
-        classification = 1;
-      }
-      else {
-        //Signaling NAN
-        classification = 3;
-      }
-#else 
-      classification = 1;
+    if (scaled < 1)
+      goto fallback;
+  }
+  if (scaled >= 9223372036854775808.0)
+    goto fallback;
+  do {
+    //scaled >= 1 is a multiple of 2^-52, the fraction is exact
+    uint64_t whole = (uint64_t)scaled;
+    uint64_t rest = (uint64_t)((scaled - (double)whole) * 4503599627370496.0);
+    if (iec)
+      return _vformat_prefixed(formatter, value < 0, whole, rest, UINT64_C(1) << 52, 1024, index, 8,
+        _vformat_iec_prefixes);
+    return _vformat_prefixed(formatter, value < 0, whole, rest, UINT64_C(1) << 52, 1000, index + PREFIX_SI_UNIT, 16,
+      _vformat_si_prefixes);
+  } while (0);
+fallback:
+  if (formatter->precision < 0)
+    formatter->precision = 3;
+  return _vformat_ieee754d64(formatter, value, 'g');
+}
+
+#if defined(_MSC_VER)
+#define FORMAT_THREAD_LOCAL __declspec(thread)
+#else
+#define FORMAT_THREAD_LOCAL __thread
 #endif
 
-    }  
-    return _vformat_nan(formatter, negative, classification, specifier);
-  }  
+#define TIMESTAMP_MAX_PRECISION 9
+//"-YYYYYYYYYYYY-MM-DDTHH:MM:" for the largest years of an int64 epoch
+#define TIMESTAMP_PREFIX_LENGTH 32
 
-  int precision;
-  intptr_t len = 0;
-  int exponent10;
-  int dotpos;
-  char gspecifier;
-  char cvtbuf[NUMBER_BUFFER_LENGTH + 1];
+//the "YYYY-MM-DDTHH:MM:" of the minute last printed by the thread, see _vformat_timestamp
+typedef struct OslTimestampCache OslTimestampCache;
+struct OslTimestampCache {
+  int64_t minute; //minutes since the epoch
+  int length;     //0 for an empty cache
+  char prefix[TIMESTAMP_PREFIX_LENGTH];
+};
 
-  switch (specifier) {
-  case 'a':
-    do{ 
-      int prefix_len;
-      precision = formatter->precision >= 0 ? formatter->precision : 13;
-      len = _vformat_hcvt_ieee754d64(formatter, formatter->tempbuf,
-        NUMBER_BUFFER_LENGTH, value, precision, &prefix_len);
-      if (len <0)
-        return FALSE; 
-      if (len >= formatter->width || formatter->left_align)
-        return _vformat_append_string(formatter, formatter->tempbuf, len);
-      else {
-        if (formatter->padding_zero) {
-          if (!_vformat_append(formatter, formatter->tempbuf, prefix_len))
-            return FALSE;
-          if (!_vformat_append_nchar(formatter, '0', formatter->width - len))
-            return FALSE;
-        }
-        else {
-          if (!_vformat_append_nchar(formatter, ' ', formatter->width - len))
-            return FALSE;
-          if (!_vformat_append(formatter, formatter->tempbuf, prefix_len))
-            return FALSE;
-        }
-        return _vformat_append(formatter, formatter->tempbuf + prefix_len, len - prefix_len);
-      }
-    }while (0);
-  case 'e':
-    precision = formatter->precision >= 0 ? formatter->precision : 6;
-    ieee754d64tos(value, cvtbuf, NUMBER_BUFFER_LENGTH,   'e',
-      precision, &exponent10, &dotpos, NULL);
-     
-    len = _vformat_double_e(
-      formatter,
-      formatter->tempbuf,
-      cvtbuf,
-      precision, FALSE, exponent10, dotpos, TRUE);
-    break;
-  case 'f':
-    precision = (formatter->precision >= 0 ? formatter->precision : 6);
-    ieee754d64tos(value, cvtbuf, NUMBER_BUFFER_LENGTH,  'f',
-      precision, &exponent10, &dotpos, NULL);
-    len = _vformat_double_f(
-      formatter,
-      formatter->tempbuf,
-      cvtbuf,
-      precision, FALSE, dotpos, TRUE);
-    break;
-  case 'g':
-    //The e format is used only when the exponent of the value is less than ?C4
-    //or greater than or equal to the precision argument.Trailing zeros are truncated,
-    //and the decimal point appears only if one or more digits follow it.
+static FORMAT_THREAD_LOCAL OslTimestampCache _vformat_timestamp_cache;
 
-    //The precision specifies the number of significant digits. 
-    //If the precision is missing, 6 digits are given;
-    precision = (formatter->precision >= 0 ? formatter->precision : 6);
-    if (precision == 0)
-      precision = 1;
-    ieee754d64tos(value, cvtbuf, NUMBER_BUFFER_LENGTH,'g',
-      precision, &exponent10, &dotpos, &gspecifier);
-    //'#' For g and G
-    //  conversions, trailing zeros are not removed from the
-    //  result as they would otherwise be.
-    // 
-    //Style e is used if the exponent from its conversion is less than -4 
-    // or greater than or equal to the precision.
-    if (gspecifier == 'e') {//if ((exp < -4 || (exp >= precision))) {
-      len = _vformat_double_e(
-        formatter,
-        formatter->tempbuf,
-        cvtbuf,
-        precision, TRUE, exponent10, dotpos, formatter->alternate_form);
+static char* _vformat_2digits(char* pos, unsigned int value) {
+  pos[0] = (char)('0' + value / 10);
+  pos[1] = (char)('0' + value % 10);
+  return pos + 2;
+}
+
+/// <summary>
+/// The proleptic Gregorian year, month and day of days since 1970-01-01,
+/// counted in 400 year eras that start on March 1st so the leap day is the last day of a year.
+/// </summary>
+static void _vformat_civil_from_days(int64_t days, int64_t* pyear, unsigned int* pmonth, unsigned int* pday) {
+  int64_t era;
+  unsigned int day_of_era, year_of_era, day_of_year, month;
+  days += 719468; //0000-03-01
+  era = (days >= 0 ? days : days - 146096) / 146097;
+  day_of_era = (unsigned int)(days - era * 146097);
+  year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+  day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  month = (5 * day_of_year + 2) / 153; //0 for March
+  *pday = day_of_year - (153 * month + 2) / 5 + 1;
+  *pmonth = month < 10 ? month + 3 : month - 9;
+  *pyear = year_of_era + era * 400 + (*pmonth <= 2);
+}
+
+/// <summary>
+/// "YYYY-MM-DDTHH:MM:" of minutes since the epoch, years beyond 0000-9999 get more digits or a sign
+/// </summary>
+static int _vformat_timestamp_prefix(int64_t minute, char* buf) {
+  int64_t days = (minute >= 0 ? minute : minute - 1439) / 1440;
+  unsigned int minute_of_day = (unsigned int)(minute - days * 1440);
+  int64_t year;
+  unsigned int month, day;
+  char* pos = buf;
+  _vformat_civil_from_days(days, &year, &month, &day);
+  if (year < 0) {
+    *pos++ = '-';
+    year = -year;
+  }
+  if (year < 10000) {
+    pos = _vformat_2digits(pos, (unsigned int)year / 100);
+    pos = _vformat_2digits(pos, (unsigned int)year % 100);
+  }
+  else {
+    pos += u64tos((uint64_t)year, pos);
+  }
+  *pos++ = '-';
+  pos = _vformat_2digits(pos, month);
+  *pos++ = '-';
+  pos = _vformat_2digits(pos, day);
+  *pos++ = 'T';
+  pos = _vformat_2digits(pos, minute_of_day / 60);
+  *pos++ = ':';
+  pos = _vformat_2digits(pos, minute_of_day % 60);
+  *pos++ = ':';
+  return (int)(pos - buf);
+}
+
+/// <summary>
+/// %T, an int64 epoch as an RFC 3339 UTC timestamp. The precision is the number of fraction digits
+/// and the unit of the value at once: seconds by default, %.3T milliseconds, %.6T microseconds,
+/// %.9T nanoseconds. The date and minute come from a per thread cache of the last minute printed,
+/// so consecutive timestamps only render their seconds and fraction.
+/// </summary>
+static ibool _vformat_timestamp(OslFormatter* formatter, int64_t value) {
+  OslTimestampCache* cache = &_vformat_timestamp_cache;
+  int precision = formatter->precision >= 0 ? formatter->precision : 0;
+  char buf[TIMESTAMP_PREFIX_LENGTH + TIMESTAMP_MAX_PRECISION + 8];
+  char* pos;
+  int64_t seconds, minute, rest;
+  int second;
+  int i;
+  if (precision > TIMESTAMP_MAX_PRECISION) {
+    errno = EINVAL;
+    return FALSE;
+  }
+  //floor division, the fraction of a time before the epoch counts up from the earlier second
+  seconds = value / (int64_t)_vformat_pow10[precision];
+  rest = value % (int64_t)_vformat_pow10[precision];
+  if (rest < 0) {
+    rest += (int64_t)_vformat_pow10[precision];
+    seconds--;
+  }
+  minute = seconds / 60;
+  second = (int)(seconds % 60);
+  if (second < 0) {
+    second += 60;
+    minute--;
+  }
+  if (cache->length == 0 || cache->minute != minute) {
+    cache->length = _vformat_timestamp_prefix(minute, cache->prefix);
+    cache->minute = minute;
+  }
+  memcpy(buf, cache->prefix, TIMESTAMP_PREFIX_LENGTH);
+  pos = _vformat_2digits(buf + cache->length, (unsigned int)second);
+  if (precision > 0) {
+    *pos++ = '.';
+    for (i = precision - 1; i >= 0; i--) {
+      pos[i] = (char)('0' + rest % 10);
+      rest /= 10;
     }
-    else {
-      len = _vformat_double_f(
-        formatter,
-        formatter->tempbuf,
-        cvtbuf,
-        precision, TRUE, dotpos, formatter->alternate_form);
-    }   
+    pos += precision;
+  }
+  *pos++ = 'Z';
+  return _vformat_append_string(formatter, buf, pos - buf);
+}
+
+//a handler of %!c and its context, see osl_format_register
+typedef struct OslFormatCustom OslFormatCustom;
+struct OslFormatCustom {
+  OslFormatHandler handler;
+  void* context;
+};
+
+static OslFormatCustom _vformat_custom_table[256];
+
+/// <summary>
+/// Registers the handler of %!conversion, the argument of the conversion is a pointer passed to it.
+/// A handler writes straight to the output with osl_format_sink_write. Registering replaces
+/// the previous handler, NULL removes it. Handlers are meant to be registered at startup,
+/// before other threads format with them.
+/// </summary>
+/// <returns>0, or -1 with errno EINVAL for the conversion 0</returns>
+int osl_format_register(char conversion, OslFormatHandler handler, void* context) {
+  OslFormatCustom* custom = _vformat_custom_table + (unsigned char)conversion;
+  if (conversion == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  custom->handler = handler;
+  custom->context = context;
+  return 0;
+}
+
+int osl_format_sink_write(OslFormatSink* sink, const char* sz, intptr_t len) {
+  return _vformat_append((OslFormatter*)sink, sz, len) ? 0 : -1;
+}
+
+int osl_format_sink_fill(OslFormatSink* sink, char ch, intptr_t count) {
+  return _vformat_append_nchar((OslFormatter*)sink, ch, count) ? 0 : -1;
+}
+
+/// <summary>
+/// %!c, dispatched through _vformat_custom_table
+/// </summary>
+static ibool _vformat_custom(OslFormatter* formatter, char conversion, const void* value) {
+  const OslFormatCustom* custom = _vformat_custom_table + (unsigned char)conversion;
+  OslFormatSpec spec;
+  if (custom->handler == NULL) {
+    errno = ENOSYS;
+    return FALSE;
+  }
+  spec.width = formatter->width;
+  spec.precision = formatter->precision;
+  spec.flags = (formatter->left_align ? OSL_FORMAT_FLAG_LEFT_ALIGN : 0)
+    | (formatter->with_sign ? OSL_FORMAT_FLAG_WITH_SIGN : 0)
+    | (formatter->padding_zero ? OSL_FORMAT_FLAG_PADDING_ZERO : 0)
+    | (formatter->prefix_blank ? OSL_FORMAT_FLAG_PREFIX_BLANK : 0)
+    | (formatter->alternate_form ? OSL_FORMAT_FLAG_ALTERNATE_FORM : 0);
+  spec.conversion = conversion;
+  return custom->handler((OslFormatSink*)formatter, &spec, value, custom->context) >= 0;
+}
+
+/// <summary>
+/// %wN and %wfN of C23, psz is at 'w'.
+/// N is 8, 16, 32, 64 or 128 for intN_t and 8, 16, 32 or 64 for int_fastN_t.
+/// </summary>
+/// <returns>the position after N, or NULL if N is not supported</returns>
+static const char* _vformat_parse_bit_width(const char* psz, int* arg_type) {
+  ibool fast = FALSE;
+  int bits = 0;
+  psz++;
+  if (*psz == 'f') {
+    fast = TRUE;
+    psz++;
+  }
+  while (('0' <= *psz) && (*psz <= '9') && bits <= 128) {
+    bits = bits * 10 + (*psz - '0');
+    psz++;
+  }
+  switch (bits) {
+  case 8:
+    *arg_type = fast ? ARG_TYPE_OF_MAX(INT_FAST8_MAX) : ARG_CHAR;
+    break;
+  case 16:
+    *arg_type = fast ? ARG_TYPE_OF_MAX(INT_FAST16_MAX) : ARG_SHORT;
+    break;
+  case 32:
+    *arg_type = fast ? ARG_TYPE_OF_MAX(INT_FAST32_MAX) : ARG_TYPE_OF_MAX(INT32_MAX);
+    break;
+  case 64:
+    *arg_type = ARG_INT64;
+    break;
+  case 128:
+    if (fast)
+      return NULL;
+    *arg_type = ARG_INT128;
     break;
   default:
-    return FALSE;
-  } 
-  return _vformat_append_double(formatter, value < 0, formatter->tempbuf, len);
+    return NULL;
+  }
+  return psz;
+}
+
+static const char* _vformat_parse_flags(OslFormatter* formatter, const char* psz) {
+  formatter->left_align = FALSE;
+  formatter->with_sign = FALSE;
+  formatter->padding_zero = FALSE;
+  formatter->prefix_blank = FALSE;
+  formatter->alternate_form = FALSE;
+
+  ibool run = TRUE;
+  do {
+    switch (*psz) {
+    case '-':
+      formatter->left_align = TRUE;
+      psz++;
+      break;
+    case '+':
+      formatter->with_sign = TRUE;
+      psz++;
+      break;
+    case '0':
+      formatter->padding_zero = TRUE;
+      psz++;
+      break;
+    case ' ':
+      formatter->prefix_blank = TRUE;
+      psz++;
+      break;
+    case '#':
+      formatter->alternate_form = TRUE;
+      psz++;
+      break;
+    default:
+      run = FALSE;
+      break;
+    }
+  } while (run);
+  //If  the 0 and -flags both appear, the 0 flag is ignored.
+  if (formatter->left_align) {
+    formatter->padding_zero = FALSE;
+  }
+  if (formatter->with_sign)
+    formatter->prefix_blank = FALSE;
+  return psz;
 }
 
 static intptr_t _vformat_impl(OslFormatter* formatter, const char* szformat, va_list argptr) {
@@ -891,6 +2842,10 @@ static intptr_t _vformat_impl(OslFormatter* formatter, const char* szformat, va_
 
   psz = szformat;
   start = psz;
+  formatter->format = szformat;
+  formatter->arg_index = 0;
+  formatter->skip = 0;
+  formatter->would_block = FALSE;
 
   for (;;) {
 
@@ -900,13 +2855,15 @@ static intptr_t _vformat_impl(OslFormatter* formatter, const char* szformat, va_
     }
 
     if (*psz == 0) {
-      if (!_vformat_append(formatter, start, psz - start))
+      if (!_vformat_begin_piece(formatter, start)
+        && !_vformat_append(formatter, start, psz - start))
         return -1;
       break;
     }
     psz++;
     if (*psz == '%') {
-      if (!_vformat_append(formatter, start, psz - start))
+      if (!_vformat_begin_piece(formatter, start)
+        && !_vformat_append(formatter, start, psz - start))
         return -1;
       psz++;
       start = psz;
@@ -914,56 +2871,21 @@ static intptr_t _vformat_impl(OslFormatter* formatter, const char* szformat, va_
     }
 
     if ((psz - start - 1) > 0
+      && !_vformat_begin_piece(formatter, start)
       && !_vformat_append(formatter, start, psz - start - 1))
       return -1;
+    start = psz - 1;
 
-    formatter->left_align = FALSE;
-    formatter->with_sign = FALSE;
-    formatter->padding_zero = FALSE;
-    formatter->prefix_blank = FALSE;
-    formatter->alternate_form = FALSE;
-
-    ibool run = TRUE;
-    do {
-      switch (*psz) {
-      case '-':
-        formatter->left_align = TRUE;
-        psz++;
-        break;
-      case '+':
-        formatter->with_sign = TRUE;
-        psz++;
-        break;
-      case '0':
-        formatter->padding_zero = TRUE;
-        psz++;
-        break;
-      case ' ':
-        formatter->prefix_blank = TRUE;
-        psz++;
-        break;
-      case '#':
-        formatter->alternate_form = TRUE;
-        psz++;
-        break;
-      default:
-        run = FALSE;
-        break;
-      }
-    } while (run);
-    //If  the 0 and -flags both appear, the 0 flag is ignored.
-    if (formatter->left_align) {
-      formatter->padding_zero = FALSE;
-    }
-    if (formatter->with_sign)
-      formatter->prefix_blank = FALSE;
+    psz = _vformat_parse_flags(formatter, psz);
 
     formatter->width = -1;
     formatter->precision = -1;
     formatter->specifieris_upper = FALSE;
+    formatter->utf8_mode = 0;
     //width
     if (*psz == '*') {
       formatter->width = va_arg(argptr, int);
+      formatter->arg_index++;
       psz++;
     }
     else if (('0' <= *psz) && (*psz <= '9')) {
@@ -981,6 +2903,7 @@ static intptr_t _vformat_impl(OslFormatter* formatter, const char* szformat, va_
       psz++;
       if (*psz == '*') {
         formatter->precision = va_arg(argptr, int);
+        formatter->arg_index++;
         psz++;
       }
       else if (('0' <= *psz) && (*psz <= '9')) {
@@ -996,180 +2919,339 @@ static intptr_t _vformat_impl(OslFormatter* formatter, const char* szformat, va_
       }
     }
 
-    int arg_size = sizeof(int);
+    int arg_type = ARG_INT;
+    int decimal_bits = 0;
+    int small_float = 0;
+    ibool double_arg = FALSE;
 
     switch (*psz) {
     case 'h':
       psz++;
       if (*psz == 'h') {
         psz++;
-        arg_size = sizeof(char);
+        arg_type = ARG_CHAR;
       }
       else {
-        arg_size = sizeof(short);
+        arg_type = ARG_SHORT;
       }
       break;
     case 'l':
       psz++;
       if (*psz == 'l') {
-        arg_size = sizeof(int64_t);
+        arg_type = ARG_INT64;
         psz++;
       }
       else {
-        arg_size = sizeof(int);
+        arg_type = ARG_TYPE_OF_MAX(LONG_MAX);
       }
       break;
     case 'I':
       psz++;
       if (*psz == '3' && *(psz + 1) == '2') {
         psz += 2;
-        arg_size = sizeof(int);
+        arg_type = ARG_INT;
       }
       else if (*psz == '6' && *(psz + 1) == '4') {
         psz += 2;
-        arg_size = sizeof(int64_t);
+        arg_type = ARG_INT64;
       }
       else {
-        arg_size = sizeof(void*);
+        arg_type = ARG_TYPE_OF_MAX(INTPTR_MAX);
       }
       break;
     case 'j':
       psz++;
-      arg_size = sizeof(intmax_t);
+      arg_type = ARG_TYPE_OF_MAX(INTMAX_MAX);
       break;
     case 't':
+      psz++;
+      arg_type = ARG_TYPE_OF_MAX(PTRDIFF_MAX);
+      break;
     case 'z':
       psz++;
-      arg_size = sizeof(void*);
+      arg_type = ARG_TYPE_OF_MAX(SIZE_MAX >> 1);
       break;
     case 'L':
       psz++;
       assert(sizeof(double) == sizeof(long double));
       break;
-    default:
+    case 'R':
+      //%Rk and %RK take a double
+      psz++;
+      double_arg = TRUE;
       break;
-    }
-
-    uint64_t i_val;
-    int64_t u_val;
-    char char_val;
-    switch (*psz) {
-    case 'c':
-      char_val = va_arg(argptr, int);
-      if (!_vformat_append(formatter, &char_val, 1))
-        return -1;
+    case 'U':
+      //%Us and %UUs, UTF-8 aware width and precision
+      psz++;
+      formatter->utf8_mode = UTF8_CODE_POINTS;
+      if (*psz == 'U') {
+        psz++;
+        formatter->utf8_mode = UTF8_COLUMNS;
+      }
       break;
-    case 'd':
-    case 'i':
-      //If a precision is given with a numeric conversion(d, i, o,
-      //  u, x, and X), the 0 flag is ignored.
-      if (formatter->precision >= 0)
-        formatter->padding_zero = FALSE;
-      if (arg_size == sizeof(int)) {
-        i_val = va_arg(argptr, int);
+    case 'w':
+      //%wb16f is a bfloat16 and %w16f a binary16, passed as their bits
+      if (psz[1] == 'b' && psz[2] == '1' && psz[3] == '6') {
+        psz += 4;
+        small_float = SMALL_FLOAT_BF16;
+        break;
       }
-      else if (arg_size == sizeof(int64_t)) {
-        i_val = va_arg(argptr, int64_t);
+      if (psz[1] == '1' && psz[2] == '6')
+        small_float = SMALL_FLOAT_HALF;
+      psz = _vformat_parse_bit_width(psz, &arg_type);
+      if (psz == NULL) {
+        errno = EINVAL;
+        return -1;
       }
-      else  if (arg_size == sizeof(short)) {
-        i_val = (short)va_arg(argptr, int);
+      break;
+    case 'D':
+      //%Df and %DDf, BID decimal64 and decimal128
+      psz++;
+      decimal_bits = 64;
+      if (*psz == 'D') {
+        psz++;
+        decimal_bits = 128;
+      }
+      break;
+    default:
+      break;
+    }
+#if !defined(__SIZEOF_INT128__)
+    if (arg_type == ARG_INT128) {
+      errno = ENOSYS;
+      return -1;
+    }
+#endif
+    if (double_arg && *psz != 'k' && *psz != 'K') {
+      errno = EINVAL;
+      return -1;
+    }
+    if (formatter->utf8_mode && *psz != 's') {
+      //%U and %UU only change how a string is counted
+      errno = EINVAL;
+      return -1;
+    }
+
+    if (_vformat_begin_piece(formatter, start)) {
+      //emitted by an earlier call, only consume the argument
+      if (decimal_bits == 64) {
+        va_arg(argptr, OslDecimal64);
       }
-      else if (arg_size == sizeof(char)) {
-        i_val = (char)va_arg(argptr, int);
+      else if (decimal_bits == 128) {
+        va_arg(argptr, OslDecimal128);
       }
       else {
-        return -1;
+        switch (*psz) {
+        case 'c':
+          va_arg(argptr, int);
+          break;
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'b': case 'B':
+#if defined(__SIZEOF_INT128__)
+          if (arg_type == ARG_INT128)
+            va_arg(argptr, osl_int128_t);
+          else
+#endif
+          if (arg_type == ARG_INT64)
+            va_arg(argptr, int64_t);
+          else
+            va_arg(argptr, int);
+          break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+          if (small_float)
+            va_arg(argptr, int);
+          else
+            va_arg(argptr, double);
+          break;
+        case 'Q':
+          va_arg(argptr, int64_t);
+          va_arg(argptr, int);
+          break;
+        case 'T':
+          va_arg(argptr, int64_t);
+          break;
+        case '!':
+          if (psz[1] == 0) {
+            errno = ENOSYS;
+            return -1;
+          }
+          va_arg(argptr, void*);
+          psz++;
+          break;
+        case 'k': case 'K':
+          if (double_arg)
+            va_arg(argptr, double);
+          else if (arg_type == ARG_INT64)
+            va_arg(argptr, int64_t);
+          else
+            va_arg(argptr, int);
+          break;
+        case 'p':
+          va_arg(argptr, void*);
+          psz += _vformat_pointer_extension(psz);
+          break;
+        case 'n': case 's': case 'S':
+          va_arg(argptr, void*);
+          break;
+        default:
+          errno = ENOSYS;
+          return -1;
+        }
       }
+      formatter->arg_index++;
+      psz++;
+      start = psz;
+      continue;
+    }
+    formatter->arg_index++;
 
-      if (!_vformat_int64(formatter, i_val, 10))
-        return -1;
-      break;
-    case 'u':
-      //If a precision is given with a numeric conversion(d, i, o,
-      //  u, x, and X), the 0 flag is ignored.
-      if (formatter->precision >= 0)
-        formatter->padding_zero = FALSE;
-      formatter->with_sign = FALSE;
-      formatter->prefix_blank = FALSE;
-      if (arg_size == sizeof(int)) {
-        u_val = va_arg(argptr, unsigned int);
-      }
-      else if (arg_size == sizeof(uint64_t)) {
-        u_val = va_arg(argptr, uint64_t);
+    int64_t i_val;
+    uint64_t u_val;
+    unsigned int base;
+    char char_val;
+    if (decimal_bits != 0) {
+      char specifier = *psz;
+      ibool ok;
+      if (specifier == 'F' || specifier == 'E' || specifier == 'G') {
+        formatter->specifieris_upper = TRUE;
+        specifier += 'a' - 'A';
       }
-      else  if (arg_size == sizeof(short)) {
-        u_val = (unsigned short)va_arg(argptr, int);
+      if (specifier != 'f' && specifier != 'e' && specifier != 'g') {
+        errno = ENOSYS;
+        return -1;
       }
-      else if (arg_size == sizeof(char)) {
-        u_val = (unsigned char)va_arg(argptr, int);
+      if (dot_without_precision)
+        formatter->precision = 0;
+      if (decimal_bits == 64) {
+        OslDecimal64 value = va_arg(argptr, OslDecimal64);
+        ok = _vformat_decimal64(formatter, value.bits, specifier);
       }
       else {
+        OslDecimal128 value = va_arg(argptr, OslDecimal128);
+        ok = _vformat_decimal128(formatter, value.high, value.low, specifier);
+      }
+      if (!ok)
         return -1;
+      goto next_conversion;
+    }
+    if (small_float != 0 && *psz && strchr("fFeEgGaA", *psz)) {
+      char specifier = *psz;
+      if ('A' <= specifier && specifier <= 'Z') {
+        formatter->specifieris_upper = TRUE;
+        specifier += 'a' - 'A';
       }
-
-      if (!_vformat_uint64(formatter, u_val, 10, FALSE))
+      if (dot_without_precision)
+        formatter->precision = 0;
+      if (!_vformat_small_float(formatter, (uint16_t)va_arg(argptr, int), small_float, specifier))
+        return -1;
+      goto next_conversion;
+    }
+    if (small_float == SMALL_FLOAT_BF16) {
+      errno = ENOSYS;
+      return -1;
+    }
+    switch (*psz) {
+    case 'c':
+      char_val = va_arg(argptr, int);
+      if (!_vformat_append(formatter, &char_val, 1))
         return -1;
       break;
-    case 'o':
+    case 'd':
+    case 'i':
       //If a precision is given with a numeric conversion(d, i, o,
       //  u, x, and X), the 0 flag is ignored.
       if (formatter->precision >= 0)
         formatter->padding_zero = FALSE;
-      formatter->with_sign = FALSE;
-
-      if (arg_size == sizeof(int)) {
-        u_val = va_arg(argptr, unsigned int);
-      }
-      else if (arg_size == sizeof(uint64_t)) {
-        u_val = va_arg(argptr, uint64_t);
-      }
-      else  if (arg_size == sizeof(short)) {
-        u_val = (unsigned short)va_arg(argptr, int);
-      }
-      else if (arg_size == sizeof(char)) {
-        u_val = (unsigned char)va_arg(argptr, int);
-      }
-      else {
+      switch (arg_type) {
+      case ARG_INT:
+        i_val = va_arg(argptr, int);
+        break;
+      case ARG_INT64:
+        i_val = va_arg(argptr, int64_t);
+        break;
+      case ARG_SHORT:
+        i_val = (short)va_arg(argptr, int);
+        break;
+      case ARG_CHAR:
+        i_val = (signed char)va_arg(argptr, int);
+        break;
+#if defined(__SIZEOF_INT128__)
+      case ARG_INT128:
+        if (!_vformat_int128(formatter, va_arg(argptr, osl_int128_t), 10))
+          return -1;
+        goto next_conversion;
+#endif
+      default:
         return -1;
       }
 
-      if (!_vformat_uint64(formatter, u_val, 8, FALSE))
+      if (!_vformat_int64(formatter, i_val, 10))
         return -1;
       break;
+    case 'B':
     case 'X':
       formatter->specifieris_upper = TRUE;
+    case 'b':
+    case 'u':
+    case 'o':
     case 'x':
       //If a precision is given with a numeric conversion(d, i, o,
       //  u, x, and X), the 0 flag is ignored.
       if (formatter->precision >= 0)
         formatter->padding_zero = FALSE;
       formatter->with_sign = FALSE;
+      formatter->prefix_blank = FALSE;
+      switch (*psz) {
+      case 'u':
+        base = 10;
+        break;
+      case 'o':
+        base = 8;
+        break;
+      case 'b': case 'B':
+        base = 2;
+        break;
+      default:
+        base = 16;
+        break;
+      }
 
-      if (arg_size == sizeof(int)) {
+      switch (arg_type) {
+      case ARG_INT:
         u_val = va_arg(argptr, unsigned int);
-      }
-      else if (arg_size == sizeof(uint64_t)) {
+        break;
+      case ARG_INT64:
         u_val = va_arg(argptr, uint64_t);
-      }
-      else  if (arg_size == sizeof(short)) {
+        break;
+      case ARG_SHORT:
         u_val = (unsigned short)va_arg(argptr, int);
-      }
-      else if (arg_size == sizeof(char)) {
+        break;
+      case ARG_CHAR:
         u_val = (unsigned char)va_arg(argptr, int);
-      }
-      else {
+        break;
+#if defined(__SIZEOF_INT128__)
+      case ARG_INT128:
+        if (!_vformat_uint128(formatter, va_arg(argptr, osl_uint128_t), base, FALSE))
+          return -1;
+        goto next_conversion;
+#endif
+      default:
         return -1;
       }
 
-      if (!_vformat_uint64(formatter, u_val, 16, FALSE))
+      if (!_vformat_uint64(formatter, u_val, base, FALSE))
         return -1;
       break;
     case 'p':
+      if (_vformat_pointer_extension(psz)) {
+        if (!_vformat_pointer(formatter, &psz, va_arg(argptr, const void*)))
+          return -1;
+        break;
+      }
       //Pointer address
 #ifdef _OS_WINDOWS
       formatter->specifieris_upper = TRUE;
 #else // !_OS_WINDOWS
-      formatter->extra_flag = TRUE;
+      formatter->alternate_form = TRUE;
       formatter->specifieris_upper = FALSE;
 #endif // _OS_WINDOWS
       formatter->with_sign = FALSE;
@@ -1227,14 +3309,415 @@ static intptr_t _vformat_impl(OslFormatter* formatter, const char* szformat, va_
       if (!_vformat_string(formatter, va_arg(argptr, const char*)))
         return -1;
       break;
+    case 'Q':
+      //int64_t value, int scale
+      if (dot_without_precision)
+        formatter->precision = 0;
+      i_val = va_arg(argptr, int64_t);
+      if (!_vformat_scaled(formatter, i_val, va_arg(argptr, int)))
+        return -1;
+      break;
+    case 'K':
+    case 'k':
+      //SI prefixes with k and IEC prefixes with K, of an integer or with R of a double
+      if (dot_without_precision)
+        formatter->precision = 0;
+      if (double_arg) {
+        if (!_vformat_prefixed_double(formatter, va_arg(argptr, double), *psz == 'K'))
+          return -1;
+        break;
+      }
+      switch (arg_type) {
+      case ARG_INT:
+        i_val = va_arg(argptr, int);
+        break;
+      case ARG_INT64:
+        i_val = va_arg(argptr, int64_t);
+        break;
+      case ARG_SHORT:
+        i_val = (short)va_arg(argptr, int);
+        break;
+      case ARG_CHAR:
+        i_val = (signed char)va_arg(argptr, int);
+        break;
+      default:
+        errno = ENOSYS;
+        return -1;
+      }
+      if (!_vformat_prefixed_int64(formatter, i_val, *psz == 'K'))
+        return -1;
+      break;
+    case 'T':
+      //int64_t epoch in units of the precision
+      if (dot_without_precision)
+        formatter->precision = 0;
+      if (!_vformat_timestamp(formatter, va_arg(argptr, int64_t)))
+        return -1;
+      break;
+    case '!':
+      //%!c, a handler registered with osl_format_register
+      psz++;
+      if (*psz == 0) {
+        errno = ENOSYS;
+        return -1;
+      }
+      if (!_vformat_custom(formatter, *psz, va_arg(argptr, const void*)))
+        return -1;
+      break;
 
     default:
       errno=ENOSYS;
       return -1;
     }
+  next_conversion:
     psz++;
     start = psz;
   }
   return formatter->count;
 }
- 
\ No newline at end of file
+ 
+
+#define OP_FLAG_LEFT_ALIGN 0x01
+#define OP_FLAG_WITH_SIGN 0x02
+#define OP_FLAG_PADDING_ZERO 0x04
+#define OP_FLAG_PREFIX_BLANK 0x08
+#define OP_FLAG_ALTERNATE_FORM 0x10
+#define OP_FLAG_UPPER 0x20
+
+static ibool _vformat_compile_add(OslCompiledFormat* compiled, const char* literal, intptr_t len) {
+  if (len <= 0)
+    return TRUE;
+  if (compiled->op_count >= OSL_COMPILED_MAX_OPS)
+    return FALSE;
+  OslFormatOp* op = compiled->ops + compiled->op_count;
+  op->literal = literal;
+  op->len = len;
+  op->specifier = 0;
+  compiled->op_count++;
+  return TRUE;
+}
+
+/// <summary>
+/// Parses format once into a list of literal runs and conversions for osl_format_columns.
+/// Conversions take their values from consecutive columns,
+/// the per-conversion flag rules of C are resolved here instead of once per row.
+/// '*' width or precision, %n and %p are not supported; length modifiers are ignored.
+/// </summary>
+/// <param name="format">must outlive compiled, literal runs point into it</param>
+/// <returns>the number of columns, or -1 if the format can not be compiled</returns>
+intptr_t osl_format_compile(OslCompiledFormat* compiled, const char* format) {
+  OslFormatter formatter;
+  const char* psz = format;
+  const char* start = psz;
+  compiled->op_count = 0;
+  compiled->column_count = 0;
+  for (;;) {
+    while (*psz && *psz != '%') {
+      psz++;
+    }
+    if (*psz == 0) {
+      if (!_vformat_compile_add(compiled, start, psz - start))
+        break;
+      return compiled->column_count;
+    }
+    psz++;
+    if (*psz == '%') {
+      if (!_vformat_compile_add(compiled, start, psz - start))
+        break;
+      psz++;
+      start = psz;
+      continue;
+    }
+    if (!_vformat_compile_add(compiled, start, psz - start - 1))
+      break;
+
+    psz = _vformat_parse_flags(&formatter, psz);
+    formatter.width = -1;
+    formatter.precision = -1;
+    formatter.specifieris_upper = FALSE;
+    if (('0' <= *psz) && (*psz <= '9')) {
+      formatter.width = 0;
+      while (('0' <= *psz) && (*psz <= '9')) {
+        formatter.width = formatter.width * 10 + (*psz - '0');
+        psz++;
+      }
+    }
+    ibool dot_without_precision = FALSE;
+    if (*psz == '.') {
+      psz++;
+      if (('0' <= *psz) && (*psz <= '9')) {
+        formatter.precision = 0;
+        while (('0' <= *psz) && (*psz <= '9')) {
+          formatter.precision = formatter.precision * 10 + (*psz - '0');
+          psz++;
+        }
+      }
+      else if (*psz != '*') {
+        dot_without_precision = TRUE;
+      }
+    }
+    while (*psz == 'h' || *psz == 'l' || *psz == 'j' || *psz == 'z' || *psz == 't' || *psz == 'L') {
+      psz++;
+    }
+    if (*psz == 'w') {
+      int arg_type;
+      psz = _vformat_parse_bit_width(psz, &arg_type);
+      if (psz == NULL) {
+        errno = EINVAL;
+        return -1;
+      }
+    }
+
+    char specifier = *psz;
+    switch (specifier) {
+    case 'X':
+    case 'B':
+    case 'F':
+    case 'E':
+    case 'G':
+    case 'A':
+      formatter.specifieris_upper = TRUE;
+      specifier = specifier - 'A' + 'a';
+      break;
+    case 'S':
+      specifier = 's';
+      break;
+    default:
+      break;
+    }
+    switch (specifier) {
+    case 'd':
+    case 'i':
+      specifier = 'd';
+      if (formatter.precision >= 0)
+        formatter.padding_zero = FALSE;
+      break;
+    case 'u':
+      if (formatter.precision >= 0)
+        formatter.padding_zero = FALSE;
+      formatter.with_sign = FALSE;
+      formatter.prefix_blank = FALSE;
+      break;
+    case 'o':
+    case 'x':
+    case 'b':
+      if (formatter.precision >= 0)
+        formatter.padding_zero = FALSE;
+      formatter.with_sign = FALSE;
+      break;
+    case 'f':
+    case 'e':
+    case 'g':
+    case 'a':
+      if (dot_without_precision)
+        formatter.precision = 0;
+      break;
+    case 's':
+    case 'c':
+      break;
+    default:
+      errno = ENOSYS;
+      return -1;
+    }
+    if (compiled->op_count >= OSL_COMPILED_MAX_OPS)
+      break;
+    OslFormatOp* op = compiled->ops + compiled->op_count;
+    op->literal = NULL;
+    op->len = 0;
+    op->specifier = specifier;
+    op->flags = (formatter.left_align ? OP_FLAG_LEFT_ALIGN : 0)
+      | (formatter.with_sign ? OP_FLAG_WITH_SIGN : 0)
+      | (formatter.padding_zero ? OP_FLAG_PADDING_ZERO : 0)
+      | (formatter.prefix_blank ? OP_FLAG_PREFIX_BLANK : 0)
+      | (formatter.alternate_form ? OP_FLAG_ALTERNATE_FORM : 0)
+      | (formatter.specifieris_upper ? OP_FLAG_UPPER : 0);
+    op->width = formatter.width;
+    op->precision = formatter.precision;
+    op->column = compiled->column_count;
+    compiled->op_count++;
+    compiled->column_count++;
+    psz++;
+    start = psz;
+  }
+  errno = ENOMEM;
+  return -1;
+}
+
+static ibool _vformat_column_matches(const OslFormatOp* op, const OslFormatColumn* column) {
+  switch (op->specifier) {
+  case 'd': case 'u': case 'o': case 'x': case 'b': case 'c':
+    return column->type == OSL_COLUMN_INT64 || column->type == OSL_COLUMN_UINT64 || column->type == OSL_COLUMN_INT32;
+  case 'f': case 'e': case 'g': case 'a':
+    return column->type == OSL_COLUMN_DOUBLE || column->type == OSL_COLUMN_FLOAT16 || column->type == OSL_COLUMN_BFLOAT16;
+  case 's':
+    return column->type == OSL_COLUMN_STRING;
+  default:
+    return FALSE;
+  }
+}
+
+//the integer at row as unsigned, an int32_t is taken as uint32_t like %u takes an int
+static uint64_t _vformat_column_bits(const OslFormatColumn* column, intptr_t row) {
+  if (column->type == OSL_COLUMN_INT32)
+    return (uint32_t)((const int32_t*)column->data)[row];
+  return ((const uint64_t*)column->data)[row];
+}
+
+static void _vformat_op_flags(OslFormatter* formatter, const OslFormatOp* op) {
+  formatter->left_align = (op->flags & OP_FLAG_LEFT_ALIGN) != 0;
+  formatter->with_sign = (op->flags & OP_FLAG_WITH_SIGN) != 0;
+  formatter->padding_zero = (op->flags & OP_FLAG_PADDING_ZERO) != 0;
+  formatter->prefix_blank = (op->flags & OP_FLAG_PREFIX_BLANK) != 0;
+  formatter->alternate_form = (op->flags & OP_FLAG_ALTERNATE_FORM) != 0;
+  formatter->specifieris_upper = (op->flags & OP_FLAG_UPPER) != 0;
+  formatter->width = op->width;
+  formatter->precision = op->precision;
+}
+
+static ibool _vformat_column(OslFormatter* formatter, const OslFormatOp* op, const OslFormatColumn* column, intptr_t row) {
+  _vformat_op_flags(formatter, op);
+
+  switch (op->specifier) {
+  case 'd':
+    if (column->type == OSL_COLUMN_UINT64)
+      return _vformat_uint64(formatter, ((const uint64_t*)column->data)[row], 10, FALSE);
+    if (column->type == OSL_COLUMN_INT32)
+      return _vformat_int64(formatter, ((const int32_t*)column->data)[row], 10);
+    return _vformat_int64(formatter, ((const int64_t*)column->data)[row], 10);
+  case 'u':
+    return _vformat_uint64(formatter, _vformat_column_bits(column, row), 10, FALSE);
+  case 'o':
+    return _vformat_uint64(formatter, _vformat_column_bits(column, row), 8, FALSE);
+  case 'x':
+    return _vformat_uint64(formatter, _vformat_column_bits(column, row), 16, FALSE);
+  case 'b':
+    return _vformat_uint64(formatter, _vformat_column_bits(column, row), 2, FALSE);
+  case 'c':
+    do {
+      char char_val = (char)_vformat_column_bits(column, row);
+      return _vformat_append(formatter, &char_val, 1);
+    } while (0);
+  case 'f': case 'e': case 'g': case 'a':
+    if (column->type == OSL_COLUMN_FLOAT16)
+      return _vformat_small_float(formatter, ((const uint16_t*)column->data)[row], SMALL_FLOAT_HALF, op->specifier);
+    if (column->type == OSL_COLUMN_BFLOAT16)
+      return _vformat_small_float(formatter, ((const uint16_t*)column->data)[row], SMALL_FLOAT_BF16, op->specifier);
+    return _vformat_ieee754d64(formatter, ((const double*)column->data)[row], op->specifier);
+  case 's':
+    do {
+      const OslStringView* view = ((const OslStringView*)column->data) + row;
+      intptr_t len = view->length;
+      if (formatter->precision >= 0 && len > formatter->precision)
+        len = formatter->precision;
+      return _vformat_append_string(formatter, view->data, len);
+    } while (0);
+  default:
+    return FALSE;
+  }
+}
+
+#define FIXED_BLOCK_ROWS 16
+#define FIXED_BLOCK_OPS 8
+
+//a block of rows of a %.Nf double column, converted together by ieee754d64fixed
+typedef struct OslFixedBlock OslFixedBlock;
+struct OslFixedBlock {
+  const double* values;
+  int precision;
+  uint64_t scaled[FIXED_BLOCK_ROWS];
+  unsigned char ok[FIXED_BLOCK_ROWS];
+};
+
+static intptr_t _vformat_columns(OslFormatWriteFunc writefunc, void* userData, const OslCompiledFormat* compiled,
+  const OslFormatColumn* columns, intptr_t row_count, const char* separator) {
+  OslFormatter formatter;
+  intptr_t separator_len = 0;
+  OslFixedBlock fixed[FIXED_BLOCK_OPS];
+  signed char fixed_slot[OSL_COMPILED_MAX_OPS];
+  int fixed_count = 0;
+  formatter.count = 0;
+  formatter.writefunc = writefunc;
+  formatter.userData = userData;
+  if (writefunc == NULL)
+    formatter.writefunc = _vformat_null_write;
+  formatter.resume = NULL;
+  formatter.replay_offset = 0;
+  formatter.skip = 0;
+  formatter.limit = -1;
+  formatter.string_mode = 0;
+  if (separator)
+    separator_len = strlen(separator);
+
+  for (int i = 0; i < compiled->op_count; i++) {
+    const OslFormatOp* op = compiled->ops + i;
+    if (op->literal == NULL && !_vformat_column_matches(op, columns + op->column)) {
+      errno = EINVAL;
+      return -1;
+    }
+    fixed_slot[i] = -1;
+    if (op->specifier == 'f' && columns[op->column].type == OSL_COLUMN_DOUBLE && fixed_count < FIXED_BLOCK_OPS) {
+      OslFixedBlock* block = fixed + fixed_count;
+      block->values = (const double*)columns[op->column].data;
+      block->precision = op->precision >= 0 ? op->precision : 6;
+      if (ieee754d64fixed(block->values, 0, block->precision, NULL, NULL) == 0)
+        fixed_slot[i] = (signed char)fixed_count++;
+    }
+  }
+
+  for (intptr_t first = 0; first < row_count; first += FIXED_BLOCK_ROWS) {
+    intptr_t last = row_count - first < FIXED_BLOCK_ROWS ? row_count : first + FIXED_BLOCK_ROWS;
+    for (int i = 0; i < fixed_count; i++)
+      ieee754d64fixed(fixed[i].values + first, last - first, fixed[i].precision, fixed[i].scaled, fixed[i].ok);
+    for (intptr_t row = first; row < last; row++) {
+      if (row > 0 && separator_len > 0 && !_vformat_append(&formatter, separator, separator_len))
+        return -1;
+      for (int i = 0; i < compiled->op_count; i++) {
+        const OslFormatOp* op = compiled->ops + i;
+        if (op->literal) {
+          if (!_vformat_append(&formatter, op->literal, op->len))
+            return -1;
+        }
+        else if (fixed_slot[i] >= 0 && fixed[fixed_slot[i]].ok[row - first]) {
+          const OslFixedBlock* block = fixed + fixed_slot[i];
+          _vformat_op_flags(&formatter, op);
+          if (!_vformat_fixed(&formatter, block->values[row] < 0, block->scaled[row - first], block->precision, 0))
+            return -1;
+        }
+        else if (!_vformat_column(&formatter, op, columns + op->column, row)) {
+          return -1;
+        }
+      }
+    }
+  }
+  return formatter.count;
+}
+
+/// <summary>
+/// Formats row_count rows of struct-of-arrays data with a compiled row format in one pass.
+/// The i-th conversion of the format takes its value from columns[i]:
+/// d i u o x X b B c need OSL_COLUMN_INT64, OSL_COLUMN_UINT64 or OSL_COLUMN_INT32,
+/// f e g a need OSL_COLUMN_DOUBLE, OSL_COLUMN_FLOAT16 or OSL_COLUMN_BFLOAT16 and s needs OSL_COLUMN_STRING.
+/// </summary>
+/// <returns>the number of characters written, or a negative value on error</returns>
+intptr_t osl_format_columns(OslFormatWriteFunc writefunc, void* userData, const OslCompiledFormat* compiled,
+  const OslFormatColumn* columns, intptr_t row_count) {
+  return _vformat_columns(writefunc, userData, compiled, columns, row_count, NULL);
+}
+
+/// <summary>
+/// Formats count elements of values with element_format, separated by separator.
+/// element_format has one conversion, e.g. "%d" or "%08x", whose width and precision apply per element;
+/// values is OSL_COLUMN_INT32, OSL_COLUMN_INT64, OSL_COLUMN_UINT64 or any type the conversion accepts.
+/// </summary>
+/// <returns>the number of characters written, or a negative value on error</returns>
+intptr_t osl_format_join(OslFormatWriteFunc writefunc, void* userData, const char* element_format,
+  const OslFormatColumn* values, intptr_t count, const char* separator) {
+  OslCompiledFormat compiled;
+  if (osl_format_compile(&compiled, element_format) < 0)
+    return -1;
+  if (compiled.column_count != 1) {
+    errno = EINVAL;
+    return -1;
+  }
+  return _vformat_columns(writefunc, userData, &compiled, values, count, separator);
+}
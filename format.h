@@ -1,8 +1,184 @@
- 
- 
+#ifndef OSL_FORMAT_H
+#define OSL_FORMAT_H
+
 #include <stdarg.h>
 #include <stdint.h>
+#include <wchar.h>
+#include <uchar.h>
 
 typedef intptr_t(*OslFormatWriteFunc)(void* userData, const char* sz, intptr_t len);
 intptr_t osl_vformat(OslFormatWriteFunc writefunc, void* userData, const char* format, va_list argptr);
 
+//returned by osl_vformat_resume when the sink accepted only part of the output
+#define OSL_FORMAT_WOULD_BLOCK (-2)
+
+typedef struct OslFormatResume OslFormatResume;
+struct OslFormatResume {
+  intptr_t format_offset; //offset in format of the literal run or conversion being emitted
+  intptr_t field_emitted; //bytes of that piece already accepted by the sink
+  int arg_index;          //arguments consumed before that piece
+  intptr_t count;         //bytes accepted by the sink so far
+};
+
+void osl_format_resume_init(OslFormatResume* resume);
+intptr_t osl_vformat_resume(OslFormatResume* resume, OslFormatWriteFunc writefunc, void* userData, const char* format, va_list argptr);
+
+intptr_t osl_vformat_limit(OslFormatWriteFunc writefunc, void* userData, intptr_t max_bytes, const char* marker, const char* format, va_list argptr);
+
+#define OSL_COUNTER_DIGITS 20
+
+//a decimal counter that keeps its ASCII form, printed with %pN
+typedef struct OslFormatCounter OslFormatCounter;
+struct OslFormatCounter {
+  uint64_t value;
+  int length;
+  char digits[OSL_COUNTER_DIGITS]; //right aligned, unused digits are '0'
+};
+
+void osl_format_counter_init(OslFormatCounter* counter, uint64_t value);
+void osl_format_counter_inc(OslFormatCounter* counter);
+
+#define OSL_TEMPLATE_MAX_SLOTS 32
+#define OSL_TEMPLATE_SPEC_LENGTH 24
+
+//a conversion of a template, rendered in place at offset
+typedef struct OslFormatSlot OslFormatSlot;
+struct OslFormatSlot {
+  intptr_t offset;
+  int width;
+  char spec[OSL_TEMPLATE_SPEC_LENGTH];
+};
+
+//a fixed-layout line whose literals are rendered once, see osl_format_template_init
+typedef struct OslFormatTemplate OslFormatTemplate;
+struct OslFormatTemplate {
+  char* buffer;
+  intptr_t length;
+  int slot_count;
+  OslFormatSlot slots[OSL_TEMPLATE_MAX_SLOTS];
+};
+
+intptr_t osl_format_template_init(OslFormatTemplate* tpl, char* buffer, intptr_t size, const char* format);
+intptr_t osl_format_template_set(OslFormatTemplate* tpl, int slot, ...);
+intptr_t osl_format_template_vset(OslFormatTemplate* tpl, int slot, va_list argptr);
+
+//length characters at data, no terminating null needed, printed with %pV
+typedef struct OslStringView OslStringView;
+struct OslStringView {
+  const char* data;
+  intptr_t length;
+};
+
+#define OSL_COLUMN_INT64 1
+#define OSL_COLUMN_UINT64 2
+#define OSL_COLUMN_DOUBLE 3
+#define OSL_COLUMN_STRING 4  //OslStringView
+#define OSL_COLUMN_INT32 5
+#define OSL_COLUMN_FLOAT16 6  //uint16_t bits of an IEEE 754 binary16
+#define OSL_COLUMN_BFLOAT16 7 //uint16_t bits of a bfloat16
+
+//one column of struct-of-arrays data, data points to row_count values of the type
+typedef struct OslFormatColumn OslFormatColumn;
+struct OslFormatColumn {
+  int type;
+  const void* data;
+};
+
+#define OSL_COMPILED_MAX_OPS 64
+
+//a literal run or a conversion of a compiled format
+typedef struct OslFormatOp OslFormatOp;
+struct OslFormatOp {
+  const char* literal;  //NULL for a conversion
+  intptr_t len;
+  char specifier;
+  unsigned char flags;
+  int width;
+  int precision;
+  int column;
+};
+
+//a format parsed once, see osl_format_compile
+typedef struct OslCompiledFormat OslCompiledFormat;
+struct OslCompiledFormat {
+  int op_count;
+  int column_count;
+  OslFormatOp ops[OSL_COMPILED_MAX_OPS];
+};
+
+intptr_t osl_format_compile(OslCompiledFormat* compiled, const char* format);
+intptr_t osl_format_columns(OslFormatWriteFunc writefunc, void* userData, const OslCompiledFormat* compiled,
+  const OslFormatColumn* columns, intptr_t row_count);
+intptr_t osl_format_columns_parallel(OslFormatWriteFunc writefunc, void* userData, const OslCompiledFormat* compiled,
+  const OslFormatColumn* columns, intptr_t row_count, int thread_count);
+void osl_format_parallel_set_cpu_count(int cpu_count);
+intptr_t osl_format_join(OslFormatWriteFunc writefunc, void* userData, const char* element_format,
+  const OslFormatColumn* values, intptr_t count, const char* separator);
+
+#if defined(__SIZEOF_INT128__)
+//128 bit integers, printed with %w128d, %w128u, %w128x and %w128o
+typedef __int128 osl_int128_t;
+typedef unsigned __int128 osl_uint128_t;
+
+int osl_u128tos(osl_uint128_t value, char* buf);
+int osl_i128tos(osl_int128_t value, char* buf);
+#endif // __SIZEOF_INT128__
+
+//UTF-16, UTF-32 and wchar_t output: the UTF-8 text of the narrow core is converted as it is written,
+//the _wide variants take a format string of the same code unit. Widths and precisions of %s count
+//output code units, %Us characters and %UUs columns. A NULL writefunc returns the length in code units
+typedef intptr_t(*OslFormatWriteFunc16)(void* userData, const char16_t* sz, intptr_t len);
+typedef intptr_t(*OslFormatWriteFunc32)(void* userData, const char32_t* sz, intptr_t len);
+typedef intptr_t(*OslFormatWriteFuncW)(void* userData, const wchar_t* sz, intptr_t len);
+
+intptr_t osl_vformat_units(OslFormatWriteFunc writefunc, void* userData, int unit_bits, const char* format, va_list argptr);
+intptr_t osl_vformat16(OslFormatWriteFunc16 writefunc, void* userData, const char* format, va_list argptr);
+intptr_t osl_vformat16_wide(OslFormatWriteFunc16 writefunc, void* userData, const char16_t* format, va_list argptr);
+intptr_t osl_vformat32(OslFormatWriteFunc32 writefunc, void* userData, const char* format, va_list argptr);
+intptr_t osl_vformat32_wide(OslFormatWriteFunc32 writefunc, void* userData, const char32_t* format, va_list argptr);
+intptr_t osl_vformatw(OslFormatWriteFuncW writefunc, void* userData, const char* format, va_list argptr);
+intptr_t osl_vformatw_wide(OslFormatWriteFuncW writefunc, void* userData, const wchar_t* format, va_list argptr);
+
+//IEEE 754 decimal64 and decimal128 in the binary integer decimal (BID) encoding,
+//passed by value to %Df, %De, %Dg and %DDf, %DDe, %DDg
+typedef struct OslDecimal64 OslDecimal64;
+struct OslDecimal64 {
+  uint64_t bits;
+};
+
+typedef struct OslDecimal128 OslDecimal128;
+struct OslDecimal128 {
+  uint64_t low;
+  uint64_t high;
+};
+
+//flags of a %!c conversion
+#define OSL_FORMAT_FLAG_LEFT_ALIGN 0x01     //'-'
+#define OSL_FORMAT_FLAG_WITH_SIGN 0x02      //'+'
+#define OSL_FORMAT_FLAG_PADDING_ZERO 0x04   //'0'
+#define OSL_FORMAT_FLAG_PREFIX_BLANK 0x08   //' '
+#define OSL_FORMAT_FLAG_ALTERNATE_FORM 0x10 //'#'
+
+//the parsed flags, width and precision of a %!c conversion
+typedef struct OslFormatSpec OslFormatSpec;
+struct OslFormatSpec {
+  int width;     //-1 if not given
+  int precision; //-1 if not given
+  unsigned char flags;
+  char conversion;
+};
+
+//the output of the conversion being formatted, written with osl_format_sink_write
+typedef struct OslFormatSink OslFormatSink;
+
+//a %!c handler, value is the pointer argument of the conversion; returns a negative value on error
+typedef int(*OslFormatHandler)(OslFormatSink* sink, const OslFormatSpec* spec, const void* value, void* context);
+
+int osl_format_register(char conversion, OslFormatHandler handler, void* context);
+int osl_format_sink_write(OslFormatSink* sink, const char* sz, intptr_t len);
+int osl_format_sink_fill(OslFormatSink* sink, char ch, intptr_t count);
+
+//counters of the calling thread's cache of converted doubles
+void ieee754d64tos_cache_stats(uint64_t* hits, uint64_t* misses);
+
+#endif // OSL_FORMAT_H
@@ -0,0 +1,705 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "format.h"
+#include "formatTestGenerated.h"
+
+extern int osl_snprintf(char* buffer, intptr_t count, const char* format, ...);
+
+static double _osl_bench_seconds(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void osl_format_bench_counter() {
+    const int count = 10000000;
+    char buffer[64];
+    uint64_t sum = 0;
+    OslFormatCounter counter;
+    clock_t start;
+
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        sum += osl_snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)(UINT64_C(1000000000) + i));
+    }
+    printf("%-28s %8.2f ns/op\n", "%llu", _osl_bench_seconds(start) * 1e9 / count);
+
+    osl_format_counter_init(&counter, UINT64_C(1000000000));
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        sum += osl_snprintf(buffer, sizeof(buffer), "%pN", &counter);
+        osl_format_counter_inc(&counter);
+    }
+    printf("%-28s %8.2f ns/op\n", "%pN", _osl_bench_seconds(start) * 1e9 / count);
+
+    //conversion alone, without the format call
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        uint64_t value = UINT64_C(1000000000) + i;
+        char* pos = buffer + 20;
+        do {
+            pos--;
+            *pos = '0' + value % 10;
+            value /= 10;
+        } while (value != 0);
+        sum += buffer[19] + pos[0];
+    }
+    printf("%-28s %8.2f ns/op\n", "divide loop", _osl_bench_seconds(start) * 1e9 / count);
+
+    osl_format_counter_init(&counter, UINT64_C(1000000000));
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        osl_format_counter_inc(&counter);
+        memcpy(buffer, counter.digits, OSL_COUNTER_DIGITS);
+        sum += buffer[OSL_COUNTER_DIGITS - counter.length] + buffer[19];
+    }
+    printf("%-28s %8.2f ns/op\n", "osl_format_counter_inc", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static intptr_t _osl_bench_null_write(void* arg, const char* sz, intptr_t len) {
+    *(uintptr_t*)arg += (unsigned char)sz[0];
+    return len;
+}
+
+static intptr_t _osl_bench_format(uintptr_t* sum, const char* format, ...) {
+    intptr_t rv;
+    va_list argptr;
+    va_start(argptr, format);
+    rv = osl_vformat(_osl_bench_null_write, sum, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+static void osl_format_bench_hex() {
+    const int count = 1000000;
+    unsigned char hash[32];
+    char buffer[128];
+    uintptr_t sum = 0;
+    clock_t start;
+    for (int i = 0; i < (int)sizeof(hash); i++) {
+        hash[i] = (unsigned char)(i * 73 + 5);
+    }
+
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        hash[0] = (unsigned char)i;
+        for (int k = 0; k < (int)sizeof(hash); k++) {
+            osl_snprintf(buffer + k * 2, 3, "%02x", hash[k]);
+        }
+        sum += buffer[0] + buffer[63];
+    }
+    printf("%-28s %8.2f ns/hash\n", "%02x per byte", _osl_bench_seconds(start) * 1e9 / count);
+
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        hash[0] = (unsigned char)i;
+        osl_snprintf(buffer, sizeof(buffer), "%*phN", (int)sizeof(hash), hash);
+        sum += buffer[0] + buffer[63];
+    }
+    printf("%-28s %8.2f ns/hash\n", "%*phN", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+#define BENCH_ROWS 1000000
+static const char* bench_row_format = "%lld,%.3f,%s,%llu\n";
+
+typedef struct OslBenchTable OslBenchTable;
+struct OslBenchTable {
+    int64_t* ids;
+    double* prices;
+    OslStringView* names;
+    uint64_t* sizes;
+    OslFormatColumn columns[4];
+};
+
+static int _osl_bench_table_init(OslBenchTable* table) {
+    static const char* names[] = { "alpha", "beta", "gamma", "delta" };
+    table->ids = (int64_t*)malloc(sizeof(int64_t) * BENCH_ROWS);
+    table->prices = (double*)malloc(sizeof(double) * BENCH_ROWS);
+    table->names = (OslStringView*)malloc(sizeof(OslStringView) * BENCH_ROWS);
+    table->sizes = (uint64_t*)malloc(sizeof(uint64_t) * BENCH_ROWS);
+    if (!table->ids || !table->prices || !table->names || !table->sizes) {
+        return 0;
+    }
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        table->ids[i] = (int64_t)i * 7919;
+        table->prices[i] = i * 0.125 + 100.0 / (i + 1);
+        table->names[i].data = names[i % 4];
+        table->names[i].length = strlen(names[i % 4]);
+        table->sizes[i] = (uint64_t)i * 4096;
+    }
+    table->columns[0].type = OSL_COLUMN_INT64; table->columns[0].data = table->ids;
+    table->columns[1].type = OSL_COLUMN_DOUBLE; table->columns[1].data = table->prices;
+    table->columns[2].type = OSL_COLUMN_STRING; table->columns[2].data = table->names;
+    table->columns[3].type = OSL_COLUMN_UINT64; table->columns[3].data = table->sizes;
+    return 1;
+}
+
+static void _osl_bench_table_free(OslBenchTable* table) {
+    free(table->ids);
+    free(table->prices);
+    free(table->names);
+    free(table->sizes);
+}
+
+static void osl_format_bench_columns(OslBenchTable* table) {
+    OslCompiledFormat compiled;
+    uintptr_t sum = 0;
+    clock_t start;
+
+    start = clock();
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        _osl_bench_format(&sum, bench_row_format, (long long)table->ids[i], table->prices[i],
+            table->names[i].data, (unsigned long long)table->sizes[i]);
+    }
+    printf("%-28s %8.2f ns/row\n", "osl_vformat per row", _osl_bench_seconds(start) * 1e9 / BENCH_ROWS);
+
+    start = clock();
+    osl_format_compile(&compiled, bench_row_format);
+    osl_format_columns(_osl_bench_null_write, &sum, &compiled, table->columns, BENCH_ROWS);
+    printf("%-28s %8.2f ns/row\n", "osl_format_columns", _osl_bench_seconds(start) * 1e9 / BENCH_ROWS);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+//wall clock, clock() adds up the time of all threads on some platforms
+static double _osl_bench_wall_seconds() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void osl_format_bench_columns_parallel(OslBenchTable* table) {
+    OslCompiledFormat compiled;
+    uintptr_t sum = 0;
+    double single = 0;
+    osl_format_compile(&compiled, bench_row_format);
+    for (int threads = 1; threads <= 32; threads *= 2) {
+        double start = _osl_bench_wall_seconds();
+        osl_format_columns_parallel(_osl_bench_null_write, &sum, &compiled, table->columns, BENCH_ROWS, threads);
+        double seconds = _osl_bench_wall_seconds() - start;
+        if (threads == 1)
+            single = seconds;
+        printf("%2d threads %8.2f ns/row  speedup %5.2f\n", threads, seconds * 1e9 / BENCH_ROWS, single / seconds);
+    }
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_join(OslBenchTable* table) {
+    OslFormatColumn ids;
+    uintptr_t sum = 0;
+    clock_t start;
+
+    start = clock();
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        if (i > 0)
+            _osl_bench_null_write(&sum, ",", 1);
+        _osl_bench_format(&sum, "%lld", (long long)table->ids[i]);
+    }
+    printf("%-28s %8.2f ns/value\n", "osl_vformat per value", _osl_bench_seconds(start) * 1e9 / BENCH_ROWS);
+
+    ids.type = OSL_COLUMN_INT64;
+    ids.data = table->ids;
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%d", &ids, BENCH_ROWS, ",");
+    printf("%-28s %8.2f ns/value\n", "osl_format_join", _osl_bench_seconds(start) * 1e9 / BENCH_ROWS);
+
+    start = clock();
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        if (i > 0)
+            _osl_bench_null_write(&sum, ",", 1);
+        _osl_bench_format(&sum, "%.3f", table->prices[i]);
+    }
+    printf("%-28s %8.2f ns/value\n", "osl_vformat %.3f per value", _osl_bench_seconds(start) * 1e9 / BENCH_ROWS);
+
+    ids.type = OSL_COLUMN_DOUBLE;
+    ids.data = table->prices;
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%.3f", &ids, BENCH_ROWS, ",");
+    printf("%-28s %8.2f ns/value\n", "osl_format_join %.3f", _osl_bench_seconds(start) * 1e9 / BENCH_ROWS);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_escape() {
+    const int count = 1000000;
+    const char* message = "GET /api/v1/items?id=42 completed in 3.2 ms for client 10.0.0.7, "
+        "user agent \"bench\" with a reasonably long but mostly clean message body\n";
+    char escaped[512];
+    uintptr_t sum = 0;
+    clock_t start;
+
+    //escape into a temporary buffer, then %s
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        char* pos = escaped;
+        for (const char* sz = message; *sz; sz++) {
+            if (*sz == '"' || *sz == '\\') {
+                *pos++ = '\\';
+                *pos++ = *sz;
+            }
+            else if (*sz == '\n') {
+                *pos++ = '\\';
+                *pos++ = 'n';
+            }
+            else {
+                *pos++ = *sz;
+            }
+        }
+        *pos = 0;
+        _osl_bench_format(&sum, "{\"msg\":\"%s\"}", escaped);
+    }
+    printf("%-28s %8.2f ns/op\n", "escape buffer + %s", _osl_bench_seconds(start) * 1e9 / count);
+
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "{\"msg\":\"%pEj\"}", message);
+    }
+    printf("%-28s %8.2f ns/op\n", "%pEj", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_string() {
+    const int count = 1000000;
+    const intptr_t big = 4 << 20;
+    char* text = (char*)malloc(big + 1);
+    uintptr_t sum = 0;
+    clock_t start;
+    if (text == NULL)
+        return;
+    memset(text, 'a', big);
+    text[big] = 0;
+
+    start = clock();
+    for (int i = 0; i < 1000; i++) {
+        _osl_bench_format(&sum, "%.16s", text);
+    }
+    printf("%-28s %8.2f ns/op\n", "%.16s of 4 MB", _osl_bench_seconds(start) * 1e9 / 1000);
+
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%-40s|%40s", "name", "value");
+    }
+    printf("%-28s %8.2f ns/op\n", "%-40s|%40s", _osl_bench_seconds(start) * 1e9 / count);
+
+    //4 KB of mostly ASCII text with an accented letter every 64 bytes
+    for (int i = 0; i < 4096; i += 64) {
+        text[i] = (char)0xc3;
+        text[i + 1] = (char)0xa9;
+    }
+    text[4096] = 0;
+    start = clock();
+    for (int i = 0; i < count / 10; i++) {
+        _osl_bench_format(&sum, "%s", text);
+    }
+    printf("%-28s %8.2f ns/op\n", "%s of 4 KB", _osl_bench_seconds(start) * 1e9 / (count / 10));
+    start = clock();
+    for (int i = 0; i < count / 10; i++) {
+        _osl_bench_format(&sum, "%5000Us", text);
+    }
+    printf("%-28s %8.2f ns/op\n", "%5000Us of 4 KB", _osl_bench_seconds(start) * 1e9 / (count / 10));
+    printf("(%llu)\n", (unsigned long long)sum);
+    free(text);
+}
+
+static void osl_format_bench_scaled() {
+    const int count = 1000000;
+    uintptr_t sum = 0;
+    clock_t start;
+
+    //latencies in microseconds with 6 decimals, once as a double and once as int64 micros
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%.6f", (double)(INT64_C(1234567890123) + i) / 1e6);
+    }
+    printf("%-28s %8.2f ns/op\n", "%.6f", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%Q", INT64_C(1234567890123) + i, 6);
+    }
+    printf("%-28s %8.2f ns/op\n", "%Q scale 6", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%.2Q", INT64_C(1234567890123) + i, 6);
+    }
+    printf("%-28s %8.2f ns/op\n", "%.2Q scale 6", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_decimal() {
+    const int count = 1000000;
+    uintptr_t sum = 0;
+    clock_t start;
+    OslDecimal64 value64;
+    OslDecimal128 value128;
+
+    //prices with 4 decimals, 1234.5678 and up
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%.6f", (double)(12345678 + i) / 1e4);
+    }
+    printf("%-28s %8.2f ns/op\n", "%.6f", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        value64.bits = ((uint64_t)(398 - 4) << 53) | (uint64_t)(12345678 + i);
+        _osl_bench_format(&sum, "%.6Df", value64);
+    }
+    printf("%-28s %8.2f ns/op\n", "%.6Df", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        value128.high = (uint64_t)(6176 - 4) << 49;
+        value128.low = (uint64_t)(12345678 + i);
+        _osl_bench_format(&sum, "%.6DDf", value128);
+    }
+    printf("%-28s %8.2f ns/op\n", "%.6DDf", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+//the prefix picked by the caller, the way it was done before %k
+static const char* _osl_bench_si_scale(double* value) {
+    static const char* prefixes[] = { "n", "u", "m", "", "k", "M", "G" };
+    int index = 3;
+    while (*value >= 1000 && index < 6) {
+        *value /= 1000;
+        index++;
+    }
+    while (*value < 1 && *value != 0 && index > 0) {
+        *value *= 1000;
+        index--;
+    }
+    return prefixes[index];
+}
+
+typedef struct OslBenchPoint OslBenchPoint;
+struct OslBenchPoint {
+    int32_t lat_e6; //micro degrees
+    int32_t lon_e6;
+};
+
+static int _osl_bench_point_text(char* buf, const OslBenchPoint* point) {
+    char* pos = buf;
+    for (int i = 0; i < 2; i++) {
+        int32_t value = i == 0 ? point->lat_e6 : point->lon_e6;
+        uint32_t magnitude = value < 0 ? 0 - (uint32_t)value : (uint32_t)value;
+        if (i > 0)
+            *pos++ = ',';
+        if (value < 0)
+            *pos++ = '-';
+        uint32_t whole = magnitude / 1000000;
+        uint32_t fraction = magnitude % 1000000;
+        char digits[12];
+        int len = 0;
+        do {
+            digits[len++] = (char)('0' + whole % 10);
+            whole /= 10;
+        } while (whole != 0);
+        while (len > 0)
+            *pos++ = digits[--len];
+        *pos++ = '.';
+        for (int digit = 5; digit >= 0; digit--) {
+            pos[digit] = (char)('0' + fraction % 10);
+            fraction /= 10;
+        }
+        pos += 6;
+    }
+    return (int)(pos - buf);
+}
+
+//%!G, a point written straight to the sink
+static int _osl_bench_point_handler(OslFormatSink* sink, const OslFormatSpec* spec, const void* value, void* context) {
+    char buf[32];
+    (void)spec;
+    (void)context;
+    return osl_format_sink_write(sink, buf, _osl_bench_point_text(buf, (const OslBenchPoint*)value));
+}
+
+static void osl_format_bench_generated() {
+    const int count = 1000000;
+    const char* format = "%s %s[%d]: request %llu from %s status=%03d bytes=%zu in %.3fms\n";
+    uintptr_t sum = 0;
+    clock_t start;
+
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, format, "2024-05-01", "httpd", 4242, 1000000ull + i, "10.0.0.7", 200, (size_t)(i & 0xFFFF), i * 0.001);
+    }
+    printf("%-28s %8.2f ns/op\n", "log line osl_vformat", _osl_bench_seconds(start) * 1e9 / count);
+    //the same format specialized by format_gen from formatGenTest.txt
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        gen_log_line(_osl_bench_null_write, &sum, "2024-05-01", "httpd", 4242, 1000000ull + i, "10.0.0.7", 200, (size_t)(i & 0xFFFF), i * 0.001);
+    }
+    printf("%-28s %8.2f ns/op\n", "log line generated", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_custom() {
+    const int count = 1000000;
+    uintptr_t sum = 0;
+    clock_t start;
+    char text[64];
+    OslBenchPoint point = { 48858370, 2294481 };
+    osl_format_register('G', _osl_bench_point_handler, NULL);
+
+    //rendered into a temporary string and copied through %s
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        point.lon_e6 = 2294481 + i;
+        _osl_bench_point_text(text, &point);
+        _osl_bench_format(&sum, "at %s id %d", text, i);
+    }
+    printf("%-28s %8.2f ns/op\n", "point through %s", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        point.lon_e6 = 2294481 + i;
+        _osl_bench_format(&sum, "at %!G id %d", &point, i);
+    }
+    printf("%-28s %8.2f ns/op\n", "%!G", _osl_bench_seconds(start) * 1e9 / count);
+    osl_format_register('G', NULL, NULL);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_network() {
+    const int count = 1000000;
+    uintptr_t sum = 0;
+    clock_t start;
+    char text[64];
+    unsigned char addr[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    unsigned char uuid[16] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    //pre-rendered into a scratch buffer and copied through %s, the way it was done before
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        addr[14] = (unsigned char)(i >> 8);
+        addr[15] = (unsigned char)i;
+        osl_snprintf(text, sizeof(text), "%x:%x::%x", (addr[0] << 8) | addr[1], (addr[2] << 8) | addr[3],
+            (addr[14] << 8) | addr[15]);
+        _osl_bench_format(&sum, "%s %s", text, "GET");
+    }
+    printf("%-28s %8.2f ns/op\n", "ipv6 through %s", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        addr[14] = (unsigned char)(i >> 8);
+        addr[15] = (unsigned char)i;
+        _osl_bench_format(&sum, "%pI6 %s", addr, "GET");
+    }
+    printf("%-28s %8.2f ns/op\n", "%pI6", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        addr[14] = (unsigned char)(i >> 8);
+        addr[15] = (unsigned char)i;
+        _osl_bench_format(&sum, "%pI4 %s", addr + 12, "GET");
+    }
+    printf("%-28s %8.2f ns/op\n", "%pI4", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        memcpy(uuid + 12, &i, sizeof(i));
+        osl_snprintf(text, sizeof(text), "%08x-%04x-%04x-%04x-%04x%08x", 0x12345678, 0x9abc, 0xdef0, 0, 0, i);
+        _osl_bench_format(&sum, "%s %s", text, "GET");
+    }
+    printf("%-28s %8.2f ns/op\n", "uuid through %s", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        memcpy(uuid + 12, &i, sizeof(i));
+        _osl_bench_format(&sum, "%pU %s", uuid, "GET");
+    }
+    printf("%-28s %8.2f ns/op\n", "%pU", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_timestamp() {
+    const int count = 1000000;
+    uintptr_t sum = 0;
+    clock_t start;
+    char date[32];
+
+    //a log line every 100us from 2023-11-14T22:13:20Z
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        int64_t millis = INT64_C(1700000000000) + i / 10;
+        time_t seconds = (time_t)(millis / 1000);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", gmtime(&seconds));
+        _osl_bench_format(&sum, "%s.%03dZ %s", date, (int)(millis % 1000), "request done");
+    }
+    printf("%-28s %8.2f ns/op\n", "gmtime strftime %s", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%.3T %s", INT64_C(1700000000000) + i / 10, "request done");
+    }
+    printf("%-28s %8.2f ns/op\n", "%.3T", _osl_bench_seconds(start) * 1e9 / count);
+    //a new minute every call, the cache always misses
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%.3T %s", INT64_C(1700000000000) + (int64_t)i * 60000, "request done");
+    }
+    printf("%-28s %8.2f ns/op\n", "%.3T new minute", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_prefixed() {
+    const int count = 1000000;
+    uintptr_t sum = 0;
+    clock_t start;
+
+    //durations from 1.5us to 15s
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        double value = 1.5e-6 * (double)(1 + (i & 0xFFFF) * 150);
+        const char* prefix = _osl_bench_si_scale(&value);
+        _osl_bench_format(&sum, "%.3g%ss", value, prefix);
+    }
+    printf("%-28s %8.2f ns/op\n", "%.3g%ss scaled by caller", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%Rks", 1.5e-6 * (double)(1 + (i & 0xFFFF) * 150));
+    }
+    printf("%-28s %8.2f ns/op\n", "%Rks", _osl_bench_seconds(start) * 1e9 / count);
+    //sizes from 1 byte to about 4 TiB
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%llKB", (long long)(((uint64_t)i * UINT64_C(2654435761)) >> (i & 31)));
+    }
+    printf("%-28s %8.2f ns/op\n", "%llKB", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+static void osl_format_bench_small_float() {
+    const intptr_t count = 1 << 20;
+    uint16_t* half = (uint16_t*)malloc(count * sizeof(uint16_t));
+    double* values = (double*)malloc(count * sizeof(double));
+    uintptr_t sum = 0;
+    OslFormatColumn column;
+    clock_t start;
+    uint64_t seed = 88172645463325252u;
+    if (half == NULL || values == NULL) {
+        free(half);
+        free(values);
+        return;
+    }
+    //activations around 1, binary16 normal numbers with a random mantissa
+    for (intptr_t i = 0; i < count; i++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        half[i] = (uint16_t)(((seed & 1) << 15) | ((12 + (seed >> 1) % 6) << 10) | ((seed >> 8) & 0x3FF));
+        values[i] = (double)(1024 + (half[i] & 0x3FF)) / 1024;
+        for (int e = ((half[i] >> 10) & 0x1F) - 15; e < 0; e++)
+            values[i] /= 2;
+        for (int e = ((half[i] >> 10) & 0x1F) - 15; e > 0; e--)
+            values[i] *= 2;
+    }
+
+    column.type = OSL_COLUMN_DOUBLE;
+    column.data = values;
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%g", &column, count, ",");
+    printf("%-28s %8.2f ns/op\n", "join %g of doubles", _osl_bench_seconds(start) * 1e9 / count);
+    column.type = OSL_COLUMN_FLOAT16;
+    column.data = half;
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%g", &column, count, ",");
+    printf("%-28s %8.2f ns/op\n", "join %g of float16", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%#g", &column, count, ",");
+    printf("%-28s %8.2f ns/op\n", "join %#g of float16", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%.4f", &column, count, ",");
+    printf("%-28s %8.2f ns/op\n", "join %.4f of float16", _osl_bench_seconds(start) * 1e9 / count);
+    column.type = OSL_COLUMN_BFLOAT16;
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%g", &column, count, ",");
+    printf("%-28s %8.2f ns/op\n", "join %g of bfloat16", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    osl_format_join(_osl_bench_null_write, &sum, "%#g", &column, count, ",");
+    printf("%-28s %8.2f ns/op\n", "join %#g of bfloat16", _osl_bench_seconds(start) * 1e9 / count);
+    printf("(%llu)\n", (unsigned long long)sum);
+    free(half);
+    free(values);
+}
+
+static intptr_t _osl_bench_null_write16(void* arg, const char16_t* sz, intptr_t len) {
+    *(uintptr_t*)arg += sz[0];
+    return len;
+}
+
+static intptr_t _osl_bench_format16(uintptr_t* sum, const char* format, ...) {
+    va_list argptr;
+    intptr_t rv;
+    va_start(argptr, format);
+    rv = osl_vformat16(_osl_bench_null_write16, sum, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+static void osl_format_bench_wide() {
+    const int count = 1000000;
+    char text[1024];
+    uintptr_t sum = 0;
+    clock_t start;
+    for (int i = 0; i < 1000; i++) {
+        text[i] = 'a' + i % 26;
+    }
+    text[1000] = 0;
+    memcpy(text + 500, "\xe2\x82\xac", 3);
+
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format(&sum, "%d,%s,%.3f", i, "name", 2.5);
+    }
+    printf("%-28s %8.2f ns/op\n", "%d,%s,%.3f", _osl_bench_seconds(start) * 1e9 / count);
+    start = clock();
+    for (int i = 0; i < count; i++) {
+        _osl_bench_format16(&sum, "%d,%s,%.3f", i, "name", 2.5);
+    }
+    printf("%-28s %8.2f ns/op\n", "%d,%s,%.3f to UTF-16", _osl_bench_seconds(start) * 1e9 / count);
+
+    start = clock();
+    for (int i = 0; i < count / 10; i++) {
+        _osl_bench_format(&sum, "%s", text);
+    }
+    printf("%-28s %8.2f ns/op\n", "%s of 1 KB", _osl_bench_seconds(start) * 1e9 / (count / 10));
+    start = clock();
+    for (int i = 0; i < count / 10; i++) {
+        _osl_bench_format16(&sum, "%s", text);
+    }
+    printf("%-28s %8.2f ns/op\n", "%s of 1 KB to UTF-16", _osl_bench_seconds(start) * 1e9 / (count / 10));
+    printf("(%llu)\n", (unsigned long long)sum);
+}
+
+void osl_format_bench() {
+    OslBenchTable table;
+    printf("bench counter\n");
+    osl_format_bench_counter();
+    if (!_osl_bench_table_init(&table)) {
+        printf("bench no memory.");
+        return;
+    }
+    printf("bench generated\n");
+    osl_format_bench_generated();
+    printf("bench custom\n");
+    osl_format_bench_custom();
+    printf("bench network\n");
+    osl_format_bench_network();
+    printf("bench timestamp\n");
+    osl_format_bench_timestamp();
+    printf("bench prefixed\n");
+    osl_format_bench_prefixed();
+    printf("bench small float\n");
+    osl_format_bench_small_float();
+    printf("bench decimal\n");
+    osl_format_bench_decimal();
+    printf("bench scaled\n");
+    osl_format_bench_scaled();
+    printf("bench wide\n");
+    osl_format_bench_wide();
+    printf("bench hex\n");
+    osl_format_bench_hex();
+    printf("bench string\n");
+    osl_format_bench_string();
+    printf("bench escape\n");
+    osl_format_bench_escape();
+    printf("bench join\n");
+    osl_format_bench_join(&table);
+    printf("bench columns\n");
+    osl_format_bench_columns(&table);
+    printf("bench columns parallel\n");
+    osl_format_bench_columns_parallel(&table);
+    _osl_bench_table_free(&table);
+}
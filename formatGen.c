@@ -0,0 +1,963 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef FALSE
+#define FALSE 0
+#endif // FALSE
+
+#ifndef TRUE
+#define TRUE 1
+#endif // TRUE
+
+typedef int ibool;
+
+// format_gen list output_base [--checks]
+//
+// Reads the format strings of a project from list and writes output_base.h and output_base.c with a
+// function specialized for each of them:
+//
+//   intptr_t name(OslFormatWriteFunc writefunc, void* userData, <one parameter per conversion>);
+//
+// which writes the same bytes and returns the same count as osl_vformat of the format.
+// Every line of list is a name and a C string literal, blank lines and lines starting with '#' are skipped:
+//
+//   log_request "%s %pI4 status=%03d in %.3fms\n"
+//
+// Literal text becomes memcpy of constants into an output buffer that is reserved once per run of
+// literals and plain integers, d i u x X o c s f F are calls into u64tos and ieee754d64fixed with the
+// width, precision and flags as constants. e E g G a A b B k K p and T go through osl_vformat with
+// the conversion alone. --checks adds a table that calls each function and osl_vformat from an array
+// of values, for the test harness.
+
+#define GEN_MAX_LINE 4096
+#define GEN_MAX_ITEMS 256
+#define GEN_MAX_OPS 128
+//the output buffer of a generated function
+#define GEN_BUFFER_LENGTH 256
+//longer literals are written without a reservation
+#define GEN_MAX_RESERVED_LITERAL 128
+//larger widths and precisions are padded by the checked helpers
+#define GEN_MAX_CONSTANT 4096
+
+#define GEN_FLAG_LEFT 0x01
+#define GEN_FLAG_SIGN 0x02
+#define GEN_FLAG_ZERO 0x04
+#define GEN_FLAG_BLANK 0x08
+#define GEN_FLAG_ALTERNATE 0x10
+
+//how an op is written, the raw kinds write into reserved room of the output buffer
+#define GEN_KIND_LITERAL 1     //raw when not longer than GEN_MAX_RESERVED_LITERAL
+#define GEN_KIND_INT_PLAIN 2   //raw, an integer without width, precision, '-', '0' or '#'
+#define GEN_KIND_CHAR 3        //raw
+#define GEN_KIND_INT 4
+#define GEN_KIND_STRING 5
+#define GEN_KIND_FIXED 6
+#define GEN_KIND_FALLBACK 7
+
+//helpers of the preamble, emitted only when a function of the file needs them
+#define GEN_HELPER_WRITE 0x01
+#define GEN_HELPER_NUMBER 0x02
+#define GEN_HELPER_DIGITS 0x04
+#define GEN_HELPER_PUT_INT64 0x08
+#define GEN_HELPER_STRING 0x10
+#define GEN_HELPER_FIXED 0x20
+#define GEN_HELPER_VFORMAT 0x40
+
+//a literal run or a conversion of a format
+typedef struct GenOp GenOp;
+struct GenOp {
+  int kind;
+  const char* literal; //the bytes of a literal run
+  int len;
+  char specifier;
+  int flags;
+  int width;           //-1 if not given
+  int precision;       //-1 if not given
+  char length[4];      //the length modifier as written
+  const char* spec;    //the conversion as written, for the fallback
+  int spec_len;
+  int arg;             //the parameter of a conversion
+  int bound;           //the most bytes a raw kind writes
+};
+
+//a named format of the list
+typedef struct GenItem GenItem;
+struct GenItem {
+  char name[64];
+  char* format;        //unescaped
+  int format_len;
+  char* literals;      //the bytes of the literal runs, "%%" is one '%'
+  int op_count;
+  GenOp ops[GEN_MAX_OPS];
+  int arg_count;
+  const char* arg_types[GEN_MAX_OPS];
+};
+
+static const char* _gen_list_path;
+static int _gen_line;
+
+static void _gen_fail(const char* message, const char* detail) {
+  fprintf(stderr, "%s:%d: %s%s\n", _gen_list_path, _gen_line, message, detail ? detail : "");
+  exit(1);
+}
+
+/// <summary>
+/// Unescapes the C string literal at pos into out
+/// </summary>
+/// <returns>the position after the closing quote</returns>
+static const char* _gen_unescape(const char* pos, char* out, int* plen) {
+  int len = 0;
+  if (*pos++ != '"')
+    _gen_fail("expected a string literal", NULL);
+  while (*pos != '"') {
+    int ch = (unsigned char)*pos++;
+    if (ch == 0 || ch == '\n' || ch == '\r')
+      _gen_fail("unterminated string literal", NULL);
+    if (ch == '\\') {
+      ch = (unsigned char)*pos++;
+      switch (ch) {
+      case 'n': ch = '\n'; break;
+      case 't': ch = '\t'; break;
+      case 'r': ch = '\r'; break;
+      case 'a': ch = '\a'; break;
+      case 'b': ch = '\b'; break;
+      case 'f': ch = '\f'; break;
+      case 'v': ch = '\v'; break;
+      case '\\': case '"': case '\'': case '?': break;
+      case 'x':
+        ch = 0;
+        while (strchr("0123456789abcdefABCDEF", *pos) && *pos) {
+          ch = ch * 16 + (*pos <= '9' ? *pos - '0' : (*pos | 0x20) - 'a' + 10);
+          pos++;
+        }
+        break;
+      default:
+        if (ch < '0' || ch > '7')
+          _gen_fail("unknown escape sequence", NULL);
+        ch -= '0';
+        for (int i = 0; i < 2 && '0' <= *pos && *pos <= '7'; i++) {
+          ch = ch * 8 + (*pos++ - '0');
+        }
+        break;
+      }
+      if (ch == 0 || ch > 0xFF)
+        _gen_fail("the format must be a string of bytes without a null", NULL);
+    }
+    out[len++] = (char)ch;
+  }
+  out[len] = 0;
+  *plen = len;
+  return pos + 1;
+}
+
+//len bytes of sz as the inside of a C string literal, octal escapes for everything but printable ASCII
+static void _gen_put_literal(FILE* file, const char* sz, int len) {
+  for (int i = 0; i < len; i++) {
+    unsigned char ch = (unsigned char)sz[i];
+    if (ch == '"' || ch == '\\')
+      fprintf(file, "\\%c", ch);
+    else if (ch < 0x20 || ch >= 0x7F || ch == '?')
+      fprintf(file, "\\%03o", ch);
+    else
+      fputc(ch, file);
+  }
+}
+
+/// <summary>
+/// The parameter type of a conversion, NULL if the generator does not support it.
+/// Integer types follow the length modifiers of osl_vformat.
+/// </summary>
+static const char* _gen_arg_type(const char* length, char specifier) {
+  static const char* lengths[] = { "", "hh", "h", "l", "ll", "j", "z", "t", "I64", "I32", "I" };
+  static const char* signed_types[] = { "int", "int", "int", "long", "long long", "intmax_t", "ptrdiff_t",
+    "ptrdiff_t", "int64_t", "int", "intptr_t" };
+  static const char* unsigned_types[] = { "unsigned int", "unsigned int", "unsigned int", "unsigned long",
+    "unsigned long long", "uintmax_t", "size_t", "size_t", "uint64_t", "unsigned int", "uintptr_t" };
+  int index = -1;
+  for (int i = 0; i < (int)(sizeof(lengths) / sizeof(lengths[0])); i++) {
+    if (strcmp(length, lengths[i]) == 0)
+      index = i;
+  }
+  switch (specifier) {
+  case 'd': case 'i':
+    return index >= 0 ? signed_types[index] : NULL;
+  case 'u': case 'x': case 'X': case 'o': case 'b': case 'B':
+    return index >= 0 ? unsigned_types[index] : NULL;
+  case 'k': case 'K':
+    if (strcmp(length, "R") == 0)
+      return "double";
+    return index >= 0 ? signed_types[index] : NULL;
+  case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+    return length[0] == 0 || strcmp(length, "l") == 0 || strcmp(length, "L") == 0 ? "double" : NULL;
+  case 'c':
+    return length[0] == 0 ? "int" : NULL;
+  case 's':
+    return length[0] == 0 ? "const char*" : NULL;
+  case 'p':
+    return length[0] == 0 ? "const void*" : NULL;
+  case 'T':
+    return length[0] == 0 ? "int64_t" : NULL;
+  default:
+    return NULL;
+  }
+}
+
+//the extension letters after %p, like _vformat_pointer_extension
+static int _gen_pointer_extension(const char* psz) {
+  switch (psz[1]) {
+  case 'N': case 'X': case 'V': case 'M':
+    return 1;
+  case 'I':
+    return psz[2] == '4' || psz[2] == '6' ? 2 : 0;
+  case 'U':
+    return psz[2] && strchr("bBlL", psz[2]) ? 2 : 1;
+  case 'E':
+    return psz[2] && strchr("jcu", psz[2]) ? 2 : 1;
+  case 'h': case 'H':
+    return psz[2] && strchr("CDN", psz[2]) ? 2 : 1;
+  default:
+    return 0;
+  }
+}
+
+static GenOp* _gen_add_op(GenItem* item) {
+  if (item->op_count >= GEN_MAX_OPS)
+    _gen_fail("too many conversions in ", item->name);
+  GenOp* op = item->ops + item->op_count++;
+  memset(op, 0, sizeof(*op));
+  return op;
+}
+
+/// <summary>
+/// Splits the format of item into literal runs and conversions and decides how each is written
+/// </summary>
+static void _gen_parse(GenItem* item) {
+  const char* psz = item->format;
+  char* literal = item->literals;
+  char* run = literal;
+  for (;;) {
+    if (*psz != '%' || psz[1] == '%') {
+      if (*psz != 0) {
+        *literal++ = *psz;
+        psz += *psz == '%' ? 2 : 1;
+        continue;
+      }
+    }
+    if (literal > run) {
+      GenOp* op = _gen_add_op(item);
+      op->kind = GEN_KIND_LITERAL;
+      op->literal = run;
+      op->len = (int)(literal - run);
+      op->bound = op->len;
+      run = literal;
+    }
+    if (*psz == 0)
+      break;
+
+    GenOp* op = _gen_add_op(item);
+    ibool dot_without_precision = FALSE;
+    int length_len = 0;
+    op->spec = psz++;
+    op->width = -1;
+    op->precision = -1;
+    while (*psz && strchr("-+0 #", *psz)) {
+      op->flags |= *psz == '-' ? GEN_FLAG_LEFT : *psz == '+' ? GEN_FLAG_SIGN : *psz == '0' ? GEN_FLAG_ZERO
+        : *psz == ' ' ? GEN_FLAG_BLANK : GEN_FLAG_ALTERNATE;
+      psz++;
+    }
+    //like osl_vformat, '-' overrides '0' and '+' overrides ' '
+    if (op->flags & GEN_FLAG_LEFT)
+      op->flags &= ~GEN_FLAG_ZERO;
+    if (op->flags & GEN_FLAG_SIGN)
+      op->flags &= ~GEN_FLAG_BLANK;
+    if (*psz == '*')
+      _gen_fail("a width argument '*' is not supported in ", item->name);
+    if ('0' <= *psz && *psz <= '9') {
+      op->width = 0;
+      while ('0' <= *psz && *psz <= '9' && op->width < GEN_MAX_CONSTANT) {
+        op->width = op->width * 10 + (*psz++ - '0');
+      }
+    }
+    if (*psz == '.') {
+      psz++;
+      if (*psz == '*')
+        _gen_fail("a precision argument '*' is not supported in ", item->name);
+      if ('0' <= *psz && *psz <= '9') {
+        op->precision = 0;
+        while ('0' <= *psz && *psz <= '9' && op->precision < GEN_MAX_CONSTANT) {
+          op->precision = op->precision * 10 + (*psz++ - '0');
+        }
+      }
+      else {
+        dot_without_precision = TRUE;
+      }
+    }
+    if (('0' <= *psz && *psz <= '9'))
+      _gen_fail("the width or precision is too large in ", item->name);
+    if ((psz[0] == 'h' && psz[1] == 'h') || (psz[0] == 'l' && psz[1] == 'l'))
+      length_len = 2;
+    else if (psz[0] == 'I' && ((psz[1] == '6' && psz[2] == '4') || (psz[1] == '3' && psz[2] == '2')))
+      length_len = 3;
+    else if (*psz && strchr("hljztLIR", *psz))
+      length_len = 1;
+    memcpy(op->length, psz, length_len);
+    psz += length_len;
+    op->specifier = *psz;
+    op->arg = item->arg_count;
+    item->arg_types[item->arg_count] = _gen_arg_type(op->length, op->specifier);
+    if (op->specifier == 0 || item->arg_types[item->arg_count] == NULL) {
+      char detail[96];
+      snprintf(detail, sizeof(detail), "%.*s in %s", (int)(psz - op->spec + (*psz != 0)), op->spec, item->name);
+      _gen_fail("conversion not supported by format_gen: ", detail);
+    }
+    item->arg_count++;
+    if (op->specifier == 'p')
+      psz += _gen_pointer_extension(psz);
+    psz++;
+    op->spec_len = (int)(psz - op->spec);
+
+    switch (op->specifier) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+      if (op->specifier != 'd' && op->specifier != 'i')
+        op->flags &= ~(GEN_FLAG_SIGN | GEN_FLAG_BLANK);
+      //the '0' flag is ignored when a precision is given
+      if (op->precision >= 0)
+        op->flags &= ~GEN_FLAG_ZERO;
+      if (op->width < 0 && op->precision < 0 && (op->flags & (GEN_FLAG_LEFT | GEN_FLAG_ZERO | GEN_FLAG_ALTERNATE)) == 0) {
+        op->kind = GEN_KIND_INT_PLAIN;
+        op->bound = op->specifier == 'o' ? 22 : op->specifier == 'x' || op->specifier == 'X' ? 16 : 21;
+      }
+      else {
+        op->kind = GEN_KIND_INT;
+      }
+      break;
+    case 'c':
+      //osl_vformat writes the character alone, without the width
+      op->kind = GEN_KIND_CHAR;
+      op->bound = 1;
+      break;
+    case 's':
+      op->kind = GEN_KIND_STRING;
+      break;
+    case 'f': case 'F':
+      if (dot_without_precision)
+        op->precision = 0;
+      //ieee754d64fixed covers precisions up to 15, other values fall back in the generated code
+      op->kind = (op->precision < 0 ? 6 : op->precision) <= 15 ? GEN_KIND_FIXED : GEN_KIND_FALLBACK;
+      break;
+    default:
+      op->kind = GEN_KIND_FALLBACK;
+      break;
+    }
+  }
+}
+
+static void _gen_put_helpers(FILE* file, int helpers) {
+  fputs(
+    "//the output of a generated function, pieces are gathered in buf and written when it is full\n"
+    "typedef struct OslGenOutput OslGenOutput;\n"
+    "struct OslGenOutput {\n"
+    "  OslFormatWriteFunc writefunc;\n"
+    "  void* userData;\n"
+    "  intptr_t count;\n"
+    "  intptr_t len;\n"
+    "  char buf[GEN_BUFFER_LENGTH];\n"
+    "};\n"
+    "\n"
+    "static intptr_t _gen_null_write(void* userData, const char* sz, intptr_t len) {\n"
+    "  (void)userData;\n"
+    "  (void)sz;\n"
+    "  return len;\n"
+    "}\n"
+    "\n"
+    "static void _gen_init(OslGenOutput* out, OslFormatWriteFunc writefunc, void* userData) {\n"
+    "  out->writefunc = writefunc != NULL ? writefunc : _gen_null_write;\n"
+    "  out->userData = userData;\n"
+    "  out->count = 0;\n"
+    "  out->len = 0;\n"
+    "}\n"
+    "\n"
+    "static ibool _gen_flush(OslGenOutput* out) {\n"
+    "  if (out->len > 0 && out->writefunc(out->userData, out->buf, out->len) != out->len)\n"
+    "    return FALSE;\n"
+    "  out->count += out->len;\n"
+    "  out->len = 0;\n"
+    "  return TRUE;\n"
+    "}\n"
+    "\n"
+    "//room for n <= GEN_BUFFER_LENGTH more bytes in buf\n"
+    "static ibool _gen_reserve(OslGenOutput* out, intptr_t n) {\n"
+    "  return out->len + n <= GEN_BUFFER_LENGTH || _gen_flush(out);\n"
+    "}\n"
+    "\n", file);
+  if (helpers & GEN_HELPER_WRITE) {
+    fputs(
+      "static ibool _gen_write(OslGenOutput* out, const char* sz, intptr_t len) {\n"
+      "  if (len > GEN_BUFFER_LENGTH) {\n"
+      "    if (!_gen_flush(out) || out->writefunc(out->userData, sz, len) != len)\n"
+      "      return FALSE;\n"
+      "    out->count += len;\n"
+      "    return TRUE;\n"
+      "  }\n"
+      "  if (!_gen_reserve(out, len))\n"
+      "    return FALSE;\n"
+      "  memcpy(out->buf + out->len, sz, len);\n"
+      "  out->len += len;\n"
+      "  return TRUE;\n"
+      "}\n"
+      "\n"
+      "static ibool _gen_fill(OslGenOutput* out, char ch, intptr_t n) {\n"
+      "  while (n > 0) {\n"
+      "    intptr_t part = n < GEN_BUFFER_LENGTH ? n : GEN_BUFFER_LENGTH;\n"
+      "    if (!_gen_reserve(out, part))\n"
+      "      return FALSE;\n"
+      "    memset(out->buf + out->len, ch, part);\n"
+      "    out->len += part;\n"
+      "    n -= part;\n"
+      "  }\n"
+      "  return TRUE;\n"
+      "}\n"
+      "\n", file);
+  }
+  if (helpers & GEN_HELPER_NUMBER) {
+    fputs(
+      "//prefix and digits padded like osl_vformat: zeros up to the precision of an integer,\n"
+      "//then blanks up to the width, or zeros after the prefix with the '0' flag\n"
+      "static ibool _gen_number(OslGenOutput* out, const char* prefix, intptr_t prefix_len, const char* digits, intptr_t len,\n"
+      "  int precision, int width, int flags) {\n"
+      "  intptr_t zeros = precision - len;\n"
+      "  intptr_t blanks;\n"
+      "  if (zeros < 0)\n"
+      "    zeros = 0;\n"
+      "  else if (zeros > 0 && prefix_len > 0 && prefix[prefix_len - 1] == '0')\n"
+      "    zeros--;\n"
+      "  blanks = width - len - prefix_len - zeros;\n"
+      "  if (blanks < 0)\n"
+      "    blanks = 0;\n"
+      "  if (!(flags & GEN_FLAG_LEFT) && (flags & GEN_FLAG_ZERO)) {\n"
+      "    zeros += blanks;\n"
+      "    blanks = 0;\n"
+      "  }\n"
+      "  if (!(flags & GEN_FLAG_LEFT) && !_gen_fill(out, ' ', blanks))\n"
+      "    return FALSE;\n"
+      "  if (!_gen_write(out, prefix, prefix_len) || !_gen_fill(out, '0', zeros) || !_gen_write(out, digits, len))\n"
+      "    return FALSE;\n"
+      "  return !(flags & GEN_FLAG_LEFT) || _gen_fill(out, ' ', blanks);\n"
+      "}\n"
+      "\n", file);
+  }
+  if (helpers & GEN_HELPER_DIGITS) {
+    fputs(
+      "//the base 16 or 8 digits of value, shift is 4 or 3\n"
+      "static int _gen_digits(uint64_t value, char* buf, int shift, const char* digits) {\n"
+      "  char tmp[24];\n"
+      "  char* pos = tmp + 24;\n"
+      "  do {\n"
+      "    *--pos = digits[value & ((1u << shift) - 1)];\n"
+      "    value >>= shift;\n"
+      "  } while (value != 0);\n"
+      "  memcpy(buf, pos, tmp + 24 - pos);\n"
+      "  return (int)(tmp + 24 - pos);\n"
+      "}\n"
+      "\n", file);
+  }
+  if (helpers & GEN_HELPER_PUT_INT64) {
+    fputs(
+      "//a signed decimal into reserved room of buf, sign is '+', ' ' or 0 for values >= 0\n"
+      "static void _gen_put_int64(OslGenOutput* out, int64_t value, char sign) {\n"
+      "  uint64_t magnitude = (uint64_t)value;\n"
+      "  if (value < 0) {\n"
+      "    out->buf[out->len++] = '-';\n"
+      "    magnitude = 0 - magnitude;\n"
+      "  }\n"
+      "  else if (sign != 0) {\n"
+      "    out->buf[out->len++] = sign;\n"
+      "  }\n"
+      "  out->len += u64tos(magnitude, out->buf + out->len);\n"
+      "}\n"
+      "\n", file);
+  }
+  if (helpers & GEN_HELPER_STRING) {
+    fputs(
+      "static ibool _gen_string(OslGenOutput* out, const char* sz, int precision, int width, int flags) {\n"
+      "  intptr_t len;\n"
+      "  if (sz == NULL)\n"
+      "    sz = \"(null)\";\n"
+      "  if (precision >= 0) {\n"
+      "    //never read past the precision\n"
+      "    const char* end = (const char*)memchr(sz, 0, precision);\n"
+      "    len = end != NULL ? end - sz : precision;\n"
+      "  }\n"
+      "  else {\n"
+      "    len = (intptr_t)strlen(sz);\n"
+      "  }\n"
+      "  if (!(flags & GEN_FLAG_LEFT) && len < width && !_gen_fill(out, ' ', width - len))\n"
+      "    return FALSE;\n"
+      "  if (!_gen_write(out, sz, len))\n"
+      "    return FALSE;\n"
+      "  return !(flags & GEN_FLAG_LEFT) || len >= width || _gen_fill(out, ' ', width - len);\n"
+      "}\n"
+      "\n", file);
+  }
+  if (helpers & GEN_HELPER_FIXED) {
+    fputs(
+      "//%.precisionf of a value whose digits are scaled = |value| * 10^precision from ieee754d64fixed\n"
+      "static ibool _gen_fixed(OslGenOutput* out, ibool neg, uint64_t scaled, int precision, int width, int flags) {\n"
+      "  char digits[24];\n"
+      "  char text[48];\n"
+      "  char* pos = text;\n"
+      "  int len = u64tos(scaled, digits);\n"
+      "  if (len <= precision) {\n"
+      "    *pos++ = '0';\n"
+      "    *pos++ = '.';\n"
+      "    memset(pos, '0', precision - len);\n"
+      "    pos += precision - len;\n"
+      "    memcpy(pos, digits, len);\n"
+      "    pos += len;\n"
+      "  }\n"
+      "  else {\n"
+      "    memcpy(pos, digits, len - precision);\n"
+      "    pos += len - precision;\n"
+      "    if (precision > 0 || (flags & GEN_FLAG_ALTERNATE))\n"
+      "      *pos++ = '.';\n"
+      "    memcpy(pos, digits + len - precision, precision);\n"
+      "    pos += precision;\n"
+      "  }\n"
+      "  if (neg)\n"
+      "    return _gen_number(out, \"-\", 1, text, pos - text, -1, width, flags);\n"
+      "  if (flags & (GEN_FLAG_BLANK | GEN_FLAG_SIGN))\n"
+      "    return _gen_number(out, (flags & GEN_FLAG_BLANK) ? \" \" : \"+\", 1, text, pos - text, -1, width, flags);\n"
+      "  return _gen_number(out, \"\", 0, text, pos - text, -1, width, flags);\n"
+      "}\n"
+      "\n", file);
+  }
+  if (helpers & GEN_HELPER_VFORMAT) {
+    fputs(
+      "//a conversion the generator does not specialize, written by osl_vformat\n"
+      "static ibool _gen_vformat(OslGenOutput* out, const char* format, ...) {\n"
+      "  va_list argptr;\n"
+      "  intptr_t rv;\n"
+      "  if (!_gen_flush(out))\n"
+      "    return FALSE;\n"
+      "  va_start(argptr, format);\n"
+      "  rv = osl_vformat(out->writefunc, out->userData, format, argptr);\n"
+      "  va_end(argptr);\n"
+      "  if (rv < 0)\n"
+      "    return FALSE;\n"
+      "  out->count += rv;\n"
+      "  return TRUE;\n"
+      "}\n"
+      "\n", file);
+  }
+}
+
+static int _gen_helpers_of(const GenItem* item) {
+  int helpers = 0;
+  for (int i = 0; i < item->op_count; i++) {
+    const GenOp* op = item->ops + i;
+    switch (op->kind) {
+    case GEN_KIND_LITERAL:
+      if (op->len > GEN_MAX_RESERVED_LITERAL)
+        helpers |= GEN_HELPER_WRITE;
+      break;
+    case GEN_KIND_INT_PLAIN:
+      if (op->specifier == 'd' || op->specifier == 'i')
+        helpers |= GEN_HELPER_PUT_INT64;
+      else if (op->specifier != 'u')
+        helpers |= GEN_HELPER_DIGITS;
+      break;
+    case GEN_KIND_INT:
+      helpers |= GEN_HELPER_WRITE | GEN_HELPER_NUMBER;
+      if (op->specifier != 'd' && op->specifier != 'i' && op->specifier != 'u')
+        helpers |= GEN_HELPER_DIGITS;
+      break;
+    case GEN_KIND_STRING:
+      helpers |= GEN_HELPER_WRITE | GEN_HELPER_STRING;
+      break;
+    case GEN_KIND_FIXED:
+      helpers |= GEN_HELPER_WRITE | GEN_HELPER_NUMBER | GEN_HELPER_FIXED | GEN_HELPER_VFORMAT;
+      break;
+    case GEN_KIND_FALLBACK:
+      helpers |= GEN_HELPER_VFORMAT;
+      break;
+    }
+  }
+  return helpers;
+}
+
+static ibool _gen_is_raw(const GenOp* op) {
+  return op->kind == GEN_KIND_INT_PLAIN || op->kind == GEN_KIND_CHAR
+    || (op->kind == GEN_KIND_LITERAL && op->len <= GEN_MAX_RESERVED_LITERAL);
+}
+
+static void _gen_put_flags(FILE* file, int flags) {
+  static const char* names[] = { "GEN_FLAG_LEFT", "GEN_FLAG_SIGN", "GEN_FLAG_ZERO", "GEN_FLAG_BLANK", "GEN_FLAG_ALTERNATE" };
+  ibool first = TRUE;
+  for (int i = 0; i < 5; i++) {
+    if (flags & (1 << i)) {
+      fprintf(file, first ? "%s" : " | %s", names[i]);
+      first = FALSE;
+    }
+  }
+  if (first)
+    fputs("0", file);
+}
+
+//the digits of an integer conversion into buf, the expression of its magnitude is value
+static void _gen_put_int_digits(FILE* file, const GenOp* op, const char* buf, const char* value) {
+  if (op->specifier == 'x' || op->specifier == 'X')
+    fprintf(file, "_gen_digits(%s, %s, 4, \"%s\")", value, buf, op->specifier == 'X' ? "0123456789ABCDEF" : "0123456789abcdef");
+  else if (op->specifier == 'o')
+    fprintf(file, "_gen_digits(%s, %s, 3, \"01234567\")", value, buf);
+  else
+    fprintf(file, "u64tos(%s, %s)", value, buf);
+}
+
+//the argument of an integer conversion, narrowed by hh and h like osl_vformat
+static void _gen_put_int_arg(FILE* file, const GenOp* op) {
+  ibool is_signed = op->specifier == 'd' || op->specifier == 'i';
+  if (strcmp(op->length, "hh") == 0)
+    fprintf(file, "(%s)", is_signed ? "signed char" : "unsigned char");
+  else if (strcmp(op->length, "h") == 0)
+    fprintf(file, "(%s)", is_signed ? "short" : "unsigned short");
+  fprintf(file, "a%d", op->arg);
+}
+
+static void _gen_put_op(FILE* file, const GenOp* op) {
+  switch (op->kind) {
+  case GEN_KIND_LITERAL:
+    if (op->len > GEN_MAX_RESERVED_LITERAL) {
+      fputs("  if (!_gen_write(&out, \"", file);
+      _gen_put_literal(file, op->literal, op->len);
+      fprintf(file, "\", %d))\n    return -1;\n", op->len);
+      break;
+    }
+    fputs("  memcpy(out.buf + out.len, \"", file);
+    _gen_put_literal(file, op->literal, op->len);
+    fprintf(file, "\", %d);\n  out.len += %d;\n", op->len, op->len);
+    break;
+  case GEN_KIND_CHAR:
+    fprintf(file, "  out.buf[out.len++] = (char)a%d;\n", op->arg);
+    break;
+  case GEN_KIND_INT_PLAIN:
+    if (op->specifier == 'd' || op->specifier == 'i') {
+      fputs("  _gen_put_int64(&out, ", file);
+      _gen_put_int_arg(file, op);
+      fprintf(file, ", %s);\n", (op->flags & GEN_FLAG_BLANK) ? "' '" : (op->flags & GEN_FLAG_SIGN) ? "'+'" : "0");
+      break;
+    }
+    fputs("  out.len += ", file);
+    do {
+      char value[64];
+      snprintf(value, sizeof(value), "(uint64_t)%s%s%sa%d", strcmp(op->length, "hh") == 0 ? "(unsigned char)" : "",
+        strcmp(op->length, "h") == 0 ? "(unsigned short)" : "", "", op->arg);
+      _gen_put_int_digits(file, op, "out.buf + out.len", value);
+    } while (0);
+    fputs(";\n", file);
+    break;
+  case GEN_KIND_INT:
+    fprintf(file, "  {\n    //%.*s\n", op->spec_len, op->spec);
+    if (op->specifier == 'd' || op->specifier == 'i') {
+      fputs("    int64_t value = ", file);
+      _gen_put_int_arg(file, op);
+      fputs(";\n    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;\n", file);
+    }
+    else {
+      fputs("    uint64_t magnitude = ", file);
+      _gen_put_int_arg(file, op);
+      fputs(";\n", file);
+    }
+    fputs("    char digits[24];\n    int len = ", file);
+    if (op->precision == 0)
+      fputs("magnitude == 0 ? 0 : ", file);
+    _gen_put_int_digits(file, op, "digits", "magnitude");
+    fputs(";\n", file);
+    //the sign or alternate form prefix
+    if (op->specifier == 'd' || op->specifier == 'i') {
+      if (op->flags & (GEN_FLAG_BLANK | GEN_FLAG_SIGN))
+        fprintf(file, "    if (!_gen_number(&out, value < 0 ? \"-\" : \"%c\", 1", (op->flags & GEN_FLAG_BLANK) ? ' ' : '+');
+      else
+        fputs("    if (!_gen_number(&out, \"-\", value < 0", file);
+    }
+    else if ((op->flags & GEN_FLAG_ALTERNATE) && op->specifier == 'o')
+      fputs("    if (!_gen_number(&out, \"0\", magnitude != 0 || len == 0", file);
+    else if ((op->flags & GEN_FLAG_ALTERNATE) && op->specifier != 'u')
+      fprintf(file, "    if (!_gen_number(&out, \"0%c\", magnitude != 0 ? 2 : 0", op->specifier);
+    else
+      fputs("    if (!_gen_number(&out, \"\", 0", file);
+    fprintf(file, ", digits, len, %d, %d, ", op->precision, op->width);
+    _gen_put_flags(file, op->flags);
+    fputs("))\n      return -1;\n  }\n", file);
+    break;
+  case GEN_KIND_STRING:
+    fprintf(file, "  if (!_gen_string(&out, a%d, %d, %d, ", op->arg, op->precision, op->width);
+    _gen_put_flags(file, op->flags);
+    fputs("))\n    return -1;\n", file);
+    break;
+  case GEN_KIND_FIXED:
+    fprintf(file, "  if (ieee754d64fixed(&a%d, 1, %d, &scaled, &ok) == 1) {\n", op->arg, op->precision < 0 ? 6 : op->precision);
+    fprintf(file, "    if (!_gen_fixed(&out, a%d < 0, scaled, %d, %d, ", op->arg, op->precision < 0 ? 6 : op->precision, op->width);
+    _gen_put_flags(file, op->flags);
+    fputs("))\n      return -1;\n  }\n  else if (!_gen_vformat(&out, \"", file);
+    _gen_put_literal(file, op->spec, op->spec_len);
+    fprintf(file, "\", a%d)) {\n    return -1;\n  }\n", op->arg);
+    break;
+  default:
+    fputs("  if (!_gen_vformat(&out, \"", file);
+    _gen_put_literal(file, op->spec, op->spec_len);
+    fprintf(file, "\", a%d))\n    return -1;\n", op->arg);
+    break;
+  }
+}
+
+static void _gen_put_signature(FILE* file, const GenItem* item) {
+  fprintf(file, "intptr_t %s(OslFormatWriteFunc writefunc, void* userData", item->name);
+  for (int i = 0; i < item->arg_count; i++) {
+    fprintf(file, ", %s a%d", item->arg_types[i], i);
+  }
+  fputs(")", file);
+}
+
+static void _gen_put_function(FILE* file, const GenItem* item) {
+  int reserved = 0;
+  ibool fixed = FALSE;
+  fputs("//\"", file);
+  _gen_put_literal(file, item->format, item->format_len);
+  fputs("\"\n", file);
+  _gen_put_signature(file, item);
+  fputs(" {\n  OslGenOutput out;\n", file);
+  for (int i = 0; i < item->op_count; i++) {
+    fixed |= item->ops[i].kind == GEN_KIND_FIXED;
+  }
+  if (fixed)
+    fputs("  uint64_t scaled;\n  unsigned char ok;\n", file);
+  fputs("  _gen_init(&out, writefunc, userData);\n", file);
+  for (int i = 0; i < item->op_count; i++) {
+    const GenOp* op = item->ops + i;
+    if (!_gen_is_raw(op)) {
+      reserved = 0;
+      _gen_put_op(file, op);
+      continue;
+    }
+    if (reserved < op->bound) {
+      //one reservation for the run of raw ops that follows
+      reserved = 0;
+      for (int k = i; k < item->op_count && _gen_is_raw(item->ops + k)
+        && reserved + item->ops[k].bound <= GEN_BUFFER_LENGTH; k++) {
+        reserved += item->ops[k].bound;
+      }
+      fprintf(file, "  if (!_gen_reserve(&out, %d))\n    return -1;\n", reserved);
+    }
+    _gen_put_op(file, op);
+    reserved -= op->bound;
+  }
+  fputs("  if (!_gen_flush(&out))\n    return -1;\n  return out.count;\n}\n\n", file);
+}
+
+//the value of argument i of a check call
+static void _gen_put_check_arg(FILE* file, const GenItem* item, int i) {
+  const char* type = item->arg_types[i];
+  if (strcmp(type, "double") == 0)
+    fprintf(file, ", values[%d].f", i);
+  else if (strcmp(type, "const char*") == 0)
+    fprintf(file, ", values[%d].s", i);
+  else if (strcmp(type, "const void*") == 0)
+    fprintf(file, ", (const void*)(intptr_t)values[%d].i", i);
+  else
+    fprintf(file, ", (%s)values[%d].i", type, i);
+}
+
+static void _gen_put_checks(FILE* file, const GenItem* items, int count, const char* table) {
+  fputs(
+    "static intptr_t _gen_reference(OslFormatWriteFunc writefunc, void* userData, const char* format, ...) {\n"
+    "  va_list argptr;\n"
+    "  intptr_t rv;\n"
+    "  va_start(argptr, format);\n"
+    "  rv = osl_vformat(writefunc, userData, format, argptr);\n"
+    "  va_end(argptr);\n"
+    "  return rv;\n"
+    "}\n\n", file);
+  for (int n = 0; n < count; n++) {
+    const GenItem* item = items + n;
+    for (int reference = 0; reference < 2; reference++) {
+      fprintf(file, "static intptr_t _gen_check_%s%s(OslFormatWriteFunc writefunc, void* userData, const OslGeneratedValue* values) {\n",
+        item->name, reference ? "_reference" : "");
+      if (item->arg_count == 0)
+        fputs("  (void)values;\n", file);
+      if (reference) {
+        fputs("  return _gen_reference(writefunc, userData, \"", file);
+        _gen_put_literal(file, item->format, item->format_len);
+        fputs("\"", file);
+      }
+      else {
+        fprintf(file, "  return %s(writefunc, userData", item->name);
+      }
+      for (int i = 0; i < item->arg_count; i++) {
+        _gen_put_check_arg(file, item, i);
+      }
+      fputs(");\n}\n\n", file);
+    }
+  }
+  fprintf(file, "const OslGeneratedCheck %s[] = {\n", table);
+  for (int n = 0; n < count; n++) {
+    fprintf(file, "  { \"%s\", \"", items[n].name);
+    _gen_put_literal(file, items[n].format, items[n].format_len);
+    fprintf(file, "\", %d, _gen_check_%s, _gen_check_%s_reference },\n", items[n].arg_count, items[n].name, items[n].name);
+  }
+  fputs("  { NULL, NULL, 0, NULL, NULL }\n};\n", file);
+}
+
+static FILE* _gen_open(const char* base, const char* extension) {
+  char path[GEN_MAX_LINE];
+  snprintf(path, sizeof(path), "%s%s", base, extension);
+  FILE* file = fopen(path, "w");
+  if (file == NULL) {
+    fprintf(stderr, "format_gen: can not write %s\n", path);
+    exit(1);
+  }
+  return file;
+}
+
+int main(int argc, char* argv[]) {
+  const char* output_base = NULL;
+  ibool checks = FALSE;
+  static GenItem items[GEN_MAX_ITEMS];
+  int count = 0;
+  int helpers = 0;
+  char line[GEN_MAX_LINE];
+  char table[GEN_MAX_LINE];
+  char guard[GEN_MAX_LINE];
+  const char* base_name;
+  FILE* list;
+  FILE* file;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--checks") == 0)
+      checks = TRUE;
+    else if (_gen_list_path == NULL)
+      _gen_list_path = argv[i];
+    else
+      output_base = argv[i];
+  }
+  if (_gen_list_path == NULL || output_base == NULL) {
+    fprintf(stderr, "usage: format_gen list output_base [--checks]\n");
+    return 2;
+  }
+  list = fopen(_gen_list_path, "r");
+  if (list == NULL) {
+    fprintf(stderr, "format_gen: can not read %s\n", _gen_list_path);
+    return 1;
+  }
+  while (fgets(line, sizeof(line), list) != NULL) {
+    char* pos = line;
+    int len = 0;
+    _gen_line++;
+    while (*pos == ' ' || *pos == '\t')
+      pos++;
+    if (*pos == '#' || *pos == '\n' || *pos == '\r' || *pos == 0)
+      continue;
+    if (count >= GEN_MAX_ITEMS)
+      _gen_fail("too many formats", NULL);
+    GenItem* item = items + count++;
+    while ((('a' <= *pos && *pos <= 'z') || ('A' <= *pos && *pos <= 'Z') || *pos == '_'
+      || (len > 0 && '0' <= *pos && *pos <= '9')) && len + 1 < (int)sizeof(item->name)) {
+      item->name[len++] = *pos++;
+    }
+    if (len == 0 || (*pos != ' ' && *pos != '\t'))
+      _gen_fail("expected a name and a format", NULL);
+    while (*pos == ' ' || *pos == '\t')
+      pos++;
+    item->format = (char*)malloc(strlen(pos) + 1);
+    item->literals = (char*)malloc(strlen(pos) + 1);
+    if (item->format == NULL || item->literals == NULL)
+      _gen_fail("out of memory", NULL);
+    pos = (char*)_gen_unescape(pos, item->format, &item->format_len);
+    while (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n')
+      pos++;
+    if (*pos != 0)
+      _gen_fail("unexpected text after the format of ", item->name);
+    for (int i = 0; i < count - 1; i++) {
+      if (strcmp(items[i].name, item->name) == 0)
+        _gen_fail("duplicate name ", item->name);
+    }
+    _gen_parse(item);
+    helpers |= _gen_helpers_of(item);
+  }
+  fclose(list);
+
+  base_name = output_base + strlen(output_base);
+  while (base_name > output_base && base_name[-1] != '/' && base_name[-1] != '\\')
+    base_name--;
+  snprintf(table, sizeof(table), "%s_checks", base_name);
+  for (int i = 0; base_name[i] != 0 && i + 3 < (int)sizeof(guard); i++) {
+    char ch = base_name[i];
+    guard[i] = ('a' <= ch && ch <= 'z') ? (char)(ch - 'a' + 'A') : (('A' <= ch && ch <= 'Z') || ('0' <= ch && ch <= '9')) ? ch : '_';
+    guard[i + 1] = 0;
+  }
+  strcat(guard, "_H");
+
+  file = _gen_open(output_base, ".h");
+  fprintf(file, "//generated by format_gen from %s, do not edit\n", _gen_list_path);
+  fprintf(file, "#ifndef %s\n#define %s\n\n#include <stddef.h>\n#include \"format.h\"\n\n", guard, guard);
+  for (int n = 0; n < count; n++) {
+    _gen_put_signature(file, items + n);
+    fputs(";\n", file);
+  }
+  if (checks) {
+    fprintf(file,
+      "\n"
+      "#ifndef OSL_GENERATED_CHECK\n"
+      "#define OSL_GENERATED_CHECK\n"
+      "//an argument of a check call, each parameter takes the member of its type\n"
+      "typedef struct OslGeneratedValue OslGeneratedValue;\n"
+      "struct OslGeneratedValue {\n"
+      "  int64_t i;\n"
+      "  double f;\n"
+      "  const char* s;\n"
+      "};\n"
+      "\n"
+      "typedef intptr_t(*OslGeneratedCall)(OslFormatWriteFunc writefunc, void* userData, const OslGeneratedValue* values);\n"
+      "\n"
+      "//a generated function and osl_vformat of its format, called with the same values\n"
+      "typedef struct OslGeneratedCheck OslGeneratedCheck;\n"
+      "struct OslGeneratedCheck {\n"
+      "  const char* name;\n"
+      "  const char* format;\n"
+      "  int arg_count;\n"
+      "  OslGeneratedCall generated;\n"
+      "  OslGeneratedCall reference;\n"
+      "};\n"
+      "#endif // OSL_GENERATED_CHECK\n"
+      "\n"
+      "//ends with a NULL name\n"
+      "extern const OslGeneratedCheck %s[];\n", table);
+  }
+  fprintf(file, "\n#endif // %s\n", guard);
+  fclose(file);
+
+  file = _gen_open(output_base, ".c");
+  fprintf(file, "//generated by format_gen from %s, do not edit\n", _gen_list_path);
+  fprintf(file, "#include <string.h>\n#include \"%s.h\"\n\n", base_name);
+  fputs(
+    "#ifndef FALSE\n#define FALSE 0\n#endif // FALSE\n\n"
+    "#ifndef TRUE\n#define TRUE 1\n#endif // TRUE\n\n"
+    "typedef int ibool;\n\n", file);
+  fprintf(file, "#define GEN_BUFFER_LENGTH %d\n\n", GEN_BUFFER_LENGTH);
+  fprintf(file,
+    "#define GEN_FLAG_LEFT 0x%02x\n#define GEN_FLAG_SIGN 0x%02x\n#define GEN_FLAG_ZERO 0x%02x\n"
+    "#define GEN_FLAG_BLANK 0x%02x\n#define GEN_FLAG_ALTERNATE 0x%02x\n\n",
+    GEN_FLAG_LEFT, GEN_FLAG_SIGN, GEN_FLAG_ZERO, GEN_FLAG_BLANK, GEN_FLAG_ALTERNATE);
+  fputs(
+    "extern int u64tos(uint64_t value, char* buf);\n"
+    "extern int ieee754d64fixed(const double* values, intptr_t count, int precision, uint64_t* scaled, unsigned char* ok);\n\n",
+    file);
+  _gen_put_helpers(file, helpers);
+  for (int n = 0; n < count; n++) {
+    _gen_put_function(file, items + n);
+  }
+  if (checks)
+    _gen_put_checks(file, items, count, table);
+  fclose(file);
+  return 0;
+}
@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "format.h"
+
+#ifndef FALSE
+#define FALSE 0
+#endif // FALSE
+
+#ifndef TRUE
+#define TRUE 1
+#endif // TRUE
+
+#if defined(_WIN32) || defined(_WIN64)
+#define _OS_WINDOWS 
+#endif
+
+typedef int ibool;
+
+#ifdef _OS_WINDOWS
+#include <windows.h>
+typedef HANDLE OslThread;
+#define PARALLEL_CAS(p, expected, desired) (InterlockedCompareExchange64((p), (desired), (expected)) == (expected))
+//volatile accesses are acquire and release on msvc
+#define PARALLEL_LOAD_ACQUIRE(p) (*(p))
+#define PARALLEL_STORE_RELEASE(p, v) (*(p) = (v))
+#define PARALLEL_YIELD() SwitchToThread()
+#else // !_OS_WINDOWS
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+typedef pthread_t OslThread;
+#define PARALLEL_CAS(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#define PARALLEL_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define PARALLEL_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define PARALLEL_YIELD() sched_yield()
+#endif // _OS_WINDOWS
+
+#define PARALLEL_CHUNK_ROWS 4096
+#define PARALLEL_MAX_THREADS 256
+//fewer chunks than this are formatted on the calling thread
+#define PARALLEL_MIN_CHUNKS 4
+//chunk buffers in flight per thread, a chunk is not started before the one this many places earlier is written
+#define PARALLEL_SLOTS_PER_THREAD 4
+
+//the buffer of a chunk in flight, reused by every slot_count-th chunk
+typedef struct OslParallelSlot OslParallelSlot;
+struct OslParallelSlot {
+  char* data;
+  intptr_t len;
+  intptr_t capacity;
+  intptr_t rv;
+  volatile int64_t ready; //index + 1 of the chunk formatted into data
+  char padding[64 - sizeof(int64_t)];
+};
+
+typedef struct OslParallelJob OslParallelJob;
+struct OslParallelJob {
+  const OslCompiledFormat* compiled;
+  const OslFormatColumn* columns;
+  intptr_t row_count;
+  int64_t chunk_count;
+  OslParallelSlot* slots;
+  int slot_count;
+  char padding[64];
+  volatile int64_t next;    //the next chunk to format
+  char padding_next[64 - sizeof(int64_t)];
+  volatile int64_t written; //chunks written to writefunc, only the calling thread writes
+  volatile int64_t failed;
+};
+
+static intptr_t _parallel_chunk_write(OslParallelSlot* slot, const char* sz, intptr_t len) {
+  if (slot->len + len > slot->capacity) {
+    intptr_t capacity = slot->capacity ? slot->capacity * 2 : PARALLEL_CHUNK_ROWS * 16;
+    if (capacity < slot->len + len)
+      capacity = slot->len + len;
+    char* data = (char*)realloc(slot->data, capacity * sizeof(char));
+    if (data == NULL)
+      return -1;
+    slot->data = data;
+    slot->capacity = capacity;
+  }
+  memcpy(slot->data + slot->len, sz, len * sizeof(char));
+  slot->len += len;
+  return len;
+}
+
+static intptr_t _parallel_column_size(int type) {
+  switch (type) {
+  case OSL_COLUMN_INT64:
+    return sizeof(int64_t);
+  case OSL_COLUMN_UINT64:
+    return sizeof(uint64_t);
+  case OSL_COLUMN_DOUBLE:
+    return sizeof(double);
+  case OSL_COLUMN_STRING:
+    return sizeof(OslStringView);
+  case OSL_COLUMN_INT32:
+    return sizeof(int32_t);
+  case OSL_COLUMN_FLOAT16:
+  case OSL_COLUMN_BFLOAT16:
+    return sizeof(uint16_t);
+  default:
+    return 0;
+  }
+}
+
+static void _parallel_format_chunk(OslParallelJob* job, int64_t index) {
+  OslFormatColumn columns[OSL_COMPILED_MAX_OPS];
+  OslParallelSlot* slot = job->slots + index % job->slot_count;
+  intptr_t first = (intptr_t)index * PARALLEL_CHUNK_ROWS;
+  intptr_t rows = job->row_count - first;
+  if (rows > PARALLEL_CHUNK_ROWS)
+    rows = PARALLEL_CHUNK_ROWS;
+  for (int i = 0; i < job->compiled->column_count; i++) {
+    columns[i].type = job->columns[i].type;
+    columns[i].data = (const char*)job->columns[i].data + first * _parallel_column_size(columns[i].type);
+  }
+  slot->len = 0;
+  slot->rv = osl_format_columns((OslFormatWriteFunc)_parallel_chunk_write, slot, job->compiled, columns, rows);
+  PARALLEL_STORE_RELEASE(&slot->ready, index + 1);
+}
+
+/// <summary>
+/// Takes the next chunk if its slot is free.
+/// </summary>
+/// <returns>1 if index was taken, 0 if the slot still holds a chunk that is not written, -1 when no chunk is left</returns>
+static int _parallel_take(OslParallelJob* job, int64_t* index) {
+  for (;;) {
+    int64_t next = PARALLEL_LOAD_ACQUIRE(&job->next);
+    if (next >= job->chunk_count || PARALLEL_LOAD_ACQUIRE(&job->failed))
+      return -1;
+    if (next >= PARALLEL_LOAD_ACQUIRE(&job->written) + job->slot_count)
+      return 0;
+    if (PARALLEL_CAS(&job->next, next, next + 1)) {
+      *index = next;
+      return 1;
+    }
+  }
+}
+
+static void _parallel_worker_run(OslParallelJob* job) {
+  int64_t index;
+  int taken;
+  while ((taken = _parallel_take(job, &index)) >= 0) {
+    if (taken)
+      _parallel_format_chunk(job, index);
+    else
+      PARALLEL_YIELD();
+  }
+}
+
+#ifdef _OS_WINDOWS
+static DWORD WINAPI _parallel_thread_main(LPVOID arg) {
+  _parallel_worker_run((OslParallelJob*)arg);
+  return 0;
+}
+
+static ibool _parallel_thread_start(OslThread* thread, OslParallelJob* job) {
+  *thread = CreateThread(NULL, 0, _parallel_thread_main, job, 0, NULL);
+  return *thread != NULL;
+}
+
+static void _parallel_thread_join(OslThread thread) {
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+
+static int _parallel_cpu_count() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return (int)info.dwNumberOfProcessors;
+}
+#else // !_OS_WINDOWS
+static void* _parallel_thread_main(void* arg) {
+  _parallel_worker_run((OslParallelJob*)arg);
+  return NULL;
+}
+
+static ibool _parallel_thread_start(OslThread* thread, OslParallelJob* job) {
+  return pthread_create(thread, NULL, _parallel_thread_main, job) == 0;
+}
+
+static void _parallel_thread_join(OslThread thread) {
+  pthread_join(thread, NULL);
+}
+
+static int _parallel_cpu_count() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+}
+#endif // _OS_WINDOWS
+
+//the cpu count set by osl_format_parallel_set_cpu_count, 0 to ask the system
+static int _parallel_cpu_override = 0;
+
+/// <summary>
+/// Makes osl_format_columns_parallel act as if the machine had cpu_count cpus, 0 asks the system again.
+/// For tests, so the threaded path also runs on a single cpu; not thread safe.
+/// </summary>
+void osl_format_parallel_set_cpu_count(int cpu_count) {
+  _parallel_cpu_override = cpu_count > 0 ? cpu_count : 0;
+}
+
+/// <summary>
+/// osl_format_columns on several threads.
+/// Rows are split into chunks of PARALLEL_CHUNK_ROWS that the threads take in row order and format
+/// into slot buffers. The calling thread writes chunk k to writefunc as soon as chunks 0..k are done
+/// and formats chunks itself while the next one is not ready, so the output is the same as from
+/// osl_format_columns and at most PARALLEL_SLOTS_PER_THREAD chunks per thread are buffered.
+/// With one cpu or fewer than PARALLEL_MIN_CHUNKS chunks it is osl_format_columns.
+/// </summary>
+/// <param name="thread_count">number of threads including the caller, 0 for one per cpu, at most one per cpu</param>
+/// <returns>the number of characters written, or a negative value on error</returns>
+intptr_t osl_format_columns_parallel(OslFormatWriteFunc writefunc, void* userData, const OslCompiledFormat* compiled,
+  const OslFormatColumn* columns, intptr_t row_count, int thread_count) {
+  OslParallelJob job;
+  OslThread threads[PARALLEL_MAX_THREADS];
+  int64_t chunk_count = (row_count + PARALLEL_CHUNK_ROWS - 1) / PARALLEL_CHUNK_ROWS;
+  int cpu_count = _parallel_cpu_override > 0 ? _parallel_cpu_override : _parallel_cpu_count();
+  intptr_t rv = 0;
+  int started = 1;
+
+  //threads beyond the cpus only add switching
+  if (thread_count <= 0 || thread_count > cpu_count)
+    thread_count = cpu_count;
+  if (thread_count > PARALLEL_MAX_THREADS)
+    thread_count = PARALLEL_MAX_THREADS;
+  if (thread_count > chunk_count)
+    thread_count = (int)chunk_count;
+  if (thread_count <= 1 || chunk_count < PARALLEL_MIN_CHUNKS)
+    return osl_format_columns(writefunc, userData, compiled, columns, row_count);
+
+  job.compiled = compiled;
+  job.columns = columns;
+  job.row_count = row_count;
+  job.chunk_count = chunk_count;
+  job.slot_count = thread_count * PARALLEL_SLOTS_PER_THREAD;
+  job.next = 0;
+  job.written = 0;
+  job.failed = 0;
+  job.slots = (OslParallelSlot*)calloc(job.slot_count, sizeof(OslParallelSlot));
+  if (job.slots == NULL) {
+    errno = ENOMEM;
+    return -1;
+  }
+
+  //a thread that fails to start leaves its share to the others
+  for (int i = 1; i < thread_count; i++) {
+    if (_parallel_thread_start(threads + started, &job))
+      started++;
+  }
+  while (job.written < chunk_count) {
+    OslParallelSlot* slot = job.slots + job.written % job.slot_count;
+    int64_t index;
+    int taken;
+    if (PARALLEL_LOAD_ACQUIRE(&slot->ready) == job.written + 1) {
+      if (slot->rv < 0 || slot->rv != slot->len
+        || (writefunc != NULL && slot->len > 0 && writefunc(userData, slot->data, slot->len) < 0)) {
+        rv = -1;
+        PARALLEL_STORE_RELEASE(&job.failed, 1);
+        break;
+      }
+      rv += slot->len;
+      //frees the slot for chunk written + slot_count
+      PARALLEL_STORE_RELEASE(&job.written, job.written + 1);
+      continue;
+    }
+    taken = _parallel_take(&job, &index);
+    if (taken > 0)
+      _parallel_format_chunk(&job, index);
+    else
+      PARALLEL_YIELD();
+  }
+  for (int i = 1; i < started; i++) {
+    _parallel_thread_join(threads[i]);
+  }
+
+  for (int i = 0; i < job.slot_count; i++) {
+    free(job.slots[i].data);
+  }
+  free(job.slots);
+  return rv;
+}
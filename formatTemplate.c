@@ -0,0 +1,178 @@
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "format.h"
+
+#ifndef FALSE
+#define FALSE 0
+#endif // FALSE
+
+#ifndef TRUE
+#define TRUE 1
+#endif // TRUE
+
+typedef int ibool;
+
+struct OslTemplateWriter {
+  char* pos;
+  intptr_t left;
+};
+
+static intptr_t _template_slot_write(struct OslTemplateWriter* writer, const char* sz, intptr_t len) {
+  if (len > writer->left)
+    return -1;
+  memcpy(writer->pos, sz, len * sizeof(char));
+  writer->pos += len;
+  writer->left -= len;
+  return len;
+}
+
+//the extension letters after %p, like _vformat_pointer_extension
+static int _template_pointer_extension(const char* psz) {
+  switch (psz[1]) {
+  case 'N': case 'X': case 'V': case 'M':
+    return 1;
+  case 'I':
+    return psz[2] == '4' || psz[2] == '6' ? 2 : 0;
+  case 'U':
+    return psz[2] && strchr("bBlL", psz[2]) ? 2 : 1;
+  case 'E':
+    return psz[2] && strchr("jcu", psz[2]) ? 2 : 1;
+  case 'h': case 'H':
+    return psz[2] && strchr("CDN", psz[2]) ? 2 : 1;
+  default:
+    return 0;
+  }
+}
+
+/// <summary>
+/// Scans %[flags][width][.precision][length]specifier.
+/// The width must be a fixed number, it is the size of the slot.
+/// </summary>
+/// <returns>the length of the conversion, 0 if it can not be a slot</returns>
+static intptr_t _template_scan_spec(const char* psz, int* pwidth) {
+  const char* pos = psz + 1;
+  int width = 0;
+  while (*pos == '-' || *pos == '+' || *pos == ' ' || *pos == '#' || *pos == '0') {
+    pos++;
+  }
+  while ('0' <= *pos && *pos <= '9') {
+    width = width * 10 + (*pos - '0');
+    pos++;
+  }
+  if (width == 0)
+    return 0;
+  if (*pos == '.') {
+    pos++;
+    while ('0' <= *pos && *pos <= '9') {
+      pos++;
+    }
+  }
+  while (*pos && strchr("hljztLIwDUR", *pos)) {
+    //%wf32 and %wb16 have a letter before the bits
+    if (*pos == 'w' && (pos[1] == 'f' || pos[1] == 'b'))
+      pos++;
+    pos++;
+    while ('0' <= *pos && *pos <= '9') {
+      pos++;
+    }
+  }
+  if (*pos == 0 || *pos == '*' || *pos == 'n')
+    return 0;
+  //%p extensions, %pI4, %pEc or %pHC have a second character
+  if (*pos == 'p')
+    pos += _template_pointer_extension(pos);
+  //%!c, a registered conversion
+  if (*pos == '!' && pos[1] != 0)
+    pos++;
+  pos++;
+  *pwidth = width;
+  return pos - psz;
+}
+
+/// <summary>
+/// Renders the literal text of format into buffer once and records a slot for every conversion.
+/// Each conversion needs a fixed width, which is the size of its slot; slots start out blank.
+/// Slots are sized in bytes, so a %Us or %UUs slot only takes strings whose padded output has
+/// as many bytes as the width, in practice ASCII. '%%' is a literal '%'.
+/// </summary>
+/// <param name="buffer">receives the line, it must outlive the template</param>
+/// <returns>the length of the line, or -1 if the buffer is too small,
+/// a conversion has no fixed width or there are more than OSL_TEMPLATE_MAX_SLOTS</returns>
+intptr_t osl_format_template_init(OslFormatTemplate* tpl, char* buffer, intptr_t size, const char* format) {
+  const char* psz = format;
+  char* pos = buffer;
+  char* end = buffer + size - 1;
+  tpl->buffer = buffer;
+  tpl->length = 0;
+  tpl->slot_count = 0;
+  if (size <= 0)
+    return -1;
+  while (*psz) {
+    if (*psz != '%' || psz[1] == '%') {
+      if (pos >= end)
+        break;
+      *pos = *psz;
+      pos++;
+      psz += *psz == '%' ? 2 : 1;
+      continue;
+    }
+    int width;
+    intptr_t spec_len = _template_scan_spec(psz, &width);
+    if (spec_len == 0 || spec_len >= OSL_TEMPLATE_SPEC_LENGTH
+      || tpl->slot_count >= OSL_TEMPLATE_MAX_SLOTS || end - pos < width) {
+      errno = EINVAL;
+      *buffer = 0;
+      return -1;
+    }
+    OslFormatSlot* slot = tpl->slots + tpl->slot_count;
+    slot->offset = pos - buffer;
+    slot->width = width;
+    memcpy(slot->spec, psz, spec_len * sizeof(char));
+    slot->spec[spec_len] = 0;
+    tpl->slot_count++;
+    memset(pos, ' ', width * sizeof(char));
+    pos += width;
+    psz += spec_len;
+  }
+  *pos = 0;
+  if (*psz) {
+    errno = ENOMEM;
+    return -1;
+  }
+  tpl->length = pos - buffer;
+  return tpl->length;
+}
+
+/// <summary>
+/// Formats the argument of one slot and rewrites only that slot of the line.
+/// A value wider than the slot fills the slot with '#'.
+/// </summary>
+/// <returns>the width of the slot, or -1 if the value did not fit</returns>
+intptr_t osl_format_template_vset(OslFormatTemplate* tpl, int slot_index, va_list argptr) {
+  struct OslTemplateWriter writer;
+  intptr_t rv;
+  if (slot_index < 0 || slot_index >= tpl->slot_count) {
+    errno = EINVAL;
+    return -1;
+  }
+  const OslFormatSlot* slot = tpl->slots + slot_index;
+  writer.pos = tpl->buffer + slot->offset;
+  writer.left = slot->width;
+  rv = osl_vformat((OslFormatWriteFunc)_template_slot_write, &writer, slot->spec, argptr);
+  if (rv != slot->width) {
+    memset(tpl->buffer + slot->offset, '#', slot->width * sizeof(char));
+    return -1;
+  }
+  return rv;
+}
+
+intptr_t osl_format_template_set(OslFormatTemplate* tpl, int slot_index, ...) {
+  intptr_t rv;
+  va_list argptr;
+  va_start(argptr, slot_index);
+  rv = osl_format_template_vset(tpl, slot_index, argptr);
+  va_end(argptr);
+  return rv;
+}
@@ -2,8 +2,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <ctype.h>
+#include <errno.h>
 #include <assert.h>  
 #include "format.h"
+#include "formatTestGenerated.h"
 #ifndef FALSE
 #define FALSE 0
 #endif // FALSE
@@ -399,7 +403,1655 @@ void osl_format_test_impl() {
     }
 }
 
+struct resume_sink_data {
+    char* buffer;
+    intptr_t count;
+    intptr_t capacity;
+};
+
+//accepts at most capacity bytes, then reports the sink as full
+static intptr_t _osl_resume_sink_write(struct resume_sink_data* arg, const char* sz, intptr_t len) {
+    intptr_t n = arg->capacity - arg->count;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(arg->buffer + arg->count, sz, n * sizeof(char));
+    arg->count += n;
+    return n;
+}
+
+static int _osl_resume_format(char* buffer, intptr_t chunk, const char* format, ...) {
+    struct resume_sink_data data;
+    OslFormatResume resume;
+    intptr_t rv;
+    va_list argptr;
+    data.buffer = buffer;
+    data.count = 0;
+    data.capacity = 0;
+    osl_format_resume_init(&resume);
+    do {
+        data.capacity += chunk;
+        va_start(argptr, format);
+        rv = osl_vformat_resume(&resume, (OslFormatWriteFunc)_osl_resume_sink_write, &data, format, argptr);
+        va_end(argptr);
+    } while (rv == OSL_FORMAT_WOULD_BLOCK);
+    if (rv < 0) {
+        buffer[0] = 0;
+        return -1;
+    }
+    assert(rv == data.count);
+    buffer[rv] = 0;
+    return (int)rv;
+}
+
+void osl_format_test_resume() {
+    printf("test resume\n");
+    char expect[512];
+    char buffer[512];
+    for (int chunk = 1; chunk < 40; chunk++) {
+        const char* format = "id=%-8d|%%|%*.*f|%s|%c%+.3e|%#x|%10s|";
+        snprintf(expect, sizeof(expect), format, 1234, 12, 3, 3.14159, "text", 'z', -1.5e10, 255u, "end");
+        _osl_resume_format(buffer, chunk, format, 1234, 12, 3, 3.14159, "text", 'z', -1.5e10, 255u, "end");
+        if (strcmp(expect, buffer) != 0) {
+            printf("resume chunk %d:\n'%s'\n'%s'\n", chunk, expect, buffer);
+        }
+    }
+}
+
+static int _osl_limit_format(char* buffer, intptr_t count, intptr_t max_bytes, const char* marker, const char* format, ...) {
+    struct vsnformat_data data;
+    intptr_t rv;
+    va_list argptr;
+    data.buffer = buffer;
+    data.count = count;
+    va_start(argptr, format);
+    rv = osl_vformat_limit((OslFormatWriteFunc)_osl_vsnformat_write, &data, max_bytes, marker, format, argptr);
+    va_end(argptr);
+    if (rv < 0) {
+        buffer[0] = 0;
+        return -1;
+    }
+    buffer[rv] = 0;
+    return (int)rv;
+}
+
+static intptr_t _osl_limit_sink_format(struct resume_sink_data* data, intptr_t max_bytes, const char* marker, const char* format, ...) {
+    intptr_t rv;
+    va_list argptr;
+    va_start(argptr, format);
+    rv = osl_vformat_limit((OslFormatWriteFunc)_osl_resume_sink_write, data, max_bytes, marker, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+void osl_format_test_limit() {
+    printf("test limit\n");
+    char expect[512];
+    char buffer[512];
+    const char* format = "id=%-8d|%*.*f|%s|%+.3e|%10s|";
+    int len = snprintf(expect, sizeof(expect), format, 1234, 12, 3, 3.14159, "text", -1.5e10, "end");
+    for (int max_bytes = 0; max_bytes <= len + 1; max_bytes++) {
+        int rv = _osl_limit_format(buffer, sizeof(buffer), max_bytes, "...", format, 1234, 12, 3, 3.14159, "text", -1.5e10, "end");
+        int shown = max_bytes < len ? max_bytes : len;
+        if (strncmp(expect, buffer, shown) != 0
+            || (max_bytes < len && strcmp(buffer + shown, "...") != 0)
+            || (max_bytes >= len && rv != len)) {
+            printf("limit %d:\n'%s'\n'%s'\n", max_bytes, expect, buffer);
+        }
+    }
+    //float digits past the limit are not converted, what is shown and later full output stay exact
+    const double values[] = { 1.0 / 3.0, -1e300, 5e-324 };
+    const char* formats[] = { "[%.500f]", "[%-+620.300e]", "[%0700.600f]" };
+    static char big_expect[2048];
+    static char big_buffer[2048];
+    for (int i = 0; i < 3; i++) {
+        for (int f = 0; f < 3; f++) {
+            len = snprintf(big_expect, sizeof(big_expect), formats[f], values[i]);
+            for (int max_bytes = 0; max_bytes <= len; max_bytes += 1 + max_bytes / 8) {
+                _osl_limit_format(big_buffer, sizeof(big_buffer), max_bytes, "...", formats[f], values[i]);
+                if (strncmp(big_expect, big_buffer, max_bytes) != 0
+                    || strcmp(big_buffer + max_bytes, max_bytes < len ? "..." : "") != 0) {
+                    printf("limit %s %d:\n'%s'\n'%s'\n", formats[f], max_bytes, big_expect, big_buffer);
+                }
+                osl_snprintf(big_buffer, sizeof(big_buffer), formats[f], values[i]);
+                if (strcmp(big_expect, big_buffer) != 0) {
+                    printf("limit %s after %d: '%s'\n", formats[f], max_bytes, big_buffer);
+                }
+            }
+        }
+    }
+    //output that ends exactly at the limit loses nothing
+    if (_osl_limit_format(buffer, sizeof(buffer), 3, "...", "abc%s%.0s", "", "x") != 3 || strcmp(buffer, "abc") != 0
+        || _osl_limit_format(buffer, sizeof(buffer), 3, "...", "abc%s", "d") != 6 || strcmp(buffer, "abc...") != 0) {
+        printf("limit exact: '%s'\n", buffer);
+    }
+    //a sink that takes only part of the marker is an error
+    struct resume_sink_data sink;
+    sink.buffer = buffer;
+    sink.count = 0;
+    sink.capacity = 5;
+    if (_osl_limit_sink_format(&sink, 3, "...", "abc%s", "def") != -1) {
+        printf("limit short marker accepted\n");
+    }
+}
+
+static int _osl_big_snprintf(char* buffer, intptr_t count, const char* format, ...) {
+    struct vsnformat_data data;
+    intptr_t rv;
+    va_list argptr;
+    data.buffer = buffer;
+    data.count = count;
+    va_start(argptr, format);
+    rv = osl_vformat((OslFormatWriteFunc)_osl_vsnformat_write, &data, format, argptr);
+    va_end(argptr);
+    buffer[rv < 0 ? 0 : rv] = 0;
+    return (int)rv;
+}
+
+void osl_format_test_precision() {
+    printf("test precision\n");
+    static char expect[4096];
+    static char buffer[4096];
+    char format[256];
+    const double values[] = { 0, 1.5, -1.0 / 3.0, 1e300, 5e-324, 2.2250738585072014e-308, 123456.789 };
+    const int precisions[] = { 100, 400, 511, 600, 800, 1100 };
+    const char* fpos;
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        for (size_t j = 0; j < sizeof(precisions) / sizeof(precisions[0]); j++) {
+            for (fpos = "aefg"; *fpos; fpos++) {
+                _osl_make_format_string(format, "#", precisions[j] + 10, precisions[j], *fpos);
+                snprintf(expect, sizeof(expect), format, values[i]);
+                _osl_big_snprintf(buffer, sizeof(buffer), format, values[i]);
+                if (strcmp(expect, buffer) != 0) {
+                    printf("fmt:'%s' %g\n'%s'\n'%s'\n", format, values[i], expect, buffer);
+                }
+            }
+        }
+    }
+}
+
+void osl_format_test_cache() {
+    printf("test cache\n");
+    char first[64];
+    char second[64];
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t old_hits;
+    uint64_t old_misses;
+    const double values[] = { 0.25, 1.0 / 3.0, -1234.5678, 9.999996 };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        ieee754d64tos_cache_stats(&old_hits, &old_misses);
+        //%.3f takes the fixed fast path, which needs no cache, %.20f does not
+        osl_snprintf(first, sizeof(first), "%.20f %g %e", values[i], values[i], values[i]);
+        osl_snprintf(second, sizeof(second), "%.20f %g %e", values[i], values[i], values[i]);
+        ieee754d64tos_cache_stats(&hits, &misses);
+        if (strcmp(first, second) != 0 || hits - old_hits != 3 || misses - old_misses != 3) {
+            printf("cache %g: '%s' '%s' hits:%d misses:%d\n", values[i], first, second,
+                (int)(hits - old_hits), (int)(misses - old_misses));
+        }
+    }
+}
+
+static void _osl_test_counter_range(uint64_t first, int count) {
+    OslFormatCounter counter;
+    char expect[128];
+    char buffer[128];
+    osl_format_counter_init(&counter, first);
+    for (int i = 0; i < count; i++) {
+        snprintf(expect, sizeof(expect), "%llu|%08llu|%-6llu|%.0llu", (unsigned long long)counter.value,
+            (unsigned long long)counter.value, (unsigned long long)counter.value, (unsigned long long)counter.value);
+        osl_snprintf(buffer, sizeof(buffer), "%pN|%08pN|%-6pN|%.0pN", &counter, &counter, &counter, &counter);
+        if (strcmp(expect, buffer) != 0) {
+            printf("counter:\n'%s'\n'%s'\n", expect, buffer);
+            return;
+        }
+        osl_format_counter_inc(&counter);
+    }
+}
+
+void osl_format_test_counter() {
+    printf("test counter\n");
+    _osl_test_counter_range(0, 100000);
+    _osl_test_counter_range(UINT64_C(9999999999999999990), 20);
+    _osl_test_counter_range(UINT64_MAX - 5, 10);
+}
+
+void osl_format_test_template() {
+    printf("test template\n");
+    OslFormatTemplate tpl;
+    char line[128];
+    char expect[128];
+    const char* format = "cpu %6.1f%% mem %12llu|%-5s|%04x|";
+    osl_format_template_init(&tpl, line, sizeof(line), format);
+    for (int i = 0; i < 50; i++) {
+        double cpu = i * 2.25;
+        unsigned long long mem = 1000000ull * i * i;
+        const char* state = (i % 3) ? "ok" : "busy";
+        osl_format_template_set(&tpl, 0, cpu);
+        if (i % 2 == 0)
+            osl_format_template_set(&tpl, 1, mem);
+        osl_format_template_set(&tpl, 2, state);
+        osl_format_template_set(&tpl, 3, (unsigned)i);
+        if (i % 2 == 1)
+            osl_format_template_set(&tpl, 1, mem);
+        snprintf(expect, sizeof(expect), format, cpu, mem, state, (unsigned)i);
+        if (strcmp(expect, line) != 0) {
+            printf("template:\n'%s'\n'%s'\n", expect, line);
+        }
+    }
+    if (osl_format_template_set(&tpl, 3, 0x12345u) != -1 || strstr(line, "|####|") == NULL) {
+        printf("template overflow: '%s'\n", line);
+    }
+    //the second letter of a %p extension belongs to the slot
+    if (osl_format_template_init(&tpl, line, sizeof(line), "[%8pEc][%-6pEj]") < 0
+        || osl_format_template_set(&tpl, 0, "a,b") < 0 || osl_format_template_set(&tpl, 1, "a\"b") < 0
+        || strcmp(line, "[   \"a,b\"][a\\\"b  ]") != 0) {
+        printf("template extension: '%s'\n", line);
+    }
+    //%Us and %UUs are one slot; the slot is sized in bytes, wider UTF-8 output does not fit
+    if (osl_format_template_init(&tpl, line, sizeof(line), "[%4Us][%-5UUs]") < 0
+        || osl_format_template_set(&tpl, 0, "ab") < 0 || osl_format_template_set(&tpl, 1, "xyz") < 0
+        || osl_format_template_set(&tpl, 1, "\xe6\x97\xa5") != -1 || strcmp(line, "[  ab][#####]") != 0) {
+        printf("template utf8: '%s'\n", line);
+    }
+    if (osl_format_template_init(&tpl, line, sizeof(line), "[%8wb16g][%6w16g][%4wf32d]") < 0
+        || osl_format_template_set(&tpl, 0, 0x3FC0) < 0 || osl_format_template_set(&tpl, 1, 0x3C00) < 0
+        || osl_format_template_set(&tpl, 2, (int_fast32_t)42) < 0 || strcmp(line, "[     1.5][     1][  42]") != 0) {
+        printf("template bit widths: '%s'\n", line);
+    }
+    if (osl_format_template_init(&tpl, line, sizeof(line), "[%7Rks][%-6RKB|][%5.1fK]") < 0
+        || osl_format_template_set(&tpl, 0, 0.25) < 0 || osl_format_template_set(&tpl, 1, 1536.0) < 0
+        || osl_format_template_set(&tpl, 2, 300.0) < 0 || strcmp(line, "[   250ms][1.5Ki B|][300.0K]") != 0) {
+        printf("template prefixed double: '%s'\n", line);
+    }
+}
+
+struct string_sink_data {
+    char* buffer;
+    intptr_t count;
+    intptr_t capacity;
+};
+
+static intptr_t _osl_string_sink_write(struct string_sink_data* arg, const char* sz, intptr_t len) {
+    if (arg->count + len >= arg->capacity) {
+        return -1;
+    }
+    memcpy(arg->buffer + arg->count, sz, len * sizeof(char));
+    arg->count += len;
+    arg->buffer[arg->count] = 0;
+    return len;
+}
+
+void osl_format_test_columns() {
+    printf("test columns\n");
+    enum { rows = 200 };
+    static int64_t ids[rows];
+    static uint64_t flags[rows];
+    static double prices[rows];
+    static OslStringView names[rows];
+    static char expect[rows * 96];
+    static char buffer[rows * 96];
+    const char* names_text[] = { "alpha", "beta", "gamma delta", "" };
+    const char* format = "%lld,%08.3f,%-6.4s|%#llx,%+.2e,%g\n";
+    OslCompiledFormat compiled;
+    OslFormatColumn columns[6];
+    struct string_sink_data data;
+    intptr_t len = 0;
+    for (int i = 0; i < rows; i++) {
+        ids[i] = (int64_t)i * 7919 - 500000;
+        flags[i] = (uint64_t)i * 2654435761u;
+        prices[i] = (i - 100) * 1.0625 + i / 7.0;
+        names[i].data = names_text[i % 4];
+        names[i].length = strlen(names_text[i % 4]);
+        len += snprintf(expect + len, sizeof(expect) - len, format, (long long)ids[i], prices[i],
+            names[i].data, (unsigned long long)flags[i], prices[i], prices[i]);
+    }
+    if (osl_format_compile(&compiled, format) != 6) {
+        printf("columns: compile failed\n");
+        return;
+    }
+    columns[0].type = OSL_COLUMN_INT64; columns[0].data = ids;
+    columns[1].type = OSL_COLUMN_DOUBLE; columns[1].data = prices;
+    columns[2].type = OSL_COLUMN_STRING; columns[2].data = names;
+    columns[3].type = OSL_COLUMN_UINT64; columns[3].data = flags;
+    columns[4].type = OSL_COLUMN_DOUBLE; columns[4].data = prices;
+    columns[5].type = OSL_COLUMN_DOUBLE; columns[5].data = prices;
+    data.buffer = buffer;
+    data.count = 0;
+    data.capacity = sizeof(buffer);
+    if (osl_format_columns((OslFormatWriteFunc)_osl_string_sink_write, &data, &compiled, columns, rows) != len
+        || strcmp(expect, buffer) != 0) {
+        printf("columns:\n'%.200s'\n'%.200s'\n", expect, buffer);
+    }
+}
+
+void osl_format_test_columns_parallel() {
+    printf("test columns parallel\n");
+    //more chunks than the slots of two threads, so the slot ring wraps
+    enum { rows = 50000 };
+    static int64_t ids[rows];
+    static double values[rows];
+    static char expect[rows * 40];
+    static char buffer[rows * 40];
+    const char* format = "%lld;%.4g;%e\n";
+    OslCompiledFormat compiled;
+    OslFormatColumn columns[3];
+    struct string_sink_data data;
+    intptr_t len = 0;
+    for (int i = 0; i < rows; i++) {
+        ids[i] = i;
+        values[i] = i / 3.0 - 1000;
+        len += snprintf(expect + len, sizeof(expect) - len, format, (long long)ids[i], values[i], values[i]);
+    }
+    osl_format_compile(&compiled, format);
+    columns[0].type = OSL_COLUMN_INT64; columns[0].data = ids;
+    columns[1].type = OSL_COLUMN_DOUBLE; columns[1].data = values;
+    columns[2].type = OSL_COLUMN_DOUBLE; columns[2].data = values;
+    //the threads run even on a single cpu
+    osl_format_parallel_set_cpu_count(8);
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        data.buffer = buffer;
+        data.count = 0;
+        data.capacity = sizeof(buffer);
+        if (osl_format_columns_parallel((OslFormatWriteFunc)_osl_string_sink_write, &data, &compiled, columns, rows, threads) != len
+            || strcmp(expect, buffer) != 0) {
+            printf("columns parallel %d threads: %d %d\n", threads, (int)len, (int)data.count);
+        }
+    }
+    osl_format_parallel_set_cpu_count(0);
+}
+
+void osl_format_test_join() {
+    printf("test join\n");
+    enum { count = 500 };
+    static int32_t values32[count];
+    static int64_t values64[count];
+    static uint64_t valuesu64[count];
+    static char expect[count * 32];
+    static char buffer[count * 32];
+    const char* formats[] = { "%d", "%5d", "%-4.3d", "%+d", "%x", "%u", "[%08d]" };
+    OslFormatColumn column;
+    struct string_sink_data data;
+    uint64_t seed = 88172645463325252u;
+    for (int i = 0; i < count; i++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        valuesu64[i] = seed >> (i % 64);
+        values64[i] = (int64_t)valuesu64[i] * (i % 2 ? -1 : 1);
+        values32[i] = (int32_t)values64[i];
+    }
+    for (int f = 0; f < (int)(sizeof(formats) / sizeof(formats[0])); f++) {
+        for (int type = 0; type < 3; type++) {
+            char element[16];
+            intptr_t len = 0;
+            //%+d of a uint64_t array keeps the sign like %d of int64_t, which %+llu has no counterpart for
+            if (type == 2 && strchr(formats[f], '+'))
+                continue;
+            for (int i = 0; i < count; i++) {
+                if (i > 0)
+                    len += snprintf(expect + len, sizeof(expect) - len, ", ");
+                if (type == 0) {
+                    len += snprintf(expect + len, sizeof(expect) - len, formats[f], values32[i]);
+                }
+                else {
+                    //the same conversion with ll for the 64 bit arrays, a uint64_t array prints %d as %u
+                    const char* percent = strchr(formats[f], '%');
+                    const char* conversion = percent + strcspn(percent, "dxu");
+                    snprintf(element, sizeof(element), "%.*sll%c%s", (int)(conversion - formats[f]), formats[f],
+                        type == 2 && *conversion == 'd' ? 'u' : *conversion, conversion + 1);
+                    len += snprintf(expect + len, sizeof(expect) - len, element,
+                        type == 1 ? (long long)values64[i] : (long long)valuesu64[i]);
+                }
+            }
+            column.type = type == 0 ? OSL_COLUMN_INT32 : type == 1 ? OSL_COLUMN_INT64 : OSL_COLUMN_UINT64;
+            column.data = type == 0 ? (const void*)values32 : type == 1 ? (const void*)values64 : (const void*)valuesu64;
+            data.buffer = buffer;
+            data.count = 0;
+            data.capacity = sizeof(buffer);
+            if (osl_format_join((OslFormatWriteFunc)_osl_string_sink_write, &data, formats[f], &column, count, ", ") != len
+                || strcmp(expect, buffer) != 0) {
+                printf("join %s type %d:\n'%.200s'\n'%.200s'\n", formats[f], type, expect, buffer);
+            }
+        }
+    }
+}
+
+void osl_format_test_fixed() {
+    printf("test fixed\n");
+    enum { count = 2000 };
+    static double values[count];
+    static char expect[count * 48];
+    static char buffer[count * 48];
+    const char* formats[] = { "%.3f", "%10.2f", "%-+12.6f", "%#.0f", "%015.4f", "% .15f", "%.1f" };
+    OslFormatColumn column;
+    struct string_sink_data data;
+    uint64_t seed = 88172645463325252u;
+    for (int i = 0; i < count; i++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        switch (i % 4) {
+        case 0: values[i] = (double)(int64_t)(seed % 2000001 - 1000000) / 1000; break;  //short decimals
+        case 1: values[i] = (double)(int64_t)(seed % 20001 - 10000) / 64; break;        //exact ties
+        case 2: values[i] = (double)(seed >> 11) / 9007199254740992.0 * (double)(seed % 100000); break;
+        default: values[i] = (double)(seed >> 12) * 1e10 * (i % 3 - 1); break;       //out of the fast path
+        }
+    }
+    column.type = OSL_COLUMN_DOUBLE;
+    column.data = values;
+    for (int f = 0; f < (int)(sizeof(formats) / sizeof(formats[0])); f++) {
+        intptr_t len = 0;
+        for (int i = 0; i < count; i++) {
+            len += snprintf(expect + len, sizeof(expect) - len, i > 0 ? ";" : "");
+            len += snprintf(expect + len, sizeof(expect) - len, formats[f], values[i]);
+        }
+        data.buffer = buffer;
+        data.count = 0;
+        data.capacity = sizeof(buffer);
+        if (osl_format_join((OslFormatWriteFunc)_osl_string_sink_write, &data, formats[f], &column, count, ";") != len
+            || strcmp(expect, buffer) != 0) {
+            printf("fixed %s:\n'%.200s'\n'%.200s'\n", formats[f], expect, buffer);
+        }
+    }
+}
+
+static const char* _osl_binary_reference(uint64_t value, char* buf, intptr_t size) {
+    char* pos = buf + size - 1;
+    *pos = 0;
+    do {
+        *--pos = '0' + (char)(value & 1);
+        value >>= 1;
+    } while (value != 0);
+    return pos;
+}
+
+void osl_format_test_length() {
+    printf("test length\n");
+    char buffer[256];
+    char expect[256];
+    char bits[3][72];
+    uint64_t seed = 88172645463325252u;
+    for (int i = 0; i < 2000; i++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        uint64_t value = i < 2 ? (uint64_t)i : seed >> (i % 64);
+        long l = (long)value;
+        size_t z = (size_t)value;
+        ptrdiff_t t = (ptrdiff_t)value;
+        intmax_t j = (intmax_t)value;
+        snprintf(expect, sizeof(expect), "%ld|%zu|%td|%jd|%hhd|%hd", l, z, t, j, (signed char)value, (short)value);
+        osl_snprintf(buffer, sizeof(buffer), "%ld|%zu|%td|%jd|%hhd|%hd", l, z, t, j, (signed char)value, (short)value);
+        if (strcmp(expect, buffer) != 0) {
+            printf("length:\n'%s'\n'%s'\n", expect, buffer);
+            break;
+        }
+        snprintf(expect, sizeof(expect), "%d|%d|%d|%lld|%d|%ld|%ld|%llu",
+            (int8_t)value, (int16_t)value, (int32_t)value, (long long)(int64_t)value,
+            (int_fast8_t)value, (long)(int_fast16_t)value, (long)(int_fast32_t)value, (unsigned long long)(uint_fast64_t)value);
+        osl_snprintf(buffer, sizeof(buffer), "%w8d|%w16d|%w32d|%w64d|%wf8d|%wf16d|%wf32d|%wf64u",
+            (int8_t)value, (int16_t)value, (int32_t)value, (int64_t)value,
+            (int_fast8_t)value, (int_fast16_t)value, (int_fast32_t)value, (uint_fast64_t)value);
+        if (strcmp(expect, buffer) != 0) {
+            printf("bit width:\n'%s'\n'%s'\n", expect, buffer);
+            break;
+        }
+        const char* binary = _osl_binary_reference(value, bits[0], sizeof(bits[0]));
+        const char* binary32 = _osl_binary_reference((uint32_t)value, bits[1], sizeof(bits[1]));
+        const char* binary8 = _osl_binary_reference((uint8_t)value, bits[2], sizeof(bits[2]));
+        snprintf(expect, sizeof(expect), "%s|%s%s|%s%s|%-70s|%.*s%s", binary,
+            (uint32_t)value ? "0b" : "", binary32, (uint8_t)value ? "0B" : "", binary8, binary,
+            12 - (int)strlen(binary8), "000000000000", binary8);
+        osl_snprintf(buffer, sizeof(buffer), "%llb|%#b|%#hhB|%-70llb|%.12hhb", (unsigned long long)value,
+            (unsigned int)value, (unsigned char)value, (unsigned long long)value, (unsigned char)value);
+        if (strcmp(expect, buffer) != 0) {
+            printf("binary:\n'%s'\n'%s'\n", expect, buffer);
+            break;
+        }
+    }
+}
+
+#if defined(__SIZEOF_INT128__)
+//one digit per 128 bit division, the reference for %w128
+static const char* _osl_u128_reference(osl_uint128_t value, unsigned int base, char* buf, intptr_t size) {
+    char* pos = buf + size - 1;
+    *pos = 0;
+    do {
+        *--pos = "0123456789abcdef"[(int)(value % base)];
+        value /= base;
+    } while (value != 0);
+    return pos;
+}
+
+void osl_format_test_int128() {
+    printf("test int128\n");
+    char buffer[256];
+    char expect[256];
+    char digits[64];
+    uint64_t seed = 88172645463325252u;
+    for (int i = 0; i < 20000; i++) {
+        osl_uint128_t value;
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        value = ((osl_uint128_t)seed << 64) | (seed * 2654435761u);
+        value >>= i % 128;
+        if (i < 78) {
+            //around the powers of ten
+            osl_uint128_t power = 1;
+            for (int k = 0; k < i % 39; k++)
+                power *= 10;
+            value = power - 1 + (i / 39);
+        }
+        else if (i == 78) {
+            value = ~(osl_uint128_t)0;
+        }
+        osl_int128_t signed_value = (osl_int128_t)value;
+        osl_uint128_t magnitude = signed_value < 0 ? (osl_uint128_t)0 - value : value;
+        //the reference helper reuses digits, copy each result out
+        char decimal[48], sdecimal[48], hex[48], octal[48];
+        strcpy(decimal, _osl_u128_reference(value, 10, digits, sizeof(digits)));
+        strcpy(sdecimal, _osl_u128_reference(magnitude, 10, digits, sizeof(digits)));
+        strcpy(hex, _osl_u128_reference(value, 16, digits, sizeof(digits)));
+        strcpy(octal, _osl_u128_reference(value, 8, digits, sizeof(digits)));
+        snprintf(expect, sizeof(expect), "%s|%s%s|%s|%s|%45s", decimal, signed_value < 0 ? "-" : "+", sdecimal, hex, octal, decimal);
+        osl_snprintf(buffer, sizeof(buffer), "%w128u|%+w128d|%w128x|%w128o|%45w128u", value, signed_value, value, value, value);
+        if (strcmp(expect, buffer) != 0) {
+            printf("int128:\n'%s'\n'%s'\n", expect, buffer);
+            break;
+        }
+    }
+}
+#endif // __SIZEOF_INT128__
+
+void osl_format_test_hex() {
+    printf("test hex\n");
+    static unsigned char data[300];
+    static char buffer[2048];
+    static char expect[2048];
+    const char* specs[] = { "%*ph", "%*phC", "%*phD", "%*phN", "%*pH", "%*pHC" };
+    const char separators[] = { ' ', ':', '-', 0, ' ', ':' };
+    for (int i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (unsigned char)(i * 37 + 11);
+    }
+    for (int len = 0; len < 300; len += 7) {
+        for (int k = 0; k < (int)(sizeof(specs) / sizeof(specs[0])); k++) {
+            intptr_t pos = 0;
+            for (int i = 0; i < len; i++) {
+                if (i > 0 && separators[k])
+                    expect[pos++] = separators[k];
+                pos += snprintf(expect + pos, sizeof(expect) - pos, k >= 4 ? "%02X" : "%02x", data[i]);
+            }
+            expect[pos] = 0;
+            osl_snprintf(buffer, sizeof(buffer), specs[k], len, data);
+            if (strcmp(expect, buffer) != 0) {
+                printf("hex %s %d:\n'%s'\n'%s'\n", specs[k], len, expect, buffer);
+            }
+        }
+    }
+    osl_snprintf(buffer, sizeof(buffer), "%6phC|%ph", data, data);
+    if (strcmp(buffer, "0b:30:55:7a:9f:c4|0b") != 0) {
+        printf("hex fixed length: '%s'\n", buffer);
+    }
+    osl_snprintf(buffer, sizeof(buffer), "%*pX", 19, "Hello, world!\n\0\1\2\3\4\5");
+    if (strcmp(buffer,
+        "00000000  48 65 6c 6c 6f 2c 20 77  6f 72 6c 64 21 0a 00 01  |Hello, world!...|\n"
+        "00000010  02 03 04                                          |...|\n") != 0) {
+        printf("hexdump:\n%s", buffer);
+    }
+}
+
+//one character at a time, the reference for %pE
+static intptr_t _osl_escape_reference(char* out, const char* sz, char mode) {
+    intptr_t pos = 0;
+    if (mode == 'c' && strpbrk(sz, "\",\r\n") != NULL) {
+        out[pos++] = '"';
+        for (; *sz; sz++) {
+            if (*sz == '"')
+                out[pos++] = '"';
+            out[pos++] = *sz;
+        }
+        out[pos++] = '"';
+    }
+    for (; mode != 'c' && *sz; sz++) {
+        unsigned char ch = (unsigned char)*sz;
+        if (mode == 'j' && (ch == '"' || ch == '\\'))
+            pos += sprintf(out + pos, "\\%c", ch);
+        else if (mode == 'j' && ch == '\n')
+            pos += sprintf(out + pos, "\\n");
+        else if (mode == 'j' && ch == '\t')
+            pos += sprintf(out + pos, "\\t");
+        else if (mode == 'j' && ch < 0x20 && ch != '\r' && ch != '\b' && ch != '\f')
+            pos += sprintf(out + pos, "\\u%04x", ch);
+        else if (mode == 'j' && ch < 0x20)
+            pos += sprintf(out + pos, "\\%c", ch == '\r' ? 'r' : ch == '\b' ? 'b' : 'f');
+        else if (mode == 'u' && !(isalnum(ch) || strchr("-._~", ch) != NULL))
+            pos += sprintf(out + pos, "%%%02X", ch);
+        else
+            out[pos++] = (char)ch;
+    }
+    if (mode == 'c' && pos == 0)
+        pos = strlen(strcpy(out, sz));
+    out[pos] = 0;
+    return pos;
+}
+
+void osl_format_test_escape() {
+    printf("test escape\n");
+    static char text[600];
+    static char buffer[4096];
+    static char expect[4096];
+    const char* specs[] = { "%pEj", "%pEc", "%pEu" };
+    const char alphabet[] = "abcXYZ019 -._~\"\\,\r\n\t\b\f\x01\x1f\x7f\xc3\xa9/%+";
+    uint64_t seed = 88172645463325252u;
+    for (int n = 0; n < 400; n++) {
+        //lengths and start offsets across the 16 byte blocks of the scan
+        int len = n % 97;
+        char* sz = text + (n % 16);
+        for (int i = 0; i < len; i++) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            sz[i] = n % 3 == 0 ? 'a' + (char)(i % 26) : alphabet[seed % (sizeof(alphabet) - 1)];
+        }
+        sz[len] = 0;
+        for (int k = 0; k < 3; k++) {
+            intptr_t expect_len = _osl_escape_reference(expect, sz, specs[k][3]);
+            if (osl_snprintf(buffer, sizeof(buffer), specs[k], sz) != expect_len || strcmp(expect, buffer) != 0) {
+                printf("escape %s: '%s' '%s'\n", specs[k], expect, buffer);
+            }
+        }
+    }
+    //width pads and precision cuts the escaped text, never inside an escape
+    osl_snprintf(buffer, sizeof(buffer), "[%12pEj][%-12pEu][%.5pEj][%.4pEu][%.3pEc]", "a\"b", "a b", "ab\ncd", "a b", "x,y");
+    if (strcmp(buffer, "[        a\\\"b][a%20b       ][ab\\nc][a%20][\"x\"]") != 0) {
+        printf("escape width: '%s'\n", buffer);
+    }
+    //a CSV field is only scanned as far as the precision, past it nothing is read
+    char field[8];
+    memcpy(field, "ab,cdefg", sizeof(field));
+    osl_snprintf(buffer, sizeof(buffer), "[%.2pEc][%.*pEc]", field, (int)sizeof(field), field);
+    if (strcmp(buffer, "[ab][\"ab,cde\"]") != 0) {
+        printf("escape csv precision: '%s'\n", buffer);
+    }
+}
+
+void osl_format_test_string() {
+    printf("test string\n");
+    char unterminated[40];
+    char buffer[512];
+    char expect[512];
+    OslStringView view;
+    memset(unterminated, 'x', sizeof(unterminated));
+    //the precision bounds the scan, the bytes after it are never read
+    for (int offset = 0; offset < 16; offset++) {
+        for (int precision = 0; precision <= 24; precision++) {
+            snprintf(expect, sizeof(expect), "[%.*s]", precision, "xxxxxxxxxxxxxxxxxxxxxxxx");
+            osl_snprintf(buffer, sizeof(buffer), "[%.*s]", precision, unterminated + offset);
+            if (strcmp(expect, buffer) != 0) {
+                printf("string %d %d: '%s' '%s'\n", offset, precision, expect, buffer);
+            }
+        }
+    }
+    snprintf(expect, sizeof(expect), "[%200s][%-150.3s][%.9s]", "right", "left", "abc");
+    osl_snprintf(buffer, sizeof(buffer), "[%200s][%-150.3s][%.9s]", "right", "left", "abc");
+    if (strcmp(expect, buffer) != 0) {
+        printf("string padding: '%s' '%s'\n", expect, buffer);
+    }
+    view.data = "view of a longer text";
+    view.length = 7;
+    osl_snprintf(buffer, sizeof(buffer), "[%pV][%10pV][%-9.4pV][%pV]", &view, &view, &view, NULL);
+    if (strcmp(buffer, "[view of][   view of][view     ][(null)]") != 0) {
+        printf("string view: '%s'\n", buffer);
+    }
+}
+
+//the bytes of the first count code points of sz, one lead byte at a time
+static intptr_t _osl_utf8_reference(const char* sz, intptr_t count, intptr_t* ppoints) {
+    intptr_t len = 0;
+    intptr_t points = 0;
+    while (sz[len] && points < count) {
+        len++;
+        while ((sz[len] & 0xC0) == 0x80)
+            len++;
+        points++;
+    }
+    *ppoints = points;
+    return len;
+}
+
+void osl_format_test_utf8() {
+    printf("test utf8\n");
+    //a, e acute, euro sign, an emoji and a CJK ideograph: 1, 2, 3, 4 and 3 bytes
+    const char* pieces[] = { "a", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xe6\x97\xa5" };
+    static char text[400];
+    char buffer[1024];
+    char expect[1024];
+    uint64_t seed = 88172645463325252u;
+    for (int n = 0; n < 300; n++) {
+        char* sz = text + n % 16;
+        intptr_t pos = 0;
+        int count = n % 80;
+        for (int i = 0; i < count; i++) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            const char* piece = pieces[n % 4 == 0 ? 0 : seed % 5];
+            memcpy(sz + pos, piece, strlen(piece));
+            pos += strlen(piece);
+        }
+        sz[pos] = 0;
+        int precision = (int)(seed % 90);
+        intptr_t points;
+        intptr_t len = _osl_utf8_reference(sz, precision, &points);
+        intptr_t all_points;
+        _osl_utf8_reference(sz, INTPTR_MAX, &all_points);
+        //%Us pads to 100 code points, %.*Us keeps whole characters
+        snprintf(expect, sizeof(expect), "[%*s%s][%.*s%*s]", (int)(100 - all_points), "", sz,
+            (int)len, sz, (int)(30 > points ? 30 - points : 0), "");
+        osl_snprintf(buffer, sizeof(buffer), "[%100Us][%-30.*Us]", sz, precision, sz);
+        if (strcmp(expect, buffer) != 0) {
+            printf("utf8 %d:\n'%s'\n'%s'\n", n, expect, buffer);
+        }
+    }
+    //display columns: the ideographs take 2, the combining acute accent 0
+    osl_snprintf(buffer, sizeof(buffer), "[%8UUs][%-4UUs][%.5UUs][%3UUs]",
+        "\xe6\x97\xa5\xe6\x9c\xac", "e\xcc\x81", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e", "ab");
+    if (strcmp(buffer, "[    \xe6\x97\xa5\xe6\x9c\xac][e\xcc\x81   ][\xe6\x97\xa5\xe6\x9c\xac][ ab]") != 0) {
+        printf("utf8 columns: '%s'\n", buffer);
+    }
+    //stray continuation bytes and truncated sequences count one each wherever the blocks fall
+    const char* broken[] = { "\x80", "\xbf\xbf", "\xe2\x82", "\xf0\x9f\x98", "a", "\xc3\xa9", "\xf0\x9f\x98\x80" };
+    char first[1024];
+    for (int n = 0; n < 40; n++) {
+        intptr_t length = 0;
+        for (int i = 0; i < 60; i++) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            const char* piece = n == 0 ? "\x80" : broken[seed % 7];
+            memcpy(text + 16 + length, piece, strlen(piece));
+            length += strlen(piece);
+        }
+        for (int offset = 0; offset < 16; offset++) {
+            memmove(text + offset, text + 16, length);
+            text[offset + length] = 0;
+            osl_snprintf(buffer, sizeof(buffer), "[%150Us][%.*Us]", text + offset, n, text + offset);
+            if (offset == 0) {
+                strcpy(first, buffer);
+            }
+            else if (strcmp(first, buffer) != 0) {
+                printf("utf8 offset %d %d:\n'%s'\n'%s'\n", n, offset, first, buffer);
+            }
+            memmove(text + 16, text + offset, length);
+        }
+    }
+    memset(text, 0x80, 32);
+    for (int offset = 0; offset < 16; offset++) {
+        text[offset + 32] = 0;
+        osl_snprintf(buffer, sizeof(buffer), "[%40Us]", text + offset);
+        if (strlen(buffer) != 42) {
+            printf("utf8 continuation bytes at %d: %d\n", offset, (int)strlen(buffer));
+        }
+        text[offset + 32] = (char)0x80;
+    }
+    if (osl_snprintf(buffer, sizeof(buffer), "%Ud", 1) != -1 || errno != EINVAL) {
+        printf("utf8 %%Ud accepted\n");
+    }
+}
+
+//value / 10^scale to precision digits by decimal string arithmetic, ties to even
+static void _osl_scaled_reference(char* out, int64_t value, int scale, int precision) {
+    char digits[128];
+    char* pos = out;
+    int len;
+    int keep;
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    //enough leading zeros that there is an integer digit
+    len = snprintf(digits, sizeof(digits), "%0*llu", scale + 1, (unsigned long long)magnitude);
+    keep = len - scale + (precision < scale ? precision : scale);
+    if (precision < scale) {
+        int round_up = digits[keep] > '5';
+        if (digits[keep] == '5') {
+            round_up = (digits[keep - 1] - '0') & 1;
+            for (int i = keep + 1; i < len; i++) {
+                if (digits[i] != '0')
+                    round_up = 1;
+            }
+        }
+        for (int i = keep - 1; round_up && i >= 0; i--) {
+            round_up = digits[i] == '9';
+            digits[i] = round_up ? '0' : digits[i] + 1;
+        }
+        if (round_up) {
+            memmove(digits + 1, digits, keep);
+            digits[0] = '1';
+            keep++;
+        }
+    }
+    if (value < 0)
+        *pos++ = '-';
+    int int_len = keep - (precision < scale ? precision : scale);
+    memcpy(pos, digits, int_len);
+    pos += int_len;
+    if (precision > 0) {
+        *pos++ = '.';
+        memcpy(pos, digits + int_len, keep - int_len);
+        pos += keep - int_len;
+        for (int i = scale; i < precision; i++)
+            *pos++ = '0';
+    }
+    *pos = 0;
+}
+
+void osl_format_test_scaled() {
+    printf("test scaled\n");
+    char buffer[256];
+    char expect[256];
+    uint64_t seed = 88172645463325252u;
+    const int64_t edges[] = { 0, 1, -1, 5, 15, 25, -25, 995, 1005, 999999, INT64_MAX, INT64_MIN };
+    for (int n = 0; n < 20000; n++) {
+        int64_t value;
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        if (n < 12 * 8) {
+            value = edges[n % 12];
+        }
+        else {
+            value = (int64_t)(seed >> (seed % 64));
+            if (seed & 1)
+                value = -value;
+        }
+        int scale = (int)((seed >> 8) % 23);
+        int precision = (int)((seed >> 16) % 25);
+        _osl_scaled_reference(expect, value, scale, precision);
+        osl_snprintf(buffer, sizeof(buffer), "%.*Q", precision, value, scale);
+        if (strcmp(expect, buffer) != 0) {
+            printf("scaled %lld %d %d: '%s' '%s'\n", (long long)value, scale, precision, expect, buffer);
+        }
+        //without a precision all digits of the scale are printed
+        _osl_scaled_reference(expect, value, scale, scale);
+        osl_snprintf(buffer, sizeof(buffer), "%Q", value, scale);
+        if (strcmp(expect, buffer) != 0) {
+            printf("scaled %lld %d: '%s' '%s'\n", (long long)value, scale, expect, buffer);
+        }
+    }
+    osl_snprintf(buffer, sizeof(buffer), "[%10Q][%-+9.1Q][%010.2Q][% Q][%#.0Q][%.0Q][%s]",
+        (int64_t)123456, 3, (int64_t)-150, 2, (int64_t)-12345, 4, (int64_t)42, 0, (int64_t)7, 0, (int64_t)25, 1, "end");
+    if (strcmp(buffer, "[   123.456][-1.5     ][-000001.23][ 42][7.][2][end]") != 0) {
+        printf("scaled flags: '%s'\n", buffer);
+    }
+}
+
+//BID decimal64 of (-1)^negative * coefficient * 10^exponent
+static OslDecimal64 _osl_bid64(int negative, uint64_t coefficient, int exponent) {
+    OslDecimal64 value;
+    uint64_t biased = (uint64_t)(exponent + 398);
+    if (coefficient < (UINT64_C(1) << 53))
+        value.bits = (biased << 53) | coefficient;
+    else
+        value.bits = (UINT64_C(3) << 61) | (biased << 51) | (coefficient & ((UINT64_C(1) << 51) - 1));
+    if (negative)
+        value.bits |= UINT64_C(1) << 63;
+    return value;
+}
+
+static OslDecimal128 _osl_bid128(int negative, uint64_t coefficient_high, uint64_t coefficient_low, int exponent) {
+    OslDecimal128 value;
+    value.high = ((uint64_t)(exponent + 6176) << 49) | coefficient_high;
+    value.low = coefficient_low;
+    if (negative)
+        value.high |= UINT64_C(1) << 63;
+    return value;
+}
+
+void osl_format_test_decimal() {
+    printf("test decimal\n");
+    char buffer[512];
+    char expect[512];
+    uint64_t seed = 88172645463325252u;
+    OslDecimal64 special;
+    OslDecimal128 wide;
+    for (int n = 0; n < 20000; n++) {
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        int negative = (int)(seed & 1);
+        uint64_t coefficient = (seed >> 8) % UINT64_C(10000000000000000);
+        coefficient >>= (seed >> 1) % 50;
+        if (coefficient == 0)
+            negative = 0; //an int64 has no -0
+        int exponent = -(int)((seed >> 2) % 21);
+        int precision = (int)((seed >> 3) % 21);
+        _osl_scaled_reference(expect, negative ? -(int64_t)coefficient : (int64_t)coefficient, -exponent, precision);
+        osl_snprintf(buffer, sizeof(buffer), "%.*Df", precision, _osl_bid64(negative, coefficient, exponent));
+        if (strcmp(expect, buffer) != 0) {
+            printf("decimal64 f %llu %d %d: '%s' '%s'\n", (unsigned long long)coefficient, exponent, precision, expect, buffer);
+        }
+        //integers below 2^53 are exact doubles
+        coefficient &= (UINT64_C(1) << 50) - 1;
+        exponent = (int)((seed >> 5) % 3);
+        for (int i = 0; i < exponent; i++)
+            coefficient /= 10;
+        double value = (double)coefficient * (exponent == 0 ? 1 : exponent == 1 ? 10 : 100);
+        if (negative)
+            value = -value;
+        snprintf(expect, sizeof(expect), "%.*e|%.*G|%#.*g|%.*f", precision, value, precision, value, precision, value,
+            precision, value);
+        osl_snprintf(buffer, sizeof(buffer), "%.*De|%.*DG|%#.*Dg|%.*Df", precision, _osl_bid64(negative, coefficient, exponent),
+            precision, _osl_bid64(negative, coefficient, exponent), precision, _osl_bid64(negative, coefficient, exponent),
+            precision, _osl_bid64(negative, coefficient, exponent));
+        if (strcmp(expect, buffer) != 0) {
+            printf("decimal64 eg %llu %d %d: '%s' '%s'\n", (unsigned long long)coefficient, exponent, precision, expect, buffer);
+        }
+    }
+    //the large coefficient form, zeros keep their exponent out of the output
+    osl_snprintf(buffer, sizeof(buffer), "[%Df][%12.3Df][%-+10.1De][%De][%Dg]", _osl_bid64(0, UINT64_C(9999999999999999), -4),
+        _osl_bid64(1, 15, -1), _osl_bid64(0, 25, 1), _osl_bid64(1, 0, -5), _osl_bid64(0, 1, 20));
+    if (strcmp(buffer, "[999999999999.999900][      -1.500][+2.5e+02  ][-0.000000e+00][1e+20]") != 0) {
+        printf("decimal64: '%s'\n", buffer);
+    }
+    special.bits = UINT64_C(0x7800000000000000);
+    osl_snprintf(buffer, sizeof(buffer), "[%Df][%DF]", special, _osl_bid64(1, 0, 0));
+    special.bits = UINT64_C(0x7C00000000000000);
+    osl_snprintf(buffer + strlen(buffer), sizeof(buffer) - strlen(buffer), "[%Dg]", special);
+    //non-canonical coefficients are zero
+    special.bits = UINT64_C(0x6FFFFFFFFFFFFFFF);
+    osl_snprintf(buffer + strlen(buffer), sizeof(buffer) - strlen(buffer), "[%.1Df]", special);
+    if (strcmp(buffer, "[inf][-0.000000][nan][0.0]") != 0) {
+        printf("decimal64 special: '%s'\n", buffer);
+    }
+    //1234567890123456789012345678901234e-30 and 10^34 - 1
+    wide = _osl_bid128(0, UINT64_C(0x3cde6fff9732), UINT64_C(0xde825cd07e96aff2), -30);
+    osl_snprintf(buffer, sizeof(buffer), "[%.10DDf][%DDe][%.40DDg][%.0DDf][%DDg][%DDf]", wide, wide, wide,
+        _osl_bid128(1, UINT64_C(0x1ed09bead87c0), UINT64_C(0x378d8e63ffffffff), 0), _osl_bid128(0, 0, 1, 6111),
+        _osl_bid128(0, UINT64_C(0x1ed09bead87c0), UINT64_C(0x378d8e63ffffffff) + 1, 0));
+    if (strcmp(buffer, "[1234.5678901235][1.234568e+03][1234.567890123456789012345678901234]"
+        "[-9999999999999999999999999999999999][1e+6111][0.000000]") != 0) {
+        printf("decimal128: '%s'\n", buffer);
+    }
+}
+
+//binary16 (type 1) or bfloat16 (type 2) bits as a double, by doubling and halving
+static double _osl_small_float_reference(uint32_t bits, int type) {
+    int mantissa_bits = type == 1 ? 10 : 7;
+    int bias = type == 1 ? 15 : 127;
+    int exponent = (int)((bits & 0x7FFF) >> mantissa_bits);
+    double value = (double)(bits & ((1u << mantissa_bits) - 1));
+    if (exponent != 0)
+        value += (double)(1u << mantissa_bits);
+    else
+        exponent = 1;
+    for (int i = exponent - bias - mantissa_bits; i > 0; i--)
+        value *= 2;
+    for (int i = exponent - bias - mantissa_bits; i < 0; i++)
+        value /= 2;
+    return (bits & 0x8000) ? -value : value;
+}
+
+//whether text reads back as bits: it must lie between the midpoints to the neighbours, on one only if bits is even
+static int _osl_small_float_reads_back(const char* text, uint32_t bits, int type) {
+    uint32_t infinity = type == 1 ? 0x7C00 : 0x7F80;
+    double value = _osl_small_float_reference(bits, type);
+    double below = _osl_small_float_reference(bits - 1, type);
+    double above = bits + 1 < infinity ? _osl_small_float_reference(bits + 1, type) : value + (value - below);
+    double low = (below + value) / 2;
+    double high = (value + above) / 2;
+    double parsed = strtod(text[0] == '-' ? text + 1 : text, NULL);
+    if (bits & 1)
+        return low < parsed && parsed < high;
+    return low <= parsed && parsed <= high;
+}
+
+void osl_format_test_small_float() {
+    printf("test small float\n");
+    static const char* formats[3] = { NULL, "%#w16g", "%#wb16g" };
+    static const char* fixed_formats[3] = { NULL, "%w16e|%.4w16g|%w16g|%.0w16e|%.12w16G|%#.3w16g|%.20w16e",
+        "%wb16e|%.4wb16g|%wb16g|%.0wb16e|%.12wb16G|%#.3wb16g|%.20wb16e" };
+    static uint16_t column[65536];
+    static char joined[65536 * 16];
+    char buffer[128];
+    char expect[128];
+    for (int type = 1; type <= 2; type++) {
+        uint32_t infinity = type == 1 ? 0x7C00 : 0x7F80;
+        intptr_t pos = 0;
+        for (uint32_t bits = 0; bits < 65536; bits++) {
+            double value = _osl_small_float_reference(bits, type);
+            uint32_t magnitude = bits & 0x7FFF;
+            osl_snprintf(buffer, sizeof(buffer), formats[type], (uint16_t)bits);
+            column[bits] = (uint16_t)bits;
+            pos += sprintf(joined + pos, "%s%s", bits ? "," : "", buffer);
+            if (magnitude > infinity)
+                continue;
+            if (magnitude == 0 || magnitude == infinity) {
+                //as %#g of the double
+                if (magnitude == 0)
+                    osl_snprintf(expect, sizeof(expect), "%#g", value);
+                else
+                    strcpy(expect, bits > 0x7FFF ? "-inf" : "inf");
+                if (strcmp(expect, buffer) != 0)
+                    printf("small float %d %04x: '%s' '%s'\n", type, bits, expect, buffer);
+                continue;
+            }
+            //shortest: reads back, and one digit less rounded to nearest does not
+            if (!_osl_small_float_reads_back(buffer, magnitude, type) || (buffer[0] == '-') != (bits > 0x7FFF)) {
+                printf("small float %d %04x: '%s' does not read back\n", type, bits, buffer);
+            }
+            int digits = 0;
+            int leading = 1;
+            for (const char* psz = buffer; *psz && *psz != 'e'; psz++) {
+                if (*psz >= '1' && *psz <= '9')
+                    leading = 0;
+                if (*psz >= '0' && *psz <= '9' && !leading)
+                    digits++;
+            }
+            //trailing zeros of an integer are not significant
+            for (const char* psz = buffer + strlen(buffer) - 1; digits > 1 && strchr(buffer, '.') == NULL
+                && strchr(buffer, 'e') == NULL && *psz == '0'; psz--)
+                digits--;
+            if (digits > 1) {
+                snprintf(expect, sizeof(expect), "%.*e", digits - 2, value < 0 ? -value : value);
+                if (_osl_small_float_reads_back(expect, magnitude, type))
+                    printf("small float %d %04x: '%s' is shorter than '%s'\n", type, bits, expect, buffer);
+            }
+            //e and g round the exact value like the conversions of the double
+            osl_snprintf(expect, sizeof(expect), "%e|%.4g|%g|%.0e|%.12G|%#.3g|%.20e", value, value, value, value, value, value, value);
+            osl_snprintf(buffer, sizeof(buffer), fixed_formats[type], (uint16_t)bits, (uint16_t)bits, (uint16_t)bits,
+                (uint16_t)bits, (uint16_t)bits, (uint16_t)bits, (uint16_t)bits);
+            if (strcmp(expect, buffer) != 0)
+                printf("small float %d %04x: '%s' '%s'\n", type, bits, expect, buffer);
+            if (bits % 61 == 0) {
+                snprintf(expect, sizeof(expect), "%.3f|%.4a", value, value);
+                osl_snprintf(buffer, sizeof(buffer), type == 1 ? "%.3w16f|%.4w16a" : "%.3wb16f|%.4wb16a", (uint16_t)bits, (uint16_t)bits);
+                if (strcmp(expect, buffer) != 0)
+                    printf("small float %d %04x: '%s' '%s'\n", type, bits, expect, buffer);
+            }
+        }
+        //the array form gives the same text as one conversion per element
+        static char batch[65536 * 16];
+        struct vsnformat_data data;
+        OslFormatColumn values;
+        values.type = type == 1 ? OSL_COLUMN_FLOAT16 : OSL_COLUMN_BFLOAT16;
+        values.data = column;
+        data.buffer = batch;
+        data.count = sizeof(batch);
+        intptr_t rv = osl_format_join((OslFormatWriteFunc)_osl_vsnformat_write, &data, "%#g", &values, 65536, ",");
+        if (rv != pos || memcmp(batch, joined, pos) != 0) {
+            printf("small float join %d: %lld %lld\n", type, (long long)rv, (long long)pos);
+        }
+    }
+    //%w16d is still an int16_t
+    //%g has the 6 digits of C, %#g the shortest ones
+    osl_snprintf(buffer, sizeof(buffer), "[%w16d][%8w16g][%-8wb16g][%+#w16g][%w16g][%#w16g]", -2, (uint16_t)0x3C00, (uint16_t)0x3F80,
+        (uint16_t)0x3555, (uint16_t)0x2E66, (uint16_t)0x2E66);
+    if (strcmp(buffer, "[-2][       1][1       ][+0.3333][0.0999756][0.1]") != 0) {
+        printf("small float: '%s'\n", buffer);
+    }
+}
+
+struct wide_data {
+    uint32_t units[2048];
+    intptr_t count;
+};
+
+//collects the code units of any width as uint32_t
+static intptr_t _osl_wide16_write(struct wide_data* arg, const char16_t* sz, intptr_t len) {
+    for (intptr_t i = 0; i < len; i++)
+        arg->units[arg->count++] = sz[i];
+    return len;
+}
+
+static intptr_t _osl_wide32_write(struct wide_data* arg, const char32_t* sz, intptr_t len) {
+    for (intptr_t i = 0; i < len; i++)
+        arg->units[arg->count++] = sz[i];
+    return len;
+}
+
+static intptr_t _osl_widew_write(struct wide_data* arg, const wchar_t* sz, intptr_t len) {
+    for (intptr_t i = 0; i < len; i++)
+        arg->units[arg->count++] = (uint32_t)sz[i];
+    return len;
+}
+
+static intptr_t _osl_format16(struct wide_data* data, const char* format, ...) {
+    va_list argptr;
+    intptr_t rv;
+    data->count = 0;
+    va_start(argptr, format);
+    rv = osl_vformat16((OslFormatWriteFunc16)_osl_wide16_write, data, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+//the code units of the UTF-16 (bits 16) or UTF-32 output, measured with a NULL writefunc
+static intptr_t _osl_wide_measure(int bits, const char* format, ...) {
+    va_list argptr;
+    intptr_t rv;
+    va_start(argptr, format);
+    rv = bits == 16 ? osl_vformat16(NULL, NULL, format, argptr) : osl_vformat32(NULL, NULL, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+static intptr_t _osl_format16_wide(struct wide_data* data, const char16_t* format, ...) {
+    va_list argptr;
+    intptr_t rv;
+    data->count = 0;
+    va_start(argptr, format);
+    rv = osl_vformat16_wide((OslFormatWriteFunc16)_osl_wide16_write, data, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+static intptr_t _osl_format32_wide(struct wide_data* data, const char32_t* format, ...) {
+    va_list argptr;
+    intptr_t rv;
+    data->count = 0;
+    va_start(argptr, format);
+    rv = osl_vformat32_wide((OslFormatWriteFunc32)_osl_wide32_write, data, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+static intptr_t _osl_formatw_wide(struct wide_data* data, const wchar_t* format, ...) {
+    va_list argptr;
+    intptr_t rv;
+    data->count = 0;
+    va_start(argptr, format);
+    rv = osl_vformatw_wide((OslFormatWriteFuncW)_osl_widew_write, data, format, argptr);
+    va_end(argptr);
+    return rv;
+}
+
+static int _osl_wide_equal16(const struct wide_data* data, intptr_t rv, const char16_t* expect) {
+    intptr_t len = 0;
+    while (expect[len])
+        len++;
+    if (rv != len || data->count != len)
+        return 0;
+    for (intptr_t i = 0; i < len; i++) {
+        if (data->units[i] != expect[i])
+            return 0;
+    }
+    return 1;
+}
+
+static int _osl_wide_equal32(const struct wide_data* data, intptr_t rv, const char32_t* expect) {
+    intptr_t len = 0;
+    while (expect[len])
+        len++;
+    if (rv != len || data->count != len)
+        return 0;
+    for (intptr_t i = 0; i < len; i++) {
+        if (data->units[i] != expect[i])
+            return 0;
+    }
+    return 1;
+}
+
+void osl_format_test_wide() {
+    printf("test wide\n");
+    static struct wide_data data;
+    static char text[1200];
+    static char16_t expect[1200];
+    intptr_t rv;
+    intptr_t len = 0;
+    intptr_t units = 0;
+    //the euro sign is one UTF-16 unit, the emoji a surrogate pair
+    rv = _osl_format16(&data, "[%5d][%-4Us][%s][%x]", 42, "\xe2\x82\xac", "\xf0\x9f\x98\x80", 255);
+    if (!_osl_wide_equal16(&data, rv, u"[   42][\u20ac   ][\U0001F600][ff]")) {
+        printf("wide utf16\n");
+    }
+    rv = _osl_format16_wide(&data, u"\u00e9t\u00e9 %s %.2f \U0001F600", "\xc3\xa9", 1.5);
+    if (!_osl_wide_equal16(&data, rv, u"\u00e9t\u00e9 \u00e9 1.50 \U0001F600")) {
+        printf("wide utf16 format\n");
+    }
+    rv = _osl_format32_wide(&data, U"%s|%3Us|\U0001F600", "\xf0\x9f\x98\x80", "\xe6\x97\xa5");
+    if (!_osl_wide_equal32(&data, rv, U"\U0001F600|  \u65e5|\U0001F600")) {
+        printf("wide utf32\n");
+    }
+    rv = _osl_formatw_wide(&data, L"%d-%s", -7, "ab");
+    if (rv != 5 || data.units[0] != '-' || data.units[1] != '7' || data.units[2] != '-' || data.units[4] != 'b') {
+        printf("wide wchar_t\n");
+    }
+    //bytes that are not UTF-8 become U+FFFD
+    rv = _osl_format16(&data, "[%s]", "a\xffz\xe2\x82");
+    if (!_osl_wide_equal16(&data, rv, u"[a\ufffdz\ufffd]")) {
+        printf("wide invalid\n");
+    }
+    //widths and precisions of %s count output code units and never cut a character
+    char euros[61];
+    for (int i = 0; i < 20; i++) {
+        memcpy(euros + 3 * i, "\xe2\x82\xac", 3);
+    }
+    euros[60] = 0;
+    rv = _osl_format16(&data, "%25s", euros);
+    if (rv != 25 || data.units[4] != ' ' || data.units[5] != 0x20AC) {
+        printf("wide block width\n");
+    }
+    rv = _osl_format16(&data, "[%5s][%-4s][%.1s][%.2s]", "\xc3\xa9", "\xf0\x9f\x98\x80", "\xf0\x9f\x98\x80", "\xf0\x9f\x98\x80");
+    if (!_osl_wide_equal16(&data, rv, u"[    \u00e9][\U0001F600  ][][\U0001F600]")) {
+        printf("wide utf16 width\n");
+    }
+    rv = _osl_format32_wide(&data, U"[%5s][%-4s][%.1s]", "\xc3\xa9", "\xf0\x9f\x98\x80", "\xf0\x9f\x98\x80");
+    if (!_osl_wide_equal32(&data, rv, U"[    \u00e9][\U0001F600   ][\U0001F600]")) {
+        printf("wide utf32 width\n");
+    }
+    //longer than the stack buffer of the converter
+    for (int i = 0; i < 300; i++) {
+        if (i % 7 == 3) {
+            memcpy(text + len, "\xf0\x9f\x98\x80", 4);
+            len += 4;
+            expect[units++] = 0xD83D;
+            expect[units++] = 0xDE00;
+        } else {
+            text[len++] = 'a' + i % 26;
+            expect[units++] = 'a' + i % 26;
+        }
+    }
+    text[len] = 0;
+    expect[units] = 0;
+    rv = _osl_format16(&data, "%s", text);
+    if (!_osl_wide_equal16(&data, rv, expect)) {
+        printf("wide long\n");
+    }
+    rv = _osl_format16(&data, "%*s", (int)units + 3, text);
+    if (rv != units + 3 || data.units[2] != ' ' || data.units[3] != 'a') {
+        printf("wide long width\n");
+    }
+    //a NULL writefunc measures the output in code units
+    if (_osl_wide_measure(16, "%s", text) != units || _osl_wide_measure(32, "[%s]", "\xf0\x9f\x98\x80") != 3) {
+        printf("wide measure\n");
+    }
+}
+
+//%k or %K of value with precision significant digits, from %Q and %f of the scaled value
+static void _osl_prefixed_reference(char* expect, int64_t value, int iec, int precision) {
+    static const char* si[7] = { "", "k", "M", "G", "T", "P", "E" };
+    static const char* binary[7] = { "", "Ki", "Mi", "Gi", "Ti", "Pi", "Ei" };
+    uint64_t radix = iec ? 1024 : 1000;
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+    uint64_t unit = 1;
+    int index = 0;
+    char whole[24];
+    if (precision == 0)
+        precision = 1;
+    while (index < 6 && magnitude / unit >= radix) {
+        unit *= radix;
+        index++;
+    }
+    for (;;) {
+        int len = osl_snprintf(whole, sizeof(whole), "%llu", (unsigned long long)(magnitude / unit));
+        int fraction = precision > len ? precision - len : 0;
+        if (iec)
+            osl_snprintf(expect, 64, "%.*f", fraction, (double)value / (double)unit);
+        else
+            osl_snprintf(expect, 64, "%.*Q", fraction, value, 3 * index);
+        if (strtoull(expect + (value < 0), NULL, 10) != radix || index == 6)
+            break;
+        unit *= radix;
+        index++;
+    }
+    if (strchr(expect, '.')) {
+        char* end = expect + strlen(expect);
+        while (end[-1] == '0')
+            end--;
+        if (end[-1] == '.')
+            end--;
+        *end = 0;
+    }
+    strcat(expect, iec ? binary[index] : si[index]);
+}
+
+void osl_format_test_prefixed() {
+    printf("test prefixed\n");
+    char buffer[256];
+    char expect[256];
+    uint64_t seed = 88172645463325252u;
+    const int64_t edges[] = { 0, 1, -1, 999, 1000, 1023, 1024, 1536, 999499, 999500, 1048063, INT64_MAX, INT64_MIN };
+    for (int n = 0; n < 20000; n++) {
+        int64_t value;
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        if (n < 13 * 8) {
+            value = edges[n % 13];
+        }
+        else {
+            value = (int64_t)(seed >> (seed % 64));
+            if (seed & 1)
+                value = -value;
+        }
+        int precision = (int)((seed >> 16) % 13);
+        _osl_prefixed_reference(expect, value, 0, precision);
+        osl_snprintf(buffer, sizeof(buffer), "%.*llk", precision, (long long)value);
+        if (strcmp(expect, buffer) != 0) {
+            printf("prefixed %lld %d: '%s' '%s'\n", (long long)value, precision, expect, buffer);
+        }
+        //doubles are exact up to 2^53
+        if (value < (INT64_C(1) << 53) && value > -(INT64_C(1) << 53)) {
+            _osl_prefixed_reference(expect, value, 1, precision);
+            osl_snprintf(buffer, sizeof(buffer), "%.*llK", precision, (long long)value);
+            if (strcmp(expect, buffer) != 0) {
+                printf("prefixed iec %lld %d: '%s' '%s'\n", (long long)value, precision, expect, buffer);
+            }
+            if (value != 0) {
+                osl_snprintf(buffer, sizeof(buffer), "%.*RK", precision, (double)value);
+                if (strcmp(expect, buffer) != 0) {
+                    printf("prefixed iec double %lld %d: '%s' '%s'\n", (long long)value, precision, expect, buffer);
+                }
+            }
+        }
+    }
+    osl_snprintf(buffer, sizeof(buffer), "[%k][%k][%K][%llKB][%.2k][%#k][%8.1KB][%-6k|][%+k][%hhk]",
+        999, 1500, 1536, (long long)3435973837, 999500, 1000, 1048576, 12, 1234, 200);
+    if (strcmp(buffer, "[999][1.5k][1.5Ki][3.2GiB][1M][1.00k][     1MiB][12    |][+1.23k][-56]") != 0) {
+        printf("prefixed flags: '%s'\n", buffer);
+    }
+    osl_snprintf(buffer, sizeof(buffer), "[%Rks][%Rks][%Rk][%RKB][%Rk][%Rks][%.2Rk][%Rk][%Rk][%RK][%Rk]",
+        0.25, 0.0000015, 12345.678, 1536.0, 0.0, -2.5e-7, 999.96, 1e30, 1e50, 0.5, 1e-30);
+    if (strcmp(buffer, "[250ms][1.5us][12.3k][1.5KiB][0][-250ns][1k][1000000Y][1e+50][0.5][1e-30]") != 0) {
+        printf("prefixed double: '%s'\n", buffer);
+    }
+    //%f followed by k or K is still %f and a letter
+    osl_snprintf(buffer, sizeof(buffer), "[%.1fK][%fkm]", 300.0, 2.5);
+    if (strcmp(buffer, "[300.0K][2.500000km]") != 0) {
+        printf("prefixed after f: '%s'\n", buffer);
+    }
+    if (osl_snprintf(buffer, sizeof(buffer), "%Rd", 1.0) != -1 || errno != EINVAL) {
+        printf("prefixed %%Rd accepted\n");
+    }
+}
+
+//the day after year-month-day
+static void _osl_next_day(int* year, int* month, int* day) {
+    static const int days_of_month[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    int leap = (*year % 4 == 0 && *year % 100 != 0) || *year % 400 == 0;
+    if (*day < days_of_month[*month - 1] + (*month == 2 && leap)) {
+        (*day)++;
+        return;
+    }
+    *day = 1;
+    if (++*month > 12) {
+        *month = 1;
+        (*year)++;
+    }
+}
+
+void osl_format_test_timestamp() {
+    printf("test timestamp\n");
+    char buffer[256];
+    char expect[256];
+    //every day from 0001-01-01 to 9999-12-31 against a counting reference
+    int year = 1, month = 1, day = 1;
+    for (int64_t days = -719162; days <= 2932896; days++) {
+        osl_snprintf(buffer, sizeof(buffer), "%T", (int64_t)(days * 86400 + 86399));
+        osl_snprintf(expect, sizeof(expect), "%04d-%02d-%02dT23:59:59Z", year, month, day);
+        if (strcmp(expect, buffer) != 0) {
+            printf("timestamp day %lld: '%s' '%s'\n", (long long)days, expect, buffer);
+            break;
+        }
+        _osl_next_day(&year, &month, &day);
+    }
+    //every second of the days around the epoch with a millisecond fraction, the cache changes minute on the way
+    year = 1969; month = 12; day = 31;
+    for (int64_t second = -86400; second < 86400; second++) {
+        int64_t of_day = second < 0 ? second + 86400 : second;
+        if (second == 0) {
+            year = 1970; month = 1; day = 1;
+        }
+        osl_snprintf(buffer, sizeof(buffer), "%.3T", (int64_t)(second * 1000 + (second & 511)));
+        osl_snprintf(expect, sizeof(expect), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", year, month, day,
+            (int)(of_day / 3600), (int)(of_day / 60 % 60), (int)(of_day % 60), (int)(second & 511));
+        if (strcmp(expect, buffer) != 0) {
+            printf("timestamp second %lld: '%s' '%s'\n", (long long)second, expect, buffer);
+            break;
+        }
+    }
+    osl_snprintf(buffer, sizeof(buffer), "[%T][%.3T][%.6T][%.9T][%T][%24T][%-21T|][%.T][%T][%T]",
+        (int64_t)951782400, (int64_t)-1, (int64_t)1700000000123456, (int64_t)1700000000123456789,
+        (int64_t)253402300799, (int64_t)0, (int64_t)0, (int64_t)59, (int64_t)-62167219200, (int64_t)253402300800);
+    if (strcmp(buffer, "[2000-02-29T00:00:00Z][1969-12-31T23:59:59.999Z][2023-11-14T22:13:20.123456Z]"
+        "[2023-11-14T22:13:20.123456789Z][9999-12-31T23:59:59Z][    1970-01-01T00:00:00Z][1970-01-01T00:00:00Z |]"
+        "[1970-01-01T00:00:59Z][0000-01-01T00:00:00Z][10000-01-01T00:00:00Z]") != 0) {
+        printf("timestamp flags: '%s'\n", buffer);
+    }
+    if (osl_snprintf(buffer, sizeof(buffer), "%.10T", (int64_t)0) >= 0) {
+        printf("timestamp precision: '%s'\n", buffer);
+    }
+    osl_snprintf(buffer, sizeof(buffer), "[%T][%T]", INT64_MIN, INT64_MAX);
+    if (strcmp(buffer, "[-292277022657-01-27T08:29:52Z][292277026596-12-04T15:30:07Z]") != 0) {
+        printf("timestamp range: '%s'\n", buffer);
+    }
+}
+
+//RFC 5952 text of an IPv6 address by trying every run of zero groups, the reference for %pI6
+static void _osl_ipv6_reference(char* expect, const unsigned char* addr) {
+    unsigned int groups[8];
+    int best = -1, best_len = 1;
+    for (int i = 0; i < 8; i++)
+        groups[i] = ((unsigned int)addr[i * 2] << 8) | addr[i * 2 + 1];
+    for (int start = 0; start < 8; start++) {
+        int len = 0;
+        while (start + len < 8 && groups[start + len] == 0)
+            len++;
+        if (len > best_len) {
+            best = start;
+            best_len = len;
+        }
+    }
+    char* pos = expect;
+    if (best == 0 && best_len == 5 && groups[5] == 0xffff) {
+        sprintf(pos, "::ffff:%u.%u.%u.%u", addr[12], addr[13], addr[14], addr[15]);
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        if (i == best) {
+            pos += sprintf(pos, i == 0 ? "::" : ":");
+            i += best_len - 1;
+            if (i == 7)
+                break;
+            continue;
+        }
+        pos += sprintf(pos, i < 7 ? "%x:" : "%x", groups[i]);
+    }
+    *pos = 0;
+}
+
+void osl_format_test_network() {
+    printf("test network\n");
+    char buffer[256];
+    char expect[256];
+    unsigned char addr[16];
+    uint64_t seed = 88172645463325252u;
+    for (int n = 0; n < 100000; n++) {
+        for (int i = 0; i < 16; i += 2) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            //mostly zero groups, so that runs of every length and position occur
+            int zero = (seed & 3) != 0;
+            addr[i] = zero ? 0 : (unsigned char)(seed >> 8);
+            addr[i + 1] = zero ? 0 : (unsigned char)(seed >> 16);
+            if (!zero && (seed & 4))
+                addr[i] = 0;
+        }
+        if (n % 97 == 0) {
+            memset(addr, 0, 10);
+            addr[10] = addr[11] = 0xff;
+        }
+        _osl_ipv6_reference(expect, addr);
+        osl_snprintf(buffer, sizeof(buffer), "%pI6", addr);
+        if (strcmp(expect, buffer) != 0) {
+            printf("ipv6: '%s' '%s'\n", expect, buffer);
+        }
+        sprintf(expect, "%u.%u.%u.%u", addr[12], addr[13], addr[14], (unsigned char)(seed >> 24));
+        addr[15] = (unsigned char)(seed >> 24);
+        osl_snprintf(buffer, sizeof(buffer), "%pI4", addr + 12);
+        if (strcmp(expect, buffer) != 0) {
+            printf("ipv4: '%s' '%s'\n", expect, buffer);
+        }
+    }
+    const unsigned char ipv4[4] = { 192, 0, 2, 1 };
+    const unsigned char ipv6[16] = { 0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0x01, 0, 0, 0, 0, 0, 0x01 };
+    const unsigned char mac[6] = { 0x00, 0x1a, 0x2b, 0x3c, 0x4d, 0xef };
+    const unsigned char uuid[16] = { 0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0,
+        0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef };
+    osl_snprintf(buffer, sizeof(buffer), "[%pI4][%16pI4][%-12pI4|][%pI6][%pM][%pU][%pUb][%pUB][%pUl][%pUL][%pI]",
+        ipv4, ipv4, ipv4, ipv6, mac, uuid, uuid, uuid, uuid, uuid, (void*)0);
+    osl_snprintf(expect, sizeof(expect), "[192.0.2.1][       192.0.2.1][192.0.2.1   |][2001:db8::1:0:0:1][00:1a:2b:3c:4d:ef]"
+        "[12345678-9abc-def0-0123-456789abcdef][12345678-9abc-def0-0123-456789abcdef]"
+        "[12345678-9ABC-DEF0-0123-456789ABCDEF][78563412-bc9a-f0de-0123-456789abcdef]"
+        "[78563412-BC9A-F0DE-0123-456789ABCDEF][%pI]", (void*)0);
+    if (strcmp(buffer, expect) != 0) {
+        printf("network flags: '%s'\n", buffer);
+    }
+    //every extension prints (null) for a NULL pointer, padded to the width like %s
+    osl_snprintf(buffer, sizeof(buffer), "[%pI4][%-8pI6|][%pM][%pUL][%pN][%8ph][%pHC][%pX][%pV][%pEj]",
+        NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+    if (strcmp(buffer, "[(null)][(null)  |][(null)][(null)][(null)][  (null)][(null)][(null)][(null)][(null)]") != 0) {
+        printf("network null: '%s'\n", buffer);
+    }
+}
+
+typedef struct OslTestTraceId OslTestTraceId;
+struct OslTestTraceId {
+    uint64_t high;
+    uint64_t low;
+};
+
+//%!t, 32 hex digits of a trace id, "0x" first with '#'
+static int _osl_trace_id_handler(OslFormatSink* sink, const OslFormatSpec* spec, const void* value, void* context) {
+    const OslTestTraceId* id = (const OslTestTraceId*)value;
+    char buf[34];
+    char* pos = buf;
+    (void)context;
+    if (spec->flags & OSL_FORMAT_FLAG_ALTERNATE_FORM) {
+        *pos++ = '0';
+        *pos++ = 'x';
+    }
+    for (int shift = 124; shift >= 0; shift -= 4) {
+        uint64_t part = shift >= 64 ? id->high >> (shift - 64) : id->low >> shift;
+        *pos++ = "0123456789abcdef"[part & 15];
+    }
+    return osl_format_sink_write(sink, buf, pos - buf);
+}
+
+//%!e, the name of an int from the table in context, padded to the width
+static int _osl_enum_handler(OslFormatSink* sink, const OslFormatSpec* spec, const void* value, void* context) {
+    const char* name = ((const char* const*)context)[*(const int*)value];
+    intptr_t len = (intptr_t)strlen(name);
+    intptr_t padding = spec->width > len ? spec->width - len : 0;
+    if (spec->precision >= 0 && spec->precision < len)
+        len = spec->precision;
+    if (!(spec->flags & OSL_FORMAT_FLAG_LEFT_ALIGN) && osl_format_sink_fill(sink, ' ', padding) < 0)
+        return -1;
+    if (osl_format_sink_write(sink, name, len) < 0)
+        return -1;
+    if ((spec->flags & OSL_FORMAT_FLAG_LEFT_ALIGN) && osl_format_sink_fill(sink, ' ', padding) < 0)
+        return -1;
+    return 0;
+}
+
+void osl_format_test_custom() {
+    printf("test custom\n");
+    static const char* colors[] = { "red", "green", "blue" };
+    char buffer[256];
+    char expect[256];
+    OslTestTraceId id = { UINT64_C(0x0123456789abcdef), UINT64_C(0xfedcba9876543210) };
+    int green = 1;
+    int blue = 2;
+    osl_format_register('t', _osl_trace_id_handler, NULL);
+    osl_format_register('e', _osl_enum_handler, (void*)colors);
+    osl_snprintf(buffer, sizeof(buffer), "[%!t][%#!t][%7!e][%-7!e|][%.2!e][%d]", &id, &id, &green, &blue, &green, 42);
+    if (strcmp(buffer, "[0123456789abcdeffedcba9876543210][0x0123456789abcdeffedcba9876543210]"
+        "[  green][blue   |][gr][42]") != 0) {
+        printf("custom: '%s'\n", buffer);
+    }
+    //handlers write through the formatter, so output that stops and resumes skips what was written
+    snprintf(expect, sizeof(expect), "id=%d trace=0123456789abcdeffedcba9876543210 color=%-6s|%s|", 7, "blue", "end");
+    for (int chunk = 1; chunk < 40; chunk++) {
+        _osl_resume_format(buffer, chunk, "id=%d trace=%!t color=%-6!e|%s|", 7, &id, &blue, "end");
+        if (strcmp(expect, buffer) != 0) {
+            printf("custom resume %d: '%s' '%s'\n", chunk, expect, buffer);
+        }
+    }
+    if (_osl_limit_format(buffer, sizeof(buffer), 12, "...", "trace=%!t", &id) != 15
+        || strcmp(buffer, "trace=012345...") != 0) {
+        printf("custom limit: '%s'\n", buffer);
+    }
+    osl_format_register('t', NULL, NULL);
+    if (osl_snprintf(buffer, sizeof(buffer), "%!t", &id) >= 0 || osl_snprintf(buffer, sizeof(buffer), "%!") >= 0
+        || osl_format_register(0, _osl_enum_handler, NULL) >= 0) {
+        printf("custom unregistered: '%s'\n", buffer);
+    }
+    osl_format_register('e', NULL, NULL);
+}
+
+//the output of a check call, NULL if it failed
+static const char* _osl_generated_call(OslGeneratedCall call, char* buffer, intptr_t size, const OslGeneratedValue* values, intptr_t* len) {
+    struct vsnformat_data data;
+    data.buffer = buffer;
+    data.count = size;
+    *len = call((OslFormatWriteFunc)_osl_vsnformat_write, &data, values);
+    return *len >= 0 ? buffer : NULL;
+}
+
+void osl_format_test_generated() {
+    printf("test generated\n");
+    static char buffer[2048];
+    static char expect[2048];
+    static char long_string[301];
+    double doubles[] = { 0.0, -0.0, 1.0, -1.5, 0.5, 2.5, 0.0005, 0.00049999999999999999, 123456.789,
+        -987654321.125, 1e15, 1e16, 1e22, 1e-7, 3.14159265358979, 1.0 / 3, 0, 0, 0 };
+    const char* strings[] = { "", "a", "abc", "hello world", NULL, long_string };
+    OslGeneratedValue values[OSL_COMPILED_MAX_OPS];
+    uint64_t seed = 88172645463325252u;
+    memset(long_string, 'x', sizeof(long_string) - 1);
+    doubles[16] = strtod("inf", NULL);
+    doubles[17] = strtod("-inf", NULL);
+    doubles[18] = strtod("nan", NULL);
+    for (const OslGeneratedCheck* check = formatTestGenerated_checks; check->name != NULL; check++) {
+        for (int n = 0; n < 2000; n++) {
+            intptr_t len;
+            intptr_t expect_len;
+            for (int i = 0; i < check->arg_count; i++) {
+                seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+                values[i].i = (int64_t)(seed >> (seed % 64));
+                if (seed & 0x100)
+                    values[i].i = -values[i].i;
+                if (n % 7 == 0)
+                    values[i].i = n % 3 == 0 ? 0 : (int64_t)(seed % 2000) - 1000;
+                values[i].f = (n + i) % 4 == 0 ? doubles[(seed >> 8) % (sizeof(doubles) / sizeof(doubles[0]))]
+                    : (double)(int64_t)(seed >> 11) / (double)(UINT64_C(1) << ((seed >> 3) % 64)) * ((seed & 4) ? -1 : 1);
+                values[i].s = strings[(seed >> 16) % (sizeof(strings) / sizeof(strings[0]))];
+            }
+            _osl_generated_call(check->reference, expect, sizeof(expect), values, &expect_len);
+            _osl_generated_call(check->generated, buffer, sizeof(buffer), values, &len);
+            if (len != expect_len || (len > 0 && memcmp(buffer, expect, len) != 0)) {
+                printf("generated %s: %d '%.*s' %d '%.*s'\n", check->name, (int)expect_len,
+                    (int)(expect_len > 0 ? expect_len : 0), expect, (int)len, (int)(len > 0 ? len : 0), buffer);
+                break;
+            }
+            //a sink that refuses the output fails both
+            _osl_generated_call(check->reference, expect, 8, values, &expect_len);
+            _osl_generated_call(check->generated, buffer, 8, values, &len);
+            if ((len < 0) != (expect_len < 0)) {
+                printf("generated %s short sink: %d %d\n", check->name, (int)expect_len, (int)len);
+                break;
+            }
+        }
+    }
+}
+
 void osl_format_test() {
+    osl_format_test_generated();
+    osl_format_test_custom();
+    osl_format_test_network();
+    osl_format_test_timestamp();
+    osl_format_test_prefixed();
+    osl_format_test_small_float();
+    osl_format_test_decimal();
+    osl_format_test_scaled();
+    osl_format_test_wide();
+    osl_format_test_utf8();
+    osl_format_test_string();
+    osl_format_test_escape();
+    osl_format_test_hex();
+    osl_format_test_length();
+#if defined(__SIZEOF_INT128__)
+    osl_format_test_int128();
+#endif
+    osl_format_test_fixed();
+    osl_format_test_join();
+    osl_format_test_columns();
+    osl_format_test_columns_parallel();
+    osl_format_test_template();
+    osl_format_test_counter();
+    osl_format_test_cache();
+    osl_format_test_precision();
+    osl_format_test_resume();
+    osl_format_test_limit();
     osl_format_test_impl();
     printf("\ntest finished.\n");
 }
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FORMAT_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define FORMAT_USE_SSE2 0
+#endif
+
+#include "format.h"
+
+#ifndef FALSE
+#define FALSE 0
+#endif // FALSE
+
+#ifndef TRUE
+#define TRUE 1
+#endif // TRUE
+
+typedef int ibool;
+
+#define WIDE_BUFFER_UNITS 256
+#define WIDE_FORMAT_STACK 512
+#define WIDE_REPLACEMENT 0xFFFD
+
+//the state of a UTF-8 character whose bytes are not all seen yet
+typedef struct OslWideUtf8 OslWideUtf8;
+struct OslWideUtf8 {
+  int32_t value;
+  int need;   //continuation bytes still missing, 0 between characters
+  int length; //bytes of the character
+};
+
+//bytes of a character by its lead byte >> 3, 0 for a byte that can not start one
+static const unsigned char _wide_utf8_lengths[32] = {
+  1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+  0, 0, 0, 0, 0, 0, 0, 0, 2, 2, 2, 2, 3, 3, 4, 0
+};
+
+static const int32_t _wide_utf8_min[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+/// <summary>
+/// Decodes the next character of a UTF-8 stream. Invalid, overlong and surrogate sequences
+/// decode to U+FFFD; a byte that breaks a sequence is left for the next character.
+/// </summary>
+/// <returns>the code point, or -1 if the bytes up to end were taken into the pending state</returns>
+static int32_t _wide_utf8_next(OslWideUtf8* state, const unsigned char** ppos, const unsigned char* end) {
+  const unsigned char* pos = *ppos;
+  while (pos < end) {
+    unsigned char c = *pos;
+    if (state->need == 0) {
+      int length = _wide_utf8_lengths[c >> 3];
+      pos++;
+      if (length <= 1) {
+        *ppos = pos;
+        return length == 1 ? c : WIDE_REPLACEMENT;
+      }
+      state->value = c & (0x7F >> length);
+      state->need = length - 1;
+      state->length = length;
+      continue;
+    }
+    if ((c & 0xC0) != 0x80) {
+      state->need = 0;
+      *ppos = pos;
+      return WIDE_REPLACEMENT;
+    }
+    pos++;
+    state->value = (state->value << 6) | (c & 0x3F);
+    if (--state->need == 0) {
+      int32_t cp = state->value;
+      *ppos = pos;
+      if (cp < _wide_utf8_min[state->length] || cp > 0x10FFFF || (0xD800 <= cp && cp < 0xE000))
+        return WIDE_REPLACEMENT;
+      return cp;
+    }
+  }
+  *ppos = pos;
+  return -1;
+}
+
+static int _wide_utf8_encode(unsigned char* pos, uint32_t cp) {
+  if (cp < 0x80) {
+    pos[0] = (unsigned char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    pos[0] = (unsigned char)(0xC0 | (cp >> 6));
+    pos[1] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    pos[0] = (unsigned char)(0xE0 | (cp >> 12));
+    pos[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+    pos[2] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  pos[0] = (unsigned char)(0xF0 | (cp >> 18));
+  pos[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+  pos[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+  pos[3] = (unsigned char)(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+#define WIDE_CONCAT(a, b) a##b
+
+#define WIDE_UNIT char16_t
+#define WIDE_UTF16 1
+#define WIDE_UTF8_PER_UNIT 3
+#define WIDE_NAME(name) WIDE_CONCAT(name, 16)
+#include "formatWideImpl.h"
+#undef WIDE_UNIT
+#undef WIDE_UTF16
+#undef WIDE_UTF8_PER_UNIT
+#undef WIDE_NAME
+
+#define WIDE_UNIT char32_t
+#define WIDE_UTF16 0
+#define WIDE_UTF8_PER_UNIT 4
+#define WIDE_NAME(name) WIDE_CONCAT(name, 32)
+#include "formatWideImpl.h"
+#undef WIDE_UNIT
+#undef WIDE_UTF16
+#undef WIDE_UTF8_PER_UNIT
+#undef WIDE_NAME
+
+//wchar_t is UTF-16 on Windows and UTF-32 elsewhere
+#define WIDE_UNIT wchar_t
+#if WCHAR_MAX > 0xFFFF
+#define WIDE_UTF16 0
+#define WIDE_UTF8_PER_UNIT 4
+#else
+#define WIDE_UTF16 1
+#define WIDE_UTF8_PER_UNIT 3
+#endif
+#define WIDE_NAME(name) WIDE_CONCAT(name, W)
+#include "formatWideImpl.h"
+#undef WIDE_UNIT
+#undef WIDE_UTF16
+#undef WIDE_UTF8_PER_UNIT
+#undef WIDE_NAME
+
+/// <summary>
+/// Like osl_vformat, but the output is UTF-16. The narrow core formats as usual and each piece
+/// it writes is converted on the way to writefunc, there is no second pass over the output.
+/// </summary>
+/// <returns>the number of code units written, or a negative value if an output error occurs</returns>
+intptr_t osl_vformat16(OslFormatWriteFunc16 writefunc, void* userData, const char* format, va_list argptr) {
+  return _wide_format16(writefunc, userData, format, argptr);
+}
+
+/// <summary>
+/// osl_vformat16 with a UTF-16 format.
+/// </summary>
+intptr_t osl_vformat16_wide(OslFormatWriteFunc16 writefunc, void* userData, const char16_t* format, va_list argptr) {
+  return _wide_format_wide16(writefunc, userData, format, argptr);
+}
+
+/// <summary>
+/// Like osl_vformat16, but the output is UTF-32.
+/// </summary>
+intptr_t osl_vformat32(OslFormatWriteFunc32 writefunc, void* userData, const char* format, va_list argptr) {
+  return _wide_format32(writefunc, userData, format, argptr);
+}
+
+intptr_t osl_vformat32_wide(OslFormatWriteFunc32 writefunc, void* userData, const char32_t* format, va_list argptr) {
+  return _wide_format_wide32(writefunc, userData, format, argptr);
+}
+
+/// <summary>
+/// Like osl_vformat16, but the output is wchar_t: UTF-16 on Windows and UTF-32 elsewhere.
+/// </summary>
+intptr_t osl_vformatw(OslFormatWriteFuncW writefunc, void* userData, const char* format, va_list argptr) {
+  return _wide_formatW(writefunc, userData, format, argptr);
+}
+
+intptr_t osl_vformatw_wide(OslFormatWriteFuncW writefunc, void* userData, const wchar_t* format, va_list argptr) {
+  return _wide_format_wideW(writefunc, userData, format, argptr);
+}
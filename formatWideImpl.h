@@ -0,0 +1,173 @@
+// Code unit template of formatWide.c, included once per output type with
+// WIDE_UNIT        the code unit type
+// WIDE_UTF16       1 for UTF-16 code units, 0 for UTF-32
+// WIDE_UTF8_PER_UNIT  the most UTF-8 bytes a code unit of a format narrows to
+// WIDE_NAME(name)  name with the suffix of the type
+
+typedef struct WIDE_NAME(OslWideSink) WIDE_NAME(OslWideSink);
+struct WIDE_NAME(OslWideSink) {
+  intptr_t(*writefunc)(void* userData, const WIDE_UNIT* sz, intptr_t len);
+  void* userData;
+  intptr_t count;
+  OslWideUtf8 utf8;
+};
+
+//the sink of a NULL writefunc, only counts the code units
+static intptr_t WIDE_NAME(_wide_null_write)(void* userData, const WIDE_UNIT* sz, intptr_t len) {
+  return len;
+}
+
+static ibool WIDE_NAME(_wide_flush)(WIDE_NAME(OslWideSink)* sink, const WIDE_UNIT* buf, intptr_t n) {
+  if (n == 0)
+    return TRUE;
+  if (sink->writefunc(sink->userData, buf, n) != n)
+    return FALSE;
+  sink->count += n;
+  return TRUE;
+}
+
+static intptr_t WIDE_NAME(_wide_encode)(WIDE_UNIT* pos, int32_t cp) {
+#if WIDE_UTF16
+  if (cp >= 0x10000) {
+    cp -= 0x10000;
+    pos[0] = (WIDE_UNIT)(0xD800 + (cp >> 10));
+    pos[1] = (WIDE_UNIT)(0xDC00 + (cp & 0x3FF));
+    return 2;
+  }
+#endif // WIDE_UTF16
+  pos[0] = (WIDE_UNIT)cp;
+  return 1;
+}
+
+#if FORMAT_USE_SSE2 == 1
+//widens 16 ASCII bytes by interleaving them with zero bytes
+static void WIDE_NAME(_wide_store_ascii)(WIDE_UNIT* pos, __m128i bytes) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+  __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+  if (sizeof(WIDE_UNIT) == 2) {
+    _mm_storeu_si128((__m128i*)pos, lo);
+    _mm_storeu_si128((__m128i*)(pos + 8), hi);
+  } else {
+    _mm_storeu_si128((__m128i*)pos, _mm_unpacklo_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(pos + 4), _mm_unpackhi_epi16(lo, zero));
+    _mm_storeu_si128((__m128i*)(pos + 8), _mm_unpacklo_epi16(hi, zero));
+    _mm_storeu_si128((__m128i*)(pos + 12), _mm_unpackhi_epi16(hi, zero));
+  }
+}
+#endif // FORMAT_USE_SSE2
+
+/// <summary>
+/// The write callback given to the narrow core, converts the UTF-8 piece into code units
+/// on the stack and passes them on. A character split across pieces is finished by the next one.
+/// </summary>
+static intptr_t WIDE_NAME(_wide_write)(WIDE_NAME(OslWideSink)* sink, const char* sz, intptr_t len) {
+  WIDE_UNIT buf[WIDE_BUFFER_UNITS];
+  const unsigned char* pos = (const unsigned char*)sz;
+  const unsigned char* end = pos + len;
+  intptr_t n = 0;
+  while (pos < end) {
+    if (n > WIDE_BUFFER_UNITS - 2) {
+      if (!WIDE_NAME(_wide_flush)(sink, buf, n))
+        return -1;
+      n = 0;
+    }
+    if (sink->utf8.need == 0 && *pos < 0x80) {
+      //the common case, ASCII widens one byte to one unit
+      intptr_t run = end - pos;
+      intptr_t i = 0;
+      if (run > WIDE_BUFFER_UNITS - n)
+        run = WIDE_BUFFER_UNITS - n;
+#if FORMAT_USE_SSE2 == 1
+      for (; i + 16 <= run; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(pos + i));
+        if (_mm_movemask_epi8(bytes) != 0)
+          break;
+        WIDE_NAME(_wide_store_ascii)(buf + n + i, bytes);
+      }
+#endif // FORMAT_USE_SSE2
+      for (; i < run && pos[i] < 0x80; i++) {
+        buf[n + i] = pos[i];
+      }
+      pos += i;
+      n += i;
+    } else {
+      int32_t cp = _wide_utf8_next(&sink->utf8, &pos, end);
+      if (cp >= 0)
+        n += WIDE_NAME(_wide_encode)(buf + n, cp);
+    }
+  }
+  if (!WIDE_NAME(_wide_flush)(sink, buf, n))
+    return -1;
+  return len;
+}
+
+static intptr_t WIDE_NAME(_wide_format)(intptr_t(*writefunc)(void* userData, const WIDE_UNIT* sz, intptr_t len),
+  void* userData, const char* format, va_list argptr) {
+  WIDE_NAME(OslWideSink) sink;
+  intptr_t rv;
+  WIDE_UNIT replacement[1];
+  sink.writefunc = writefunc;
+  sink.userData = userData;
+  if (writefunc == NULL)
+    sink.writefunc = WIDE_NAME(_wide_null_write);
+  sink.count = 0;
+  sink.utf8.need = 0;
+  //%s pads and cuts in the code units written here
+  rv = osl_vformat_units((OslFormatWriteFunc)WIDE_NAME(_wide_write), &sink, WIDE_UTF16 ? 16 : 32, format, argptr);
+  if (rv < 0)
+    return rv;
+  if (sink.utf8.need != 0) {
+    //the output ended inside a character
+    replacement[0] = WIDE_REPLACEMENT;
+    if (!WIDE_NAME(_wide_flush)(&sink, replacement, 1))
+      return -1;
+  }
+  return sink.count;
+}
+
+/// <summary>
+/// Encodes the code units of a wide format as UTF-8, unpaired surrogates become U+FFFD.
+/// </summary>
+/// <param name="buffer">receives the format, it needs WIDE_UTF8_PER_UNIT bytes per code unit and a null</param>
+static void WIDE_NAME(_wide_narrow_format)(const WIDE_UNIT* format, char* buffer) {
+  const WIDE_UNIT* psz = format;
+  unsigned char* pos = (unsigned char*)buffer;
+  while (*psz) {
+    uint32_t cp = (uint32_t)*psz++;
+    if (cp < 0x80) {
+      *pos++ = (unsigned char)cp;
+      continue;
+    }
+#if WIDE_UTF16
+    if (0xD800 <= cp && cp < 0xDC00 && 0xDC00 <= *psz && *psz < 0xE000) {
+      cp = 0x10000 + ((cp - 0xD800) << 10) + (*psz++ - 0xDC00);
+    }
+#endif // WIDE_UTF16
+    if ((0xD800 <= cp && cp < 0xE000) || cp > 0x10FFFF)
+      cp = WIDE_REPLACEMENT;
+    pos += _wide_utf8_encode(pos, cp);
+  }
+  *pos = 0;
+}
+
+static intptr_t WIDE_NAME(_wide_format_wide)(intptr_t(*writefunc)(void* userData, const WIDE_UNIT* sz, intptr_t len),
+  void* userData, const WIDE_UNIT* format, va_list argptr) {
+  char stack[WIDE_FORMAT_STACK];
+  char* buffer = stack;
+  intptr_t len = 0;
+  intptr_t rv;
+  while (format[len]) {
+    len++;
+  }
+  if (len >= WIDE_FORMAT_STACK / WIDE_UTF8_PER_UNIT) {
+    buffer = (char*)malloc(len * WIDE_UTF8_PER_UNIT + 1);
+    if (buffer == NULL)
+      return -1;
+  }
+  WIDE_NAME(_wide_narrow_format)(format, buffer);
+  rv = WIDE_NAME(_wide_format)(writefunc, userData, buffer, argptr);
+  if (buffer != stack)
+    free(buffer);
+  return rv;
+}
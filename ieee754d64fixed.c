@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <string.h>
+#include "format.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FIXED_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define FIXED_USE_SSE2 0
+#endif
+
+//the largest precision of the fast path, 10^15 and its halves are exact
+#define FIXED_MAX_PRECISION 15
+//scaled values from 2^51 on are left to ieee754d64tos
+#define FIXED_LIMIT 2251799813685248.0
+#define FIXED_MAGIC 4503599627370496.0  //2^52
+#define FIXED_SPLITTER 134217729.0      //2^27 + 1
+
+static const double fixed_powers[FIXED_MAX_PRECISION + 1] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15
+};
+
+int ieee754d64fixed(const double* values, intptr_t count, int precision, uint64_t* scaled, unsigned char* ok);
+
+/// <summary>
+/// round(|value| * 10^precision) to nearest, ties to even, of the exact product.
+/// The product p is split as p + e with Dekker's two-product, then p is rounded with the 2^52 trick
+/// and moved by one when p lies exactly halfway and e breaks the tie.
+/// </summary>
+static int ieee754d64fixed_one(double value, double scale, double scale_hi, double scale_lo, uint64_t* scaled) {
+  double a = value < 0 ? -value : value;
+  double p = a * scale;
+  if (!(p < FIXED_LIMIT))
+    return 0;
+  double t = a * FIXED_SPLITTER;
+  double a_hi = t - (t - a);
+  double a_lo = a - a_hi;
+  double e = ((a_hi * scale_hi - p) + a_hi * scale_lo + a_lo * scale_hi) + a_lo * scale_lo;
+  double r = (p + FIXED_MAGIC) - FIXED_MAGIC;
+  double diff = p - r;
+  uint64_t n = (uint64_t)r;
+  if (diff == 0.5 && e > 0)
+    n++;
+  else if (diff == -0.5 && e < 0)
+    n--;
+  *scaled = n;
+  return 1;
+}
+
+/// <summary>
+/// Converts count doubles to |value| * 10^precision rounded like %.precisionf, two at a time with SSE2.
+/// ok[i] is 0 for values the fast path does not cover (inf, nan, too large), which need ieee754d64tos.
+/// </summary>
+/// <returns>the number of values converted, -1 when precision is out of the fast path</returns>
+int ieee754d64fixed(const double* values, intptr_t count, int precision, uint64_t* scaled, unsigned char* ok) {
+  if (precision < 0 || precision > FIXED_MAX_PRECISION)
+    return -1;
+  double scale = fixed_powers[precision];
+  double t = scale * FIXED_SPLITTER;
+  double scale_hi = t - (t - scale);
+  double scale_lo = scale - scale_hi;
+  int converted = 0;
+  intptr_t i = 0;
+#if FIXED_USE_SSE2 == 1
+  const __m128i sign_mask = _mm_set1_epi64x(INT64_MAX);
+  const __m128d vscale = _mm_set1_pd(scale);
+  const __m128d vscale_hi = _mm_set1_pd(scale_hi);
+  const __m128d vscale_lo = _mm_set1_pd(scale_lo);
+  const __m128d splitter = _mm_set1_pd(FIXED_SPLITTER);
+  const __m128d magic = _mm_set1_pd(FIXED_MAGIC);
+  const __m128d limit = _mm_set1_pd(FIXED_LIMIT);
+  const __m128d half = _mm_set1_pd(0.5);
+  const __m128d zero = _mm_setzero_pd();
+  for (; i + 2 <= count; i += 2) {
+    __m128d a = _mm_and_pd(_mm_loadu_pd(values + i), _mm_castsi128_pd(sign_mask));
+    __m128d p = _mm_mul_pd(a, vscale);
+    __m128d t2 = _mm_mul_pd(a, splitter);
+    __m128d a_hi = _mm_sub_pd(t2, _mm_sub_pd(t2, a));
+    __m128d a_lo = _mm_sub_pd(a, a_hi);
+    __m128d e = _mm_sub_pd(_mm_mul_pd(a_hi, vscale_hi), p);
+    e = _mm_add_pd(e, _mm_mul_pd(a_hi, vscale_lo));
+    e = _mm_add_pd(e, _mm_mul_pd(a_lo, vscale_hi));
+    e = _mm_add_pd(e, _mm_mul_pd(a_lo, vscale_lo));
+    __m128d biased = _mm_add_pd(p, magic);
+    __m128d diff = _mm_sub_pd(p, _mm_sub_pd(biased, magic));
+    //the integer is in the low mantissa bits of p + 2^52
+    __m128i n = _mm_sub_epi64(_mm_castpd_si128(biased), _mm_castpd_si128(magic));
+    __m128d up = _mm_and_pd(_mm_cmpeq_pd(diff, half), _mm_cmpgt_pd(e, zero));
+    __m128d down = _mm_and_pd(_mm_cmpeq_pd(diff, _mm_sub_pd(zero, half)), _mm_cmplt_pd(e, zero));
+    n = _mm_sub_epi64(n, _mm_castpd_si128(up));
+    n = _mm_add_epi64(n, _mm_castpd_si128(down));
+    _mm_storeu_si128((__m128i*)(scaled + i), n);
+    int in_range = _mm_movemask_pd(_mm_cmplt_pd(p, limit));
+    ok[i] = (unsigned char)(in_range & 1);
+    ok[i + 1] = (unsigned char)(in_range >> 1);
+    converted += (in_range & 1) + (in_range >> 1);
+  }
+#endif // FIXED_USE_SSE2
+  for (; i < count; i++) {
+    ok[i] = (unsigned char)ieee754d64fixed_one(values[i], scale, scale_hi, scale_lo, scaled + i);
+    converted += ok[i];
+  }
+  return converted;
+}
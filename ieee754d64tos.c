@@ -17,6 +17,18 @@ int ieee754d64tos(double val, char* buf, int buflen, char specifier, int precisi
 
 #define BIGNUM_ROUND_AWAY_FROM_ZERO 0
 #define BIGNUM_IEEE754D64_USE_CACHE 1
+//per thread direct-mapped cache of converted values, must be a power of two, 0 disables it
+#ifndef BIGNUM_IEEE754D64_RESULT_CACHE_SIZE
+#define BIGNUM_IEEE754D64_RESULT_CACHE_SIZE 256
+#endif
+//longer digit strings are not cached
+#define BIGNUM_IEEE754D64_RESULT_CACHE_DIGITS 27
+
+#if defined(_MSC_VER)
+#define BIGNUM_THREAD_LOCAL __declspec(thread)
+#else
+#define BIGNUM_THREAD_LOCAL __thread
+#endif
  
 typedef unsigned int BigNumDigit;
 typedef int BigNumDigitDiff;
@@ -554,6 +566,45 @@ static int bignum_to_dec(const BigNum* num, char* buf, int* ppow10) {
  
 
 #if BIGNUM_IEEE754D64_USE_CACHE ==1
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BIGNUM_CAS(p, expected, desired) (_InterlockedCompareExchange((p), (desired), (expected)) == (expected))
+#define BIGNUM_LOAD_ACQUIRE(p) (*(volatile long*)(p))
+#define BIGNUM_STORE_RELEASE(p, v) (*(volatile long*)(p) = (v))
+#else
+#define BIGNUM_CAS(p, expected, desired) __sync_bool_compare_and_swap((p), (expected), (desired))
+#define BIGNUM_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define BIGNUM_STORE_RELEASE(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+
+#define BIGNUM_POW_EMPTY 0
+#define BIGNUM_POW_FILLING 1
+#define BIGNUM_POW_READY 2
+
+/// <summary>
+/// pow(base, n) from a table shared by all threads.
+/// An entry is filled once by the thread that claims it, others wait until it is ready.
+/// </summary>
+static const BigNum* bignum_pow_for_ieee754d64(BigNum* nums, long* states, const BigNum* base, int n) {
+  BigNum* ret = nums + n;
+  long* state = states + n;
+  for (;;) {
+    long current = BIGNUM_LOAD_ACQUIRE(state);
+    if (current == BIGNUM_POW_READY)
+      return ret;
+    if (current == BIGNUM_POW_EMPTY && BIGNUM_CAS(state, BIGNUM_POW_EMPTY, BIGNUM_POW_FILLING)) {
+      if (0 != bignum_pow32(ret, base, n)) {
+        assert(FALSE);
+        BIGNUM_STORE_RELEASE(state, BIGNUM_POW_EMPTY);
+        return NULL;
+      }
+      BIGNUM_STORE_RELEASE(state, BIGNUM_POW_READY);
+      return ret;
+    }
+  }
+}
+
 static const BigNum* bignum_5_pow_for_ieee754d64(int n) {
   // orign_exp: 0_2047
   // exp=orign_exp-1023: -1023_1024
@@ -561,15 +612,9 @@ static const BigNum* bignum_5_pow_for_ieee754d64(int n) {
   // 52-exp:1075_-972
   assert(n>=0 && n< 1076);
   static BigNum nums[1076]; 
-  BigNum* ret = nums + n;
-  if (ret->length == 0) {
-    static const BigNumSmall big_5 = { 1,{5} };
-    if (0 != bignum_pow32(ret, (const BigNum*)&big_5,n)) {
-      assert(FALSE);
-      return NULL;
-    }
-  }
-  return ret;
+  static long states[1076];
+  static const BigNumSmall big_5 = { 1,{5} };
+  return bignum_pow_for_ieee754d64(nums, states, (const BigNum*)&big_5, n);
 }
 
 static const BigNum* bignum_2_pow_for_ieee754d64(int n) {
@@ -579,15 +624,9 @@ static const BigNum* bignum_2_pow_for_ieee754d64(int n) {
   // 52-exp:1075_-972
   assert(n >= 0 && n < 1076);
   static BigNum nums[1076];
-  BigNum* ret = nums + n;
-  if (ret->length == 0) {
-    static const BigNumSmall big_2 = { 1,{2} };
-    if (0 != bignum_pow32(ret, (const BigNum*)&big_2, n)) {
-      assert(FALSE);
-      return NULL;
-    }
-  }
-  return ret;
+  static long states[1076];
+  static const BigNumSmall big_2 = { 1,{2} };
+  return bignum_pow_for_ieee754d64(nums, states, (const BigNum*)&big_2, n);
 }
  
 #endif // BIGNUM_IEEE754D64_USE_CACHE
@@ -877,44 +916,14 @@ static int decint_convert_round_to(DecInt* result, const DecInt* num, int round_
 #endif
 
  
-int ieee754d64tos(double value, char* buf, int buflen, char specifier,
+/// <summary>
+/// Rounds num * pow(10, -pow10) for specifier 'e', 'f' or 'g' and writes the digits to buf
+/// </summary>
+static int decint_tos(const DecInt* num, int pow10, char* buf, int buflen, char specifier,
   int precision, int* pexp, int* pdotpos, char* gspecifier) {
-  *pexp = 0;
-  *pdotpos = 0;
-
-  DecInt num;
   DecInt result = { -1 };
-  int pow10;
-#if 0 // cache last value
-  static int  cached = FALSE;
-  static double cache_value = 0;
-  static int cache_pow10;
-  static DecInt cache;
-  if (cached && cache_value == value) {
-    pow10 = cache_pow10;
-    decint_assign(&num, &cache);
-  }
-  else {
-    num.length = decint_ieee754d64(num.digits, value, &pow10);
-    if (num.length < 0) {
-      buf[0] = 0;
-      return -1;
-    }
-    cached = TRUE;
-    decint_assign(&cache, &num);
-    cache_value = value;
-    cache_pow10 = pow10;
-  }
-#else
-  num.length = decint_ieee754d64(num.digits, value, &pow10);
-  if (num.length < 0) {
-    buf[0] = 0;
-    return -1;
-  }
-#endif  
-    
   char orign_specifier = specifier;
-  int exp = num.length - pow10 - 1;
+  int exp = num->length - pow10 - 1;
   *pexp = exp;
 
   if (precision < 0)
@@ -932,20 +941,20 @@ int ieee754d64tos(double value, char* buf, int buflen, char specifier,
     }
     else {
       specifier = 'f';
-      precision -= -pow10 + num.length;
+      precision -= -pow10 + num->length;
     }
     if (gspecifier)
       *gspecifier = specifier;
   }
 again:
-  decint_assign(&result, &num);
+  decint_assign(&result, num);
   if (specifier == 'f') {
-    int dotpos = -pow10 + num.length;
+    int dotpos = -pow10 + num->length;
     *pdotpos = dotpos;
     if (pow10 != 0) {
       int round_pos = dotpos + precision + 1;
       if (round_pos > 0) {
-        if (decint_convert_round_to(&result, &num, round_pos)) {
+        if (decint_convert_round_to(&result, num, round_pos)) {
           if (orign_specifier == 'g') {
             int new_exp = exp + 1;
             if (new_exp < -4 || new_exp >= orign_precision) {
@@ -980,11 +989,11 @@ again:
   else if (specifier == 'e') {
     *pdotpos = 1;
     int round_pos = 1 + precision + 1;
-    if (decint_convert_round_to(&result, &num, round_pos)) {
+    if (decint_convert_round_to(&result, num, round_pos)) {
       if (orign_specifier == 'g') {
         int new_exp = exp + 1;
         if (new_exp >= -4 && new_exp < orign_precision) {
-          precision = orign_precision - (-pow10 + num.length);
+          precision = orign_precision - (-pow10 + num->length);
           specifier = orign_specifier;
           orign_specifier = 0;
           specifier = 'f';
@@ -1007,10 +1016,129 @@ again:
   decint_to_string(&result, buf, buflen);
   return 0;
 }
+
+static int ieee754d64tos_convert(double value, char* buf, int buflen, char specifier,
+  int precision, int* pexp, int* pdotpos, char* gspecifier) {
+  *pexp = 0;
+  *pdotpos = 0;
+
+  DecInt num;
+  int pow10;
+  num.length = decint_ieee754d64(num.digits, value, &pow10);
+  if (num.length < 0) {
+    buf[0] = 0;
+    return -1;
+  }
+  return decint_tos(&num, pow10, buf, buflen, specifier, precision, pexp, pdotpos, gspecifier);
+}
+
+/// <summary>
+/// Like ieee754d64tos, for the exact decimal value digits * pow(10, exponent),
+/// digits are length ASCII digits most significant first.
+/// Used for the decimal floating point types, whose coefficient and exponent are already decimal.
+/// </summary>
+int ieee754dectos(const char* digits, int length, int exponent, char* buf, int buflen, char specifier,
+  int precision, int* pexp, int* pdotpos, char* gspecifier) {
+  DecInt num;
+  *pexp = 0;
+  *pdotpos = 0;
+  if (length <= 0 || length >= DECINT_BASE_SIZE) {
+    buf[0] = 0;
+    return -1;
+  }
+  while (length > 1 && digits[0] == '0') {
+    digits++;
+    length--;
+  }
+  if (length == 1 && digits[0] == '0')
+    exponent = 0;
+  for (int i = 0; i < length; i++) {
+    num.digits[length - 1 - i] = digits[i] - '0';
+  }
+  //the guard digit of a rounding at the most significant digit
+  num.digits[length] = 0;
+  num.length = length;
+  return decint_tos(&num, -exponent, buf, buflen, specifier, precision, pexp, pdotpos, gspecifier);
+}
  
 
 
  
 
+#if BIGNUM_IEEE754D64_RESULT_CACHE_SIZE > 0
+
+typedef struct Ieee754d64CacheEntry Ieee754d64CacheEntry;
+struct Ieee754d64CacheEntry {
+  uint64_t bits;
+  int precision;
+  char specifier; //0 for an empty entry
+  char gspecifier;
+  char length;
+  char digits[BIGNUM_IEEE754D64_RESULT_CACHE_DIGITS];
+  int exp;
+  int dotpos;
+};
+
+static BIGNUM_THREAD_LOCAL Ieee754d64CacheEntry ieee754d64_cache[BIGNUM_IEEE754D64_RESULT_CACHE_SIZE];
+static BIGNUM_THREAD_LOCAL uint64_t ieee754d64_cache_hits;
+static BIGNUM_THREAD_LOCAL uint64_t ieee754d64_cache_misses;
+
+#endif // BIGNUM_IEEE754D64_RESULT_CACHE_SIZE
 
+/// <summary>
+/// Counters of the calling thread's ieee754d64tos result cache
+/// </summary>
+void ieee754d64tos_cache_stats(uint64_t* hits, uint64_t* misses) {
+#if BIGNUM_IEEE754D64_RESULT_CACHE_SIZE > 0
+  *hits = ieee754d64_cache_hits;
+  *misses = ieee754d64_cache_misses;
+#else
+  *hits = 0;
+  *misses = 0;
+#endif // BIGNUM_IEEE754D64_RESULT_CACHE_SIZE
+}
 
+int ieee754d64tos(double value, char* buf, int buflen, char specifier,
+  int precision, int* pexp, int* pdotpos, char* gspecifier) {
+#if BIGNUM_IEEE754D64_RESULT_CACHE_SIZE > 0
+  union ui64_f64 ua;
+  ua.f = value;
+  uint64_t hash = (ua.ui ^ ((uint64_t)(unsigned int)precision << 8) ^ (unsigned char)specifier)
+    * UINT64_C(0x9E3779B97F4A7C15);
+  Ieee754d64CacheEntry* entry = ieee754d64_cache + ((hash >> 32) & (BIGNUM_IEEE754D64_RESULT_CACHE_SIZE - 1));
+  if (entry->specifier == specifier && entry->bits == ua.ui
+    && entry->precision == precision && entry->length < buflen) {
+    ieee754d64_cache_hits++;
+    memcpy(buf, entry->digits, entry->length);
+    buf[(int)entry->length] = 0;
+    *pexp = entry->exp;
+    *pdotpos = entry->dotpos;
+    if (gspecifier && specifier == 'g')
+      *gspecifier = entry->gspecifier;
+    return 0;
+  }
+  ieee754d64_cache_misses++;
+
+  char g = 0;
+  int rv = ieee754d64tos_convert(value, buf, buflen, specifier, precision, pexp, pdotpos, &g);
+  if (gspecifier && specifier == 'g')
+    *gspecifier = g;
+  if (rv == 0) {
+    size_t length = strlen(buf);
+    //a result cut by buflen is not the whole conversion
+    if (length < BIGNUM_IEEE754D64_RESULT_CACHE_DIGITS && (int)length < buflen) {
+      entry->bits = ua.ui;
+      entry->precision = precision;
+      entry->specifier = specifier;
+      entry->gspecifier = g;
+      entry->length = (char)length;
+      memcpy(entry->digits, buf, length);
+      entry->exp = *pexp;
+      entry->dotpos = *pdotpos;
+    }
+  }
+  return rv;
+#else
+  return ieee754d64tos_convert(value, buf, buflen, specifier, precision, pexp, pdotpos, gspecifier);
+#endif // BIGNUM_IEEE754D64_RESULT_CACHE_SIZE
+}
@@ -1,7 +1,12 @@
+#include <string.h>
  
 extern void osl_format_test();
-int main()
+extern void osl_format_bench();
+int main(int argc, char* argv[])
 {
-  osl_format_test();
+  if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    osl_format_bench();
+  else
+    osl_format_test();
 }
- 
\ No newline at end of file
+ 
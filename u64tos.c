@@ -0,0 +1,204 @@
+#include <string.h>
+#include <assert.h>
+#include "format.h"
+
+int u64tos(uint64_t value, char* buf);
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define U64TOS_USE_SSE2 1
+#include <emmintrin.h>
+#else
+#define U64TOS_USE_SSE2 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+static int u64tos_ctz(unsigned int mask) {
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+}
+#else
+#define u64tos_ctz(mask) __builtin_ctz(mask)
+#endif
+
+static const char u64tos_digit_pairs[201] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/// <summary>
+/// value < 100000000, two digits per division
+/// </summary>
+static int u32tos_small(uint32_t value, char* buf) {
+  char tmp[8];
+  char* pos = tmp + 8;
+  while (value >= 100) {
+    uint32_t pair = value % 100;
+    value /= 100;
+    pos -= 2;
+    memcpy(pos, u64tos_digit_pairs + pair * 2, 2);
+  }
+  if (value >= 10) {
+    pos -= 2;
+    memcpy(pos, u64tos_digit_pairs + value * 2, 2);
+  }
+  else {
+    pos--;
+    *pos = (char)('0' + value);
+  }
+  int len = (int)(tmp + 8 - pos);
+  memcpy(buf, pos, len);
+  return len;
+}
+
+#if U64TOS_USE_SSE2 == 1
+
+/// <summary>
+/// The 8 decimal digits of value < 100000000 as 16 bit lanes,
+/// abcdefgh is split into abcd and efgh, then each lane divides by 1000, 100, 10 and 1
+/// with multiply-high and subtracts ten times its neighbour.
+/// </summary>
+static __m128i u64tos_8digits_sse2(uint32_t value) {
+  const __m128i div10000 = _mm_set1_epi32((int)0xd1b71759);
+  const __m128i ten_thousand = _mm_set1_epi32(10000);
+  const __m128i div_powers = _mm_setr_epi16(8389, 5243, 13108, (short)0x8000, 8389, 5243, 13108, (short)0x8000);
+  const __m128i shift_powers = _mm_setr_epi16(1 << 7, 1 << 11, 1 << 13, (short)0x8000, 1 << 7, 1 << 11, 1 << 13, (short)0x8000);
+  const __m128i ten = _mm_set1_epi16(10);
+  //abcd, efgh = abcdefgh divmod 10000
+  __m128i abcdefgh = _mm_cvtsi32_si128((int)value);
+  __m128i abcd = _mm_srli_epi64(_mm_mul_epu32(abcdefgh, div10000), 45);
+  __m128i efgh = _mm_sub_epi32(abcdefgh, _mm_mul_epu32(abcd, ten_thousand));
+  //[abcd * 4, abcd * 4, abcd * 4, abcd * 4, efgh * 4, efgh * 4, efgh * 4, efgh * 4]
+  __m128i v1 = _mm_slli_epi64(_mm_unpacklo_epi16(abcd, efgh), 2);
+  __m128i v2 = _mm_unpacklo_epi16(v1, v1);
+  v2 = _mm_unpacklo_epi32(v2, v2);
+  //[a, ab, abc, abcd, e, ef, efg, efgh]
+  __m128i v3 = _mm_mulhi_epu16(_mm_mulhi_epu16(v2, div_powers), shift_powers);
+  //[0, a0, ab0, abc0, 0, e0, ef0, efg0]
+  __m128i v4 = _mm_slli_epi64(_mm_mullo_epi16(v3, ten), 16);
+  return _mm_sub_epi16(v3, v4);
+}
+
+//16 digits of hi and lo < 100000000 as ASCII
+static __m128i u64tos_16digits_sse2(uint32_t hi, uint32_t lo) {
+  __m128i digits = _mm_packus_epi16(u64tos_8digits_sse2(hi), u64tos_8digits_sse2(lo));
+  return _mm_add_epi8(digits, _mm_set1_epi8('0'));
+}
+
+#endif // U64TOS_USE_SSE2
+
+/// <summary>
+/// Writes the decimal digits of value to buf without a terminating null.
+/// Values of 9 digits and more are converted 16 digits at a time with SSE2 when available.
+/// </summary>
+/// <param name="buf">at least 20 characters</param>
+/// <returns>the number of digits</returns>
+int u64tos(uint64_t value, char* buf) {
+  if (value < 100000000)
+    return u32tos_small((uint32_t)value, buf);
+#if U64TOS_USE_SSE2 == 1
+  char tmp[16];
+  if (value < UINT64_C(10000000000000000)) {
+    __m128i digits = u64tos_16digits_sse2((uint32_t)(value / 100000000), (uint32_t)(value % 100000000));
+    _mm_storeu_si128((__m128i*)tmp, digits);
+    //value >= 100000000, so one of the first 8 digits is not zero
+    unsigned int zeros = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(digits, _mm_set1_epi8('0')));
+    int skip = u64tos_ctz(~zeros);
+    memcpy(buf, tmp + skip, 16 - skip);
+    return 16 - skip;
+  }
+  else {
+    uint64_t low = value % UINT64_C(10000000000000000);
+    int len = u32tos_small((uint32_t)(value / UINT64_C(10000000000000000)), buf);
+    _mm_storeu_si128((__m128i*)tmp, u64tos_16digits_sse2((uint32_t)(low / 100000000), (uint32_t)(low % 100000000)));
+    memcpy(buf + len, tmp, 16);
+    return len + 16;
+  }
+#else
+  char tmp[20];
+  char* pos = tmp + 20;
+  do {
+    uint32_t part = (uint32_t)(value % 100000000);
+    value /= 100000000;
+    if (value == 0) {
+      int len = u32tos_small(part, buf);
+      memcpy(buf + len, pos, tmp + 20 - pos);
+      return len + (int)(tmp + 20 - pos);
+    }
+    for (int i = 0; i < 4; i++) {
+      pos -= 2;
+      memcpy(pos, u64tos_digit_pairs + (part % 100) * 2, 2);
+      part /= 100;
+    }
+  } while (1);
+#endif // U64TOS_USE_SSE2
+}
+
+/// <summary>
+/// Writes exactly 19 digits of value < 10^19 with leading zeros
+/// </summary>
+static void u64tos_19digits(uint64_t value, char* buf) {
+  uint32_t top = (uint32_t)(value / UINT64_C(10000000000000000));
+  uint64_t low = value % UINT64_C(10000000000000000);
+  buf[0] = (char)('0' + top / 100);
+  memcpy(buf + 1, u64tos_digit_pairs + (top % 100) * 2, 2);
+#if U64TOS_USE_SSE2 == 1
+  _mm_storeu_si128((__m128i*)(buf + 3), u64tos_16digits_sse2((uint32_t)(low / 100000000), (uint32_t)(low % 100000000)));
+#else
+  for (char* pos = buf + 19; pos > buf + 3; pos -= 2) {
+    memcpy(pos - 2, u64tos_digit_pairs + (low % 100) * 2, 2);
+    low /= 100;
+  }
+#endif // U64TOS_USE_SSE2
+}
+
+#if defined(__SIZEOF_INT128__)
+
+/// <summary>
+/// Writes the decimal digits of value to buf without a terminating null.
+/// value is cut into 64 bit chunks of 19 digits by at most two 128 bit divisions,
+/// the chunks are converted by the 64 bit kernel.
+/// </summary>
+/// <param name="buf">at least 39 characters</param>
+/// <returns>the number of digits</returns>
+int osl_u128tos(osl_uint128_t value, char* buf) {
+  const uint64_t chunk = UINT64_C(10000000000000000000);
+  uint64_t low;
+  int len;
+  if ((value >> 64) == 0)
+    return u64tos((uint64_t)value, buf);
+  low = (uint64_t)(value % chunk);
+  value /= chunk;
+  if ((value >> 64) == 0) {
+    len = u64tos((uint64_t)value, buf);
+  }
+  else {
+    len = u64tos((uint64_t)(value / chunk), buf);
+    u64tos_19digits((uint64_t)(value % chunk), buf + len);
+    len += 19;
+  }
+  u64tos_19digits(low, buf + len);
+  return len + 19;
+}
+
+/// <summary>
+/// osl_u128tos with a leading '-' for negative values
+/// </summary>
+/// <param name="buf">at least 40 characters</param>
+int osl_i128tos(osl_int128_t value, char* buf) {
+  if (value < 0) {
+    *buf = '-';
+    return osl_u128tos((osl_uint128_t)0 - (osl_uint128_t)value, buf + 1) + 1;
+  }
+  return osl_u128tos((osl_uint128_t)value, buf);
+}
+
+#endif // __SIZEOF_INT128__